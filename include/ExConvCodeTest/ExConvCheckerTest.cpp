@@ -1,6 +1,17 @@
 #include "ExConvCheckerTest.h"
 #include "ExConvCodeTest/ExConvCodeTest.h"
 #include <iomanip>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
 #include "libOTe/Tools/CoeffCtx.h"
 
 namespace osuCrypto
@@ -80,6 +91,321 @@ namespace osuCrypto
     }
 
 
+    namespace
+    {
+        double logBinomial(double a, double b)
+        {
+            if (b < 0 || b > a)
+                return -std::numeric_limits<double>::infinity();
+            return std::lgamma(a + 1) - std::lgamma(b + 1) - std::lgamma(a - b + 1);
+        }
+
+        u64 rowWeight(const u64* row, u64 W)
+        {
+            u64 weight = 0;
+            for (u64 w = 0; w < W; ++w)
+                weight += popcount(row[w]);
+            return weight;
+        }
+    }
+
+    double isdFindProb(u64 n, u64 k, u64 w, u64 window, bool stern)
+    {
+        if (w == 0 || w > n)
+            return 0;
+
+        // the codeword has exactly one position in the information set and
+        // therefore is one of the rows.
+        auto denom = logBinomial(n, k);
+        double p = std::exp(std::log(double(w)) + logBinomial(n - w, k - 1.0) - denom);
+
+        // the codeword has two positions in the information set and is zero
+        // on the window.
+        if (stern && w >= 2)
+            p += std::exp(
+                logBinomial(w, 2) + logBinomial(n - w, k - 2.0) - denom +
+                logBinomial(double(n) - k - (w - 2.0), window) - logBinomial(n - k, window));
+
+        return std::min(p, 1.0);
+    }
+
+    ISDResult isdMinWeight(
+        Matrix<block> G,
+        u64 n,
+        const ISDParams& params,
+        std::atomic<u64>* progress)
+    {
+        auto k = G.rows();
+        auto W = G.cols() * 2;
+        if (k == 0 || k >= n || W * 64 < n || params.mThreads == 0)
+            throw RTE_LOC;
+        if (params.mIters == 0 && params.mSeconds == 0)
+            throw RTE_LOC;
+
+        auto window = params.mWindow ? params.mWindow : log2ceil(k);
+        window = std::min<u64>({ window, 64, n - k });
+
+        // G is put in systematic form in place. pivot[r] is the information
+        // set column of row r and info[c] is set if c is in the information set.
+        auto& S = G;
+        std::vector<u64> pivot(k);
+        std::vector<u8> info(n);
+
+        // clear any bits past n.
+        for (u64 i = 0; i < k; ++i)
+        {
+            auto row = (u64*)S.data(i);
+            if (n % 64)
+                row[n / 64] &= (1ull << (n % 64)) - 1;
+            for (u64 w = divCeil(n, 64); w < W; ++w)
+                row[w] = 0;
+        }
+
+        PRNG prng(params.mSeed);
+        std::vector<u64> perm(n);
+        std::iota(perm.begin(), perm.end(), 0);
+
+        std::mutex mtx;
+        std::atomic<u64> gMin(n);
+        u64 hits = 0, completed = 0, restarts = 0, rank = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto budget = params.mIters ? params.mIters : ~0ull;
+        auto period = params.mRestart ? params.mRestart : k;
+
+        auto record = [&](u64 weight) {
+            if (weight <= gMin.load(std::memory_order_relaxed))
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (weight < gMin)
+                {
+                    gMin = weight;
+                    hits = 1;
+                }
+                else if (weight == gMin)
+                    ++hits;
+            }
+        };
+
+        // All threads work on the one matrix S and split every elimination
+        // by rows, so the memory is that of a single generator whatever the
+        // thread count. Thread 0 makes the choices of each step (pivot row,
+        // swapped column, Stern window) between the barriers; the other
+        // threads only write their own rows.
+        auto nt = std::min<u64>(params.mThreads, k);
+        detail::Barrier barrier(nt);
+        std::vector<u64> cols(window), outside;
+        std::vector<std::pair<u64, u64>> keys(k);
+        std::vector<u64> buckets;
+        u64 r = 0, col = ~0ull;
+        bool stop = false, restart = false;
+
+        // rows q != r with a one in column c get row r added.
+        auto eliminate = [&](u64 qBegin, u64 qEnd, u64 r, u64 c, bool prange) {
+            auto rr = (u64*)S.data(r);
+            for (u64 q = qBegin; q < qEnd; ++q)
+            {
+                auto rq = (u64*)S.data(q);
+                if (c != ~0ull && q != r && (rq[c / 64] >> (c % 64) & 1))
+                    for (u64 w = 0; w < W; ++w)
+                        rq[w] ^= rr[w];
+                if (prange)
+                    record(rowWeight(rq, W));
+            }
+        };
+
+        auto routine = [&](u64 t) {
+            u64 qBegin = k * t / nt, qEnd = k * (t + 1) / nt;
+            std::vector<u64> ones;
+
+            for (u64 iter = 0; ; ++iter)
+            {
+                if (t == 0)
+                {
+                    stop = iter && (completed >= budget || (params.mSeconds &&
+                        std::chrono::steady_clock::now() - start > std::chrono::seconds(params.mSeconds)));
+
+                    // a fresh random column order. The information set it
+                    // gives does not depend on the earlier ones, unlike those
+                    // of the single column swaps.
+                    restart = !stop && iter % period == 0;
+                    if (restart)
+                    {
+                        for (u64 i = n - 1; i; --i)
+                            std::swap(perm[i], perm[prng.get<u64>() % (i + 1)]);
+                        std::fill(info.begin(), info.end(), 0);
+                        rank = 0;
+                    }
+                }
+                barrier.wait();
+                if (stop)
+                    break;
+
+                // the systematic form, one column of perm at a time.
+                for (u64 c = 0; restart && c < n && rank < k; ++c)
+                {
+                    if (t == 0)
+                    {
+                        col = perm[c];
+                        u64 p = rank;
+                        while (p < k && (((u64*)S.data(p))[col / 64] >> (col % 64) & 1) == 0)
+                            ++p;
+                        if (p == k)
+                            col = ~0ull;
+                        else if (p != rank)
+                            std::swap_ranges(S.data(p), S.data(p) + S.cols(), S.data(rank));
+                    }
+                    barrier.wait();
+                    if (col != ~0ull)
+                        eliminate(qBegin, qEnd, rank, col, false);
+                    barrier.wait();
+                    if (t == 0 && col != ~0ull)
+                    {
+                        pivot[rank] = col;
+                        info[col] = 1;
+                        ++rank;
+                    }
+                    barrier.wait();
+                }
+
+                // the rows of G are linearly dependent.
+                if (rank < k)
+                    return;
+
+                if (t == 0)
+                {
+                    // swap a random column into the information set. It
+                    // replaces the pivot of row r.
+                    r = prng.get<u64>() % k;
+                    auto rr = (u64*)S.data(r);
+                    ones.clear();
+                    for (u64 w = 0; w < W; ++w)
+                    {
+                        for (auto bits = rr[w]; bits; bits &= bits - 1)
+                        {
+                            auto c = w * 64 + popcount((bits & (0 - bits)) - 1);
+                            if (info[c] == 0)
+                                ones.push_back(c);
+                        }
+                    }
+                    col = ~0ull;
+                    if (ones.size())
+                    {
+                        col = ones[prng.get<u64>() % ones.size()];
+                        info[pivot[r]] = 0;
+                        info[col] = 1;
+                        pivot[r] = col;
+                    }
+
+                    // the Stern window, distinct columns outside of the
+                    // information set.
+                    if (params.mStern)
+                    {
+                        outside.clear();
+                        for (u64 c = 0; c < n; ++c)
+                            if (info[c] == 0)
+                                outside.push_back(c);
+                        for (u64 i = 0; i < window; ++i)
+                        {
+                            std::swap(outside[i], outside[i + prng.get<u64>() % (outside.size() - i)]);
+                            cols[i] = outside[i];
+                        }
+                    }
+                }
+                barrier.wait();
+
+                // Prange, every row is a codeword. Then the Stern key of
+                // each row.
+                eliminate(qBegin, qEnd, r, col, true);
+                for (u64 q = qBegin; params.mStern && window && q < qEnd; ++q)
+                {
+                    auto rq = (u64*)S.data(q);
+                    u64 key = 0;
+                    for (u64 i = 0; i < window; ++i)
+                        key |= ((rq[cols[i] / 64] >> (cols[i] % 64)) & 1) << i;
+                    keys[q] = { key, q };
+                }
+                barrier.wait();
+
+                // Stern, pairs of rows that agree on the window. The buckets
+                // of equal keys are dealt round robin to the threads.
+                if (params.mStern && window)
+                {
+                    if (t == 0)
+                    {
+                        std::sort(keys.begin(), keys.end());
+                        buckets.clear();
+                        for (u64 b = 0; b < k; ++b)
+                            if (b == 0 || keys[b].first != keys[b - 1].first)
+                                buckets.push_back(b);
+                        buckets.push_back(k);
+                    }
+                    barrier.wait();
+
+                    for (u64 bi = t; bi + 1 < buckets.size(); bi += nt)
+                    {
+                        for (u64 i = buckets[bi]; i < buckets[bi + 1]; ++i)
+                        {
+                            auto ri = (u64*)S.data(keys[i].second);
+                            for (u64 j = i + 1; j < buckets[bi + 1]; ++j)
+                            {
+                                auto rj = (u64*)S.data(keys[j].second);
+                                u64 weight = 0;
+                                for (u64 w = 0; w < W; ++w)
+                                    weight += popcount(ri[w] ^ rj[w]);
+                                record(weight);
+                            }
+                        }
+                    }
+                    barrier.wait();
+                }
+
+                if (t == 0)
+                {
+                    ++completed;
+                    restarts += restart;
+                    if (progress)
+                        ++*progress;
+                }
+            }
+        };
+
+        std::vector<std::thread> thrds(nt - 1);
+        for (u64 t = 1; t < nt; ++t)
+            thrds[t - 1] = std::thread(routine, t);
+        routine(0);
+        for (auto& t : thrds)
+            t.join();
+
+        ISDResult ret;
+        if (rank < k)
+        {
+            // the rows of G are linearly dependent and some nonzero message
+            // encodes to the zero codeword.
+            ret.mMin = 0;
+            ret.mHits = 1;
+            return ret;
+        }
+
+        ret.mMin = gMin;
+        ret.mHits = hits;
+        ret.mIters = completed;
+        ret.mRestarts = restarts;
+
+        // the largest weight that the independent iterations would have
+        // found with the requested confidence.
+        while (ret.mCertified < n)
+        {
+            auto p = isdFindProb(n, k, ret.mCertified + 1, params.mStern ? window : 0, params.mStern);
+            auto miss = p >= 1 ? 0 : std::exp(ret.mRestarts * std::log1p(-p));
+            if (miss > 1 - params.mConfidence)
+                break;
+            ++ret.mCertified;
+        }
+
+        return ret;
+    }
+
+
     //u64 getGeneratorWeight(ExConvCodeTest& encoder)
     //{
     //    auto k = encoder.mMessageSize;
@@ -112,6 +438,173 @@ namespace osuCrypto
     //    }
     //}
 
+    namespace
+    {
+        // a decimal u64 with nothing else around it.
+        bool parseU64(const std::string& s, u64& v)
+        {
+            if (s.empty() || s.size() > 20 || s.find_first_not_of("0123456789") != std::string::npos)
+                return false;
+            errno = 0;
+            v = std::strtoull(s.c_str(), nullptr, 10);
+            return errno == 0;
+        }
+
+        // TileCheckpoint::mDone as <count>:<hex>, four bits per hex digit.
+        std::string encodeDone(const std::vector<u8>& done)
+        {
+            std::string hex = std::to_string(done.size()) + ":";
+            for (u64 i = 0; i < done.size(); i += 4)
+            {
+                u64 v = 0;
+                for (u64 j = 0; j < 4 && i + j < done.size(); ++j)
+                    v |= u64(done[i + j] != 0) << j;
+                hex += "0123456789abcdef"[v];
+            }
+            return hex;
+        }
+
+        bool decodeDone(const std::string& s, std::vector<u8>& done)
+        {
+            auto colon = s.find(':');
+            u64 count;
+            if (colon == std::string::npos || !parseU64(s.substr(0, colon), count))
+                return false;
+
+            auto hex = s.substr(colon + 1);
+            if (hex.size() != divCeil(count, 4))
+                return false;
+
+            done.resize(count);
+            for (u64 i = 0; i < count; ++i)
+            {
+                auto h = hex[i / 4];
+                int v =
+                    h >= '0' && h <= '9' ? h - '0' :
+                    h >= 'a' && h <= 'f' ? h - 'a' + 10 : -1;
+                if (v < 0)
+                    return false;
+                done[i] = (v >> (i % 4)) & 1;
+            }
+            return true;
+        }
+
+        void writeResult(std::ostream& out, const std::string& key, const std::vector<u64>& vals)
+        {
+            out << "r " << key;
+            for (auto v : vals)
+                out << " " << v;
+            out << "\n";
+        }
+    }
+
+    ExConvResultStore::ExConvResultStore(std::string path)
+        : mPath(std::move(path))
+    {
+        std::ifstream in(mPath);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            // the last line was not finished.
+            if (in.eof())
+                break;
+
+            std::stringstream ss(line);
+            std::string type, key, token;
+            std::vector<std::string> tokens;
+            ss >> type >> key;
+            while (ss >> token)
+                tokens.push_back(token);
+
+            if (type == "r" && tokens.size())
+            {
+                std::vector<u64> vals(tokens.size());
+                bool ok = true;
+                for (u64 i = 0; i < tokens.size(); ++i)
+                    ok = ok && parseU64(tokens[i], vals[i]);
+                if (ok)
+                {
+                    mResults[key] = vals;
+                    mCheckpoints.erase(key);
+                }
+            }
+            else if (type == "c" && tokens.size() == 2)
+            {
+                u64 min;
+                std::vector<u8> done;
+                if (parseU64(tokens[0], min) && decodeDone(tokens[1], done))
+                    mCheckpoints[key] = { min, std::move(done) };
+            }
+        }
+        in.close();
+
+        // rewrite the file with only the latest entries.
+        auto tmp = mPath + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            for (auto& r : mResults)
+                writeResult(out, r.first, r.second);
+            for (auto& c : mCheckpoints)
+                out << "c " << c.first << " " << c.second.first << " " << encodeDone(c.second.second) << "\n";
+            if (!out)
+                throw RTE_LOC;
+        }
+        if (std::rename(tmp.c_str(), mPath.c_str()))
+            throw RTE_LOC;
+
+        mOut.open(mPath, std::ios::app);
+        if (!mOut)
+            throw RTE_LOC;
+    }
+
+    std::string ExConvResultStore::key(u64 k, u64 n, u64 aw, u64 bw, bool sys, bool reg, bool accTwice, block seed, const std::string& method)
+    {
+        std::stringstream ss;
+        ss << "k=" << k << ",n=" << n << ",aw=" << aw << ",bw=" << bw
+            << ",sys=" << sys << ",reg=" << reg << ",accTwice=" << accTwice
+            << ",seed=" << std::hex << seed.get<u64>(1) << "." << seed.get<u64>(0) << std::dec
+            << ",m=" << method;
+        return ss.str();
+    }
+
+    bool ExConvResultStore::getResult(const std::string& key, std::vector<u64>& vals)
+    {
+        std::lock_guard<std::mutex> lock(mMtx);
+        auto iter = mResults.find(key);
+        if (iter == mResults.end())
+            return false;
+        vals = iter->second;
+        return true;
+    }
+
+    void ExConvResultStore::putResult(const std::string& key, const std::vector<u64>& vals)
+    {
+        std::lock_guard<std::mutex> lock(mMtx);
+        mResults[key] = vals;
+        mCheckpoints.erase(key);
+        writeResult(mOut, key, vals);
+        mOut.flush();
+    }
+
+    bool ExConvResultStore::getCheckpoint(const std::string& key, TileCheckpoint& ckpt)
+    {
+        std::lock_guard<std::mutex> lock(mMtx);
+        auto iter = mCheckpoints.find(key);
+        if (iter == mCheckpoints.end())
+            return false;
+        ckpt.mMin = iter->second.first;
+        ckpt.mDone = iter->second.second;
+        return true;
+    }
+
+    void ExConvResultStore::putCheckpoint(const std::string& key, const TileCheckpoint& ckpt)
+    {
+        std::lock_guard<std::mutex> lock(mMtx);
+        mCheckpoints[key] = { ckpt.mMin, ckpt.mDone };
+        mOut << "c " << key << " " << ckpt.mMin << " " << encodeDone(ckpt.mDone) << "\n";
+        mOut.flush();
+    }
+
     void ExConvChecker(const oc::CLP& cmd)
     {
         u64  k = cmd.getOr("k", 1ull << cmd.getOr("kk", 6));
@@ -129,6 +622,42 @@ namespace osuCrypto
         u64 bwEnd = cmd.getOr("bwEnd", 11);
         auto x2 = cmd.isSet("x2");
 
+        // estimate the distance with information set decoding instead of
+        // the brute force search. The nt threads are then used within each trial.
+        auto isd = cmd.isSet("isd");
+        ISDParams isdParams;
+        isdParams.mIters = cmd.getOr("isdIters", isdParams.mIters);
+        isdParams.mSeconds = cmd.getOr("isdSec", isdParams.mSeconds);
+        isdParams.mWindow = cmd.getOr("isdWindow", isdParams.mWindow);
+        isdParams.mStern = cmd.getOr("isdStern", 1);
+        isdParams.mConfidence = cmd.getOr("isdConf", isdParams.mConfidence);
+        isdParams.mRestart = cmd.getOr("isdRestart", isdParams.mRestart);
+        isdParams.mThreads = nt;
+        if (isd && isdParams.mIters == 0)
+            throw RTE_LOC;
+
+        // the threads are split across the trials first. If there are fewer
+        // trials than threads, the rest work within each trial.
+        u64 ntTrials = isd ? 1 : std::max<u64>(1, std::min(nt, trials));
+        u64 ntInner = isd ? 1 : std::max<u64>(1, nt / ntTrials);
+
+        // the results store. Finished trials are read from it and unfinished
+        // x2 trials resume from their last checkpoint.
+        std::unique_ptr<ExConvResultStore> store;
+        if (cmd.isSet("cache"))
+            store.reset(new ExConvResultStore(cmd.get<std::string>("cache")));
+        u64 ckptInterval = cmd.getOr("ckptSec", 60);
+
+        std::string method = x2 ? "x2" : "w";
+        if (isd)
+        {
+            std::stringstream ss;
+            ss << "isd-" << isdParams.mIters << "-" << isdParams.mSeconds << "-"
+                << isdParams.mWindow << "-" << isdParams.mStern << "-" << isdParams.mConfidence
+                << "-" << isdParams.mRestart;
+            method = ss.str();
+        }
+
         for (u64 aw = awBeing; aw < awEnd; aw += 2)
         {
             for (u64 bw = bwBeing; bw < bwEnd; bw += 2)
@@ -138,16 +667,34 @@ namespace osuCrypto
                 u64 avg = 0;
                 u64 gMin = n;
                 std::mutex mtx;
-                u64 ticks = x2 ? k * k * trials  : n * trials;
+                u64 ticksPerTrial = isd ? isdParams.mIters : x2 ? k * k : n;
+                u64 ticks = ticksPerTrial * trials;
+                u64 certified = n;
+                u64 hits = 0;
+
+                // merge the ISD result of one trial. mtx must be held.
+                auto addIsd = [&](u64 min, u64 cert, u64 h) {
+                    certified = std::min(certified, cert);
+                    if (min < gMin)
+                        hits = 0;
+                    if (min <= gMin)
+                        hits += h;
+                };
                 std::atomic<u64> done = 0;
                 auto routine = [&](u64 i) {
-                    for (u64 j = i; j < trials; j += nt)
+                    for (u64 j = i; j < trials; j += ntTrials)
                     {
 
+                        auto seed = block(21341234, j);
                         ExConvCodeTest encoder;
-                        encoder.config(k, n, bw, aw, sys, reg, block(21341234, j));
+                        encoder.config(k, n, bw, aw, sys, reg, seed);
                         encoder.mAccTwice = accTwice;
 
+                        std::string key;
+                        std::vector<u64> cached;
+                        if (store)
+                            key = ExConvResultStore::key(k, n, aw, bw, sys, reg, accTwice, seed, method);
+
                         //auto g = getGenerator(encoder);
                         //auto g2 = compress(g);
                         //auto G = getCompressedGenerator(encoder);
@@ -155,17 +702,58 @@ namespace osuCrypto
                         //    throw RTE_LOC;
 
                         u64 min = 0;
-                        if (x2)
+                        // an ISD entry without its certified bound and hits
+                        // is stale and is computed again.
+                        if (store && store->getResult(key, cached) && cached.size() >= (isd ? 3 : 1))
                         {
-                            min = getGeneratorWeightx2<ExConvCodeTest, std::atomic<u64>&>(encoder, verbose, done);
-                            
+                            // computed by an earlier sweep.
+                            min = cached[0];
+                            done += ticksPerTrial;
+
+                            if (isd)
+                            {
+                                std::lock_guard<std::mutex> lock(mtx);
+                                addIsd(min, cached[1], cached[2]);
+                            }
+                        }
+                        else if (isd)
+                        {
+                            auto r = getGeneratorWeightISD(encoder, isdParams, &done);
+                            min = r.mMin;
+
+                            // account for iterations skipped due to the time limit.
+                            done += isdParams.mIters - r.mIters;
+
+                            if (store)
+                                store->putResult(key, { r.mMin, r.mCertified, r.mHits });
+
+                            std::lock_guard<std::mutex> lock(mtx);
+                            addIsd(r.mMin, r.mCertified, r.mHits);
+                        }
+                        else if (x2)
+                        {
+                            TileCheckpoint ckpt;
+                            if (store)
+                            {
+                                store->getCheckpoint(key, ckpt);
+                                ckpt.mInterval = ckptInterval;
+                                ckpt.mSave = [&](const TileCheckpoint& c) { store->putCheckpoint(key, c); };
+                            }
+
+                            min = getGeneratorWeightx2<ExConvCodeTest, std::atomic<u64>&>(encoder, verbose, done, ntInner, store ? &ckpt : nullptr);
+
+                            if (store)
+                                store->putResult(key, { min });
                         }
                         else
                         {
                             //min = getGeneratorWeight<ExConvCodeTest, std::atomic<u64>&>(encoder, verbose, done);
-                            min = getGeneratorWeight2<ExConvCodeTest, std::atomic<u64>&>(encoder, verbose, done);
+                            min = getGeneratorWeight2<ExConvCodeTest, std::atomic<u64>&>(encoder, verbose, done, ntInner);
                             //if(min != min2)
                             //    throw RTE_LOC;
+
+                            if (store)
+                                store->putResult(key, { min });
                         }
 
                         std::lock_guard<std::mutex> lock(mtx);
@@ -174,7 +762,7 @@ namespace osuCrypto
                     }
                     };
 
-                std::vector<std::thread> thrds(nt);
+                std::vector<std::thread> thrds(ntTrials);
                 for (u64 i = 0; i < thrds.size(); ++i)
                 {
                     thrds[i] = std::thread(routine, i);
@@ -207,7 +795,12 @@ namespace osuCrypto
                 }
                 std::cout << "aw " << aw << " bw " << bw <<
                     " min " << double(gMin) / n <<
-                    " avg " << double(avg) / n / trials << std::endl;
+                    " avg " << double(avg) / n / trials;
+                if (isd)
+                    std::cout << " hits " << hits <<
+                        " certified " << double(certified) / n <<
+                        " @ " << isdParams.mConfidence;
+                std::cout << std::endl;
             }
         }
 
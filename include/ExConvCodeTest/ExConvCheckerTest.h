@@ -11,12 +11,142 @@
 #include "cryptoTools/Crypto/RandomOracle.h"
 #include "libOTe/Tools/LDPC/Util.h"
 #include "libOTe/Tools/CoeffCtx.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <string>
 
 namespace osuCrypto
 {
 
     // the (psuedo) minimum distance finder for expand convolute codes.
     void ExConvChecker(const CLP& cmd);
+
+    // The progress of a tiled search so that it can be resumed. mDone[t] is
+    // set once tile t is finished and mMin is the minimum weight found so far.
+    struct TileCheckpoint
+    {
+        std::vector<u8> mDone;
+        u64 mMin = ~0ull;
+
+        // if set, called with the checkpoint at most every mInterval seconds
+        // and once the search is finished.
+        std::function<void(const TileCheckpoint&)> mSave;
+        u64 mInterval = 60;
+    };
+
+    // A persistent store of ExConvChecker results and x2 checkpoints. The file
+    // consists of lines
+    //
+    //   r <key> <values...>      the result of a finished trial
+    //   c <key> <min> <done>     the finished tiles of an unfinished trial
+    //
+    // where later lines replace earlier ones. <done> is the TileCheckpoint::mDone
+    // bits as <count>:<hex>. Malformed lines and a last line without a newline,
+    // left by an interrupted write, are dropped. The file is compacted when it
+    // is opened and then appended to.
+    class ExConvResultStore
+    {
+    public:
+        ExConvResultStore(std::string path);
+
+        // the key of a trial. method identifies how the distance was computed.
+        static std::string key(u64 k, u64 n, u64 aw, u64 bw, bool sys, bool reg, bool accTwice, block seed, const std::string& method);
+
+        bool getResult(const std::string& key, std::vector<u64>& vals);
+
+        void putResult(const std::string& key, const std::vector<u64>& vals);
+
+        bool getCheckpoint(const std::string& key, TileCheckpoint& ckpt);
+
+        void putCheckpoint(const std::string& key, const TileCheckpoint& ckpt);
+
+    private:
+        std::mutex mMtx;
+        std::string mPath;
+        std::ofstream mOut;
+        std::map<std::string, std::vector<u64>> mResults;
+        std::map<std::string, std::pair<u64, std::vector<u8>>> mCheckpoints;
+    };
+
+    // parameters of the information set decoding (ISD) min distance estimator.
+    struct ISDParams
+    {
+        // the total number of iterations over all threads.
+        u64 mIters = 1000;
+
+        // stop after this many seconds, 0 for no time limit.
+        u64 mSeconds = 0;
+
+        // the number of threads.
+        u64 mThreads = 1;
+
+        // the number of window columns in the Stern step. 0 means log2(k).
+        u64 mWindow = 0;
+
+        // also search for pairs of rows that cancel on the window (Stern),
+        // otherwise only single rows are checked (Prange).
+        bool mStern = true;
+
+        // the confidence with which mCertified is reported.
+        double mConfidence = 0.99;
+
+        // put G in systematic form from a fresh random column order every
+        // mRestart iterations. 0 means k.
+        u64 mRestart = 0;
+
+        block mSeed = block(2345234, 5475234);
+    };
+
+    struct ISDResult
+    {
+        // the minimum weight codeword that was found. An upper bound on the
+        // minimum distance.
+        u64 mMin = 0;
+
+        // the number of times a codeword of weight mMin was found.
+        u64 mHits = 0;
+
+        // the number of iterations that were performed.
+        u64 mIters = 0;
+
+        // the number of iterations that started from a fresh random
+        // information set. Only these are independent of each other.
+        u64 mRestarts = 0;
+
+        // any fixed codeword of weight at most mCertified would have been
+        // found with probability mConfidence by the mRestarts independent
+        // iterations. The correlated iterations in between are not counted.
+        u64 mCertified = 0;
+    };
+
+    // Randomized low weight codeword search over the bit packed k by n
+    // generator G. Every params.mRestart iterations the rows of G are put in
+    // systematic form over a fresh random column order, and each iteration
+    // swaps one column into the information set (Canteaut-Chabaud). The
+    // weight of every row is then checked (Prange) along with pairs of rows
+    // that are zero on a window of distinct random columns (Stern). progress,
+    // if not null, is incremented once per iteration.
+    //
+    // G is reduced in place and shared by all the threads, which split each
+    // elimination by rows, so the memory is k*n/8 bytes for any thread
+    // count; pass G with std::move to avoid a copy. G is dense, which puts
+    // the deployed k=2^20, n=2^21 out of reach: it would take 256 GiB and
+    // each restart about k*k*n/128 word operations (~2^54). That size needs
+    // a search over the sparse expander and accumulator instead.
+    ISDResult isdMinWeight(
+        Matrix<block> G,
+        u64 n,
+        const ISDParams& params,
+        std::atomic<u64>* progress = nullptr);
+
+    // the probability that one ISD iteration finds a fixed codeword of weight w.
+    double isdFindProb(u64 n, u64 k, u64 w, u64 window, bool stern);
     namespace detail
     {
         struct GetGeneratorBatch
@@ -31,6 +161,133 @@ namespace osuCrypto
                 return ret;
             }
         };
+
+        // A work stealing scheduler over the tiles [0, numTiles). Each thread
+        // owns a contiguous range of tiles and takes them from the front. A
+        // thread whose range is empty steals the back half of the largest
+        // remaining range.
+        class TileScheduler
+        {
+            struct Range
+            {
+                std::mutex mMtx;
+                u64 mBegin = 0, mEnd = 0;
+            };
+            std::vector<Range> mRanges;
+
+        public:
+            TileScheduler(u64 numTiles, u64 nt)
+                : mRanges(nt)
+            {
+                for (u64 t = 0; t < nt; ++t)
+                {
+                    mRanges[t].mBegin = numTiles * t / nt;
+                    mRanges[t].mEnd = numTiles * (t + 1) / nt;
+                }
+            }
+
+            // get the next tile for thread t. Returns false once all tiles
+            // have been handed out.
+            bool next(u64 t, u64& tile)
+            {
+                while (true)
+                {
+                    {
+                        auto& r = mRanges[t];
+                        std::lock_guard<std::mutex> lock(r.mMtx);
+                        if (r.mBegin != r.mEnd)
+                        {
+                            tile = r.mBegin++;
+                            return true;
+                        }
+                    }
+
+                    // find the victim with the most remaining tiles.
+                    u64 victim = t, most = 0;
+                    for (u64 v = 0; v < mRanges.size(); ++v)
+                    {
+                        auto& r = mRanges[v];
+                        std::lock_guard<std::mutex> lock(r.mMtx);
+                        if (r.mEnd - r.mBegin > most)
+                        {
+                            most = r.mEnd - r.mBegin;
+                            victim = v;
+                        }
+                    }
+                    if (most == 0)
+                        return false;
+
+                    u64 begin, end;
+                    {
+                        auto& r = mRanges[victim];
+                        std::lock_guard<std::mutex> lock(r.mMtx);
+                        if (r.mBegin == r.mEnd)
+                            continue;
+                        end = r.mEnd;
+                        begin = r.mEnd = r.mEnd - divCeil(r.mEnd - r.mBegin, 2);
+                    }
+
+                    auto& r = mRanges[t];
+                    std::lock_guard<std::mutex> lock(r.mMtx);
+                    r.mBegin = begin;
+                    r.mEnd = end;
+                }
+            }
+        };
+
+        // run f(t, tile) for all the tiles using nt threads.
+        template<typename Fn>
+        void forEachTile(u64 numTiles, u64 nt, Fn&& f)
+        {
+            nt = std::max<u64>(1, std::min(nt, numTiles));
+            TileScheduler sched(numTiles, nt);
+            auto routine = [&](u64 t) {
+                u64 tile;
+                while (sched.next(t, tile))
+                    f(t, tile);
+            };
+
+            std::vector<std::thread> thrds(nt - 1);
+            for (u64 t = 1; t < nt; ++t)
+                thrds[t - 1] = std::thread(routine, t);
+            routine(0);
+            for (auto& t : thrds)
+                t.join();
+        }
+
+        // a reusable barrier for count threads.
+        class Barrier
+        {
+            std::mutex mMtx;
+            std::condition_variable mCv;
+            u64 mCount, mWaiting = 0, mGeneration = 0;
+
+        public:
+            Barrier(u64 count)
+                : mCount(count)
+            {}
+
+            void wait()
+            {
+                std::unique_lock<std::mutex> lock(mMtx);
+                auto gen = mGeneration;
+                if (++mWaiting == mCount)
+                {
+                    mWaiting = 0;
+                    ++mGeneration;
+                    mCv.notify_all();
+                }
+                else
+                    mCv.wait(lock, [&] { return gen != mGeneration; });
+            }
+        };
+
+        // min = std::min(min, v)
+        inline void atomicMin(std::atomic<u64>& min, u64 v)
+        {
+            auto cur = min.load(std::memory_order_relaxed);
+            while (v < cur && !min.compare_exchange_weak(cur, v, std::memory_order_relaxed));
+        }
     }
 
 
@@ -67,8 +324,9 @@ namespace osuCrypto
         for (u64 i = 0; i < n; i += batchSize)
         {
             memset(x.data(), 0, sizeof(x[0]) * x.size());
+            u64 min = std::min<u64>(batchSize, n - i);
 
-            for (u64 p = 0; p < batchSize; ++p)
+            for (u64 p = 0; p < min; ++p)
             {
                 *oc::BitIterator((u8*)&x[i + p], p) = 1;
             }
@@ -76,7 +334,7 @@ namespace osuCrypto
             // encode a batch of batchSize=1024 unit vectors...
             encoder.template dualEncode<detail::GetGeneratorBatch, CoeffCtxGF2>(x.data(), {});
 
-            u64 mk = divCeil(std::min<u64>(batchSize, n - i), 8);
+            u64 mk = divCeil(min, 8);
             auto i128 = i / 128;
 
             // x[j,p] is the (i+p)-th bit of the j-th codeword.
@@ -121,75 +379,117 @@ namespace osuCrypto
         return G;
     }
 
+    // the minimum weight of the sum of any one or two rows of the generator.
+    // The pairs i <= i2 are split into tiles of rows which nt threads process
+    // with work stealing. A pair is abandoned once its weight reaches the
+    // current minimum. If ckpt is given, its finished tiles are skipped and it
+    // is updated as tiles finish. c is advanced once per tile under a lock so
+    // that a plain integer Count is safe for any nt.
     template<typename Code, typename Count = u64>
-    u64 getGeneratorWeightx2(Code& encoder, bool verbose, Count c = {})
+    u64 getGeneratorWeightx2(Code& encoder, bool verbose, Count c = {}, u64 nt = 1, TileCheckpoint* ckpt = nullptr)
     {
         auto k = encoder.mMessageSize;
         auto n = encoder.mCodeSize;
         auto G = getCompressedGenerator(encoder);
         //auto G = compress(g);
 
-        u64 min = n;
+        std::atomic<u64> min(n);
         auto N = G.cols();
-        for (u64 i = 0; i < k; ++i)
+
+        // tile (bi, bi2) covers the rows [bi, bi+1) * tileSize and
+        // [bi2, bi2+1) * tileSize where bi <= bi2.
+        u64 tileSize = 64;
+        u64 numBlocks = divCeil(k, tileSize);
+        std::vector<std::pair<u64, u64>> tiles;
+        tiles.reserve(numBlocks * (numBlocks + 1) / 2);
+        for (u64 bi = 0; bi < numBlocks; ++bi)
+            for (u64 bi2 = bi; bi2 < numBlocks; ++bi2)
+                tiles.emplace_back(bi, bi2);
+
+        std::mutex ckptMtx, countMtx;
+        auto lastSave = std::chrono::steady_clock::now();
+        if (ckpt)
         {
-            for (u64 i2 = 0; i2 < k; ++i2)
-            { 
-                ++c;
+            if (ckpt->mDone.size() != tiles.size())
+            {
+                ckpt->mDone.assign(tiles.size(), 0);
+                ckpt->mMin = n;
+            }
+            min = std::min<u64>(n, ckpt->mMin);
+        }
+
+        detail::forEachTile(tiles.size(), nt, [&](u64, u64 t) {
+            auto iBegin = tiles[t].first * tileSize;
+            auto iEnd = std::min(k, (tiles[t].first + 1) * tileSize);
+            auto i2End = std::min(k, (tiles[t].second + 1) * tileSize);
+
+            // the number of ordered pairs in the tile.
+            u64 count = 0;
+            for (u64 i = iBegin; i < iEnd; ++i)
+            {
+                auto i2Begin = std::max(i, tiles[t].second * tileSize);
+                if (i2Begin < i2End)
+                    count += 2 * (i2End - i2Begin) - (i2Begin == i);
+            }
+
+            if (ckpt && ckpt->mDone[t])
+            {
+                std::lock_guard<std::mutex> lock(countMtx);
+                c += count;
+                return;
+            }
+            for (u64 i = iBegin; i < iEnd; ++i)
+            {
                 auto gg = G.data(i);
-                u64 weight = 0;
-                if (i == i2)
+                for (u64 i2 = std::max(i, tiles[t].second * tileSize); i2 < i2End; ++i2)
                 {
-                    for (u64 j = 0; j < N; ++j)
+                    auto gg2 = G.data(i2);
+                    auto cur = min.load(std::memory_order_relaxed);
+                    u64 weight = 0;
+                    for (u64 j = 0; j < N && weight < cur; )
                     {
-                        weight +=
-                            popcount(gg[j].template get<u64>(0)) +
-                            popcount(gg[j].template get<u64>(1));
+                        auto end = std::min(N, j + 8);
+                        for (; j < end; ++j)
+                        {
+                            auto gj = i == i2 ? gg[j] : gg[j] ^ gg2[j];
+                            weight +=
+                                popcount(gj.template get<u64>(0)) +
+                                popcount(gj.template get<u64>(1));
+                        }
                     }
 
+                    if (weight < cur)
+                        detail::atomicMin(min, weight);
                 }
-                else
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(countMtx);
+                c += count;
+            }
+
+            if (ckpt)
+            {
+                std::lock_guard<std::mutex> lock(ckptMtx);
+                ckpt->mDone[t] = 1;
+                ckpt->mMin = min;
+
+                auto now = std::chrono::steady_clock::now();
+                if (ckpt->mSave && now - lastSave > std::chrono::seconds(ckpt->mInterval))
                 {
-                    auto gg2 = G.data(i2);
-                    for (u64 j = 0; j < N; ++j)
-                    {
-                        auto gj = gg[j] ^ gg2[j];
-                        weight +=
-                            popcount(gj.template get<u64>(0)) +
-                            popcount(gj.template get<u64>(1));
-                    }
+                    ckpt->mSave(*ckpt);
+                    lastSave = now;
                 }
-
-                //if (verbose)
-                //{
-                //    std::cout << i << " \n";
-                //    for (u64 j = 0; j < n; ++j)
-                //    {
-                //        if (g(i, j))
-                //            std::cout << Color::Green << "1" << Color::Default;
-                //        else
-                //            std::cout << "0";
-                //    }
-                //    std::cout << "\n";
-
-                //    if (i != i2)
-                //    {
-
-                //        std::cout << i2 << " \n";
-                //        for (u64 j = 0; j < n; ++j)
-                //        {
-                //            if (g(i2, j))
-                //                std::cout << Color::Green << "1" << Color::Default;
-                //            else
-                //                std::cout << "0";
-                //        }
-                //        std::cout << "\n";
-                //    }
-
-                //}
-                min = std::min<u64>(min, weight);
             }
+        });
+
+        if (ckpt)
+        {
+            ckpt->mMin = min;
+            if (ckpt->mSave)
+                ckpt->mSave(*ckpt);
         }
+
         return min;
     }
 
@@ -217,34 +517,31 @@ namespace osuCrypto
     }
 
 
+    // the minimum weight of a generator row. The batches of unit vectors are
+    // encoded by nt threads with work stealing, each using its own copy of
+    // the encoder. c is advanced under a lock, as in getGeneratorWeightx2.
     template<typename Code, typename Count = u64>
-    u64 getGeneratorWeight2(Code& encoder, bool verbose, Count c = {})
+    u64 getGeneratorWeight2(Code& encoder, bool verbose, Count c = {}, u64 nt = 1)
     {
         auto k = encoder.mMessageSize;
         auto n = encoder.mCodeSize;
         //auto g = getGenerator(encoder);
 
-        std::vector<u64> weights(k);
-        //for (u64 i = 0; i < n; ++i)
-        //{
-        //    std::vector<u8> x(n);
-        //    x[i] = 1;
-        //    encoder.template dualEncode<u8, CoeffCtxGF2>(x.data(), {});
-
-        //    for (u64 j = 0; j < k; ++j)
-        //    {
-        //        weights[j] += x[j];
-        //    }
-        //    ++c;
-        //}
-        //Matrix<block> g(k, divCeil(n, 128));
-
         u64 batchSize = sizeof(detail::GetGeneratorBatch) * 8;
-        std::vector<detail::GetGeneratorBatch> x(n);
-        for (u64 i = 0; i < n; i += batchSize)
-        {
+        u64 numBatches = divCeil(n, batchSize);
+        nt = std::max<u64>(1, std::min(nt, numBatches));
+
+        std::vector<std::vector<u64>> weights(nt, std::vector<u64>(k));
+        std::vector<Code> encoders(nt, encoder);
+        std::vector<std::vector<detail::GetGeneratorBatch>> xs(nt);
+        std::mutex countMtx;
+
+        detail::forEachTile(numBatches, nt, [&](u64 t, u64 b) {
+            auto i = b * batchSize;
+            auto& x = xs[t];
+            x.resize(n);
             memset(x.data(), 0, sizeof(x[0]) * x.size());
-            u64 min = std::min<u64>(batchSize, n - 1);
+            u64 min = std::min<u64>(batchSize, n - i);
 
             for (u64 p = 0; p < min; ++p)
             {
@@ -252,27 +549,37 @@ namespace osuCrypto
             }
 
             // encode a batch of batchSize=1024 unit vectors...
-            encoder.template dualEncode<detail::GetGeneratorBatch, CoeffCtxGF2>(x.data(), {});
-
-            u64 mk = divCeil(min, 8);
-            auto i128 = i / 128;
+            encoders[t].template dualEncode<detail::GetGeneratorBatch, CoeffCtxGF2>(x.data(), {});
 
             // x[j,p] is the (i+p)-th bit of the j-th codeword.
-            // We want g[j, i+p] = x[j,p]
             for (u64 j = 0; j < k; ++j)
             {
                 for (u64 b = 0; b < x[j].mVal.size(); ++b)
                 {
-                    weights[j] += 
-                        popcount(x[j].mVal[b].get<u64>(0)) +
-                        popcount(x[j].mVal[b].get<u64>(1));
+                    weights[t][j] +=
+                        popcount(x[j].mVal[b].template get<u64>(0)) +
+                        popcount(x[j].mVal[b].template get<u64>(1));
                 }
             }
 
+            std::lock_guard<std::mutex> lock(countMtx);
             c += min;
-        }
+        });
 
-        return *std::min_element(weights.begin(), weights.end());
+        for (u64 t = 1; t < nt; ++t)
+            for (u64 j = 0; j < k; ++j)
+                weights[0][j] += weights[t][j];
+
+        return *std::min_element(weights[0].begin(), weights[0].end());
+    }
+
+    // estimate the minimum distance of the code using information set decoding.
+    // Unlike getGeneratorWeightx2 this does not enumerate the row pairs and can
+    // be given an iteration or time budget.
+    template<typename Code>
+    ISDResult getGeneratorWeightISD(Code& encoder, const ISDParams& params, std::atomic<u64>* progress = nullptr)
+    {
+        return isdMinWeight(getCompressedGenerator(encoder), encoder.mCodeSize, params, progress);
     }
 
-}
\ No newline at end of file
+}
@@ -10,6 +10,12 @@
 #include "cryptoTools/Common/Timer.h"
 #include "ExConvCodeTest/ExpanderTest.h"
 #include "libOTe/Tools/EACode/Util.h"
+#include <atomic>
+#include <thread>
+#include <chrono>
+#ifdef ENABLE_SSE
+#include <immintrin.h>
+#endif
 
 namespace osuCrypto
 {
@@ -42,6 +48,125 @@ namespace osuCrypto
         : std::true_type{};
     */
 
+    // A ring of 4KB accumulator coefficient chunks. The chunks are produced
+    // ahead of the accumulator, either in bulk when the ring runs dry or by a
+    // helper thread, so that the accumulator only has to consume bytes.
+    //
+    // Chunk 0 is the initial PRNG buffer and chunk c+1 is chunk c after one
+    // ExConvCodeTest::refill(...). The byte stream is therefore identical to
+    // calling refill(prng) in place whenever the buffer is exhausted.
+    class AccCoeffRing
+    {
+    public:
+        static constexpr u64 ChunkBlocks = 256;
+        static constexpr u64 ChunkBytes = ChunkBlocks * sizeof(block);
+
+        // seed: the accumulator seed.
+        // numChunks: the number of chunks held in the ring.
+        // totalChunks: the number of chunks that will be consumed.
+        // threaded: if true, a helper thread fills the ring.
+        AccCoeffRing(block seed, u64 numChunks, u64 totalChunks, bool threaded)
+            : mNumChunks(std::max<u64>(numChunks, threaded ? 2 : 1))
+            , mTotalChunks(std::max<u64>(totalChunks, 1))
+        {
+            PRNG prng(seed);
+            if (prng.mBuffer.size() != ChunkBlocks)
+                throw RTE_LOC;
+
+            mRing.resize(mNumChunks * ChunkBlocks);
+            std::copy(prng.mBuffer.begin(), prng.mBuffer.end(), mRing.begin());
+            mProduced = 1;
+
+            if (threaded && mTotalChunks > 1)
+                mThread = std::thread([this]() { produce(); });
+        }
+
+        AccCoeffRing(const AccCoeffRing&) = delete;
+        AccCoeffRing& operator=(const AccCoeffRing&) = delete;
+
+        ~AccCoeffRing()
+        {
+            mStop = true;
+            if (mThread.joinable())
+                mThread.join();
+        }
+
+        // returns the next chunk of coefficients. The chunk is valid until
+        // the next call.
+        u8* next()
+        {
+            // the previously returned chunk can now be overwritten.
+            mReleased.store(mConsumed, std::memory_order_release);
+
+            if (mConsumed >= mTotalChunks)
+                throw RTE_LOC;
+
+            if (mThread.joinable())
+            {
+                while (mProduced.load(std::memory_order_acquire) <= mConsumed)
+                    std::this_thread::yield();
+            }
+            else if (mProduced == mConsumed)
+            {
+                // bulk generate as many chunks as the ring holds.
+                auto end = std::min<u64>(mConsumed + mNumChunks, mTotalChunks);
+                for (u64 c = mProduced; c < end; ++c)
+                    generate(c);
+                mProduced.store(end, std::memory_order_relaxed);
+            }
+
+            return (u8*)chunk(mConsumed++);
+        }
+
+    private:
+        u64 mNumChunks = 0, mTotalChunks = 0, mConsumed = 0;
+        std::atomic<u64> mProduced{ 0 }, mReleased{ 0 };
+        std::atomic<bool> mStop{ false };
+        AlignedUnVector<block> mRing;
+        std::thread mThread;
+
+        block* chunk(u64 c) { return mRing.data() + (c % mNumChunks) * ChunkBlocks; }
+
+        // compute chunk c from chunk c-1. This is refill(...) out of place,
+        // or in place when the ring holds a single chunk, so prev and next
+        // may alias. Each block is read before it is overwritten.
+        void generate(u64 c)
+        {
+            const block* prev = chunk(c - 1);
+            block* next = chunk(c);
+            for (u64 i = 0; i < ChunkBlocks; i += 8)
+            {
+                const block* k = i ? next + i - 8 : prev + ChunkBlocks - 8;
+                next[i + 0] = AES::roundEnc(prev[i + 0], k[0]);
+                next[i + 1] = AES::roundEnc(prev[i + 1], k[1]);
+                next[i + 2] = AES::roundEnc(prev[i + 2], k[2]);
+                next[i + 3] = AES::roundEnc(prev[i + 3], k[3]);
+                next[i + 4] = AES::roundEnc(prev[i + 4], k[4]);
+                next[i + 5] = AES::roundEnc(prev[i + 5], k[5]);
+                next[i + 6] = AES::roundEnc(prev[i + 6], k[6]);
+                next[i + 7] = AES::roundEnc(prev[i + 7], k[7]);
+            }
+        }
+
+        // helper thread. Chunk c is written once the consumer has released
+        // chunk c - mNumChunks.
+        void produce()
+        {
+            for (u64 c = 1; c < mTotalChunks && !mStop; ++c)
+            {
+                while (c >= mReleased.load(std::memory_order_acquire) + mNumChunks)
+                {
+                    if (mStop)
+                        return;
+                    std::this_thread::yield();
+                }
+
+                generate(c);
+                mProduced.store(c + 1, std::memory_order_release);
+            }
+        }
+    };
+
     // The encoder for the generator matrix G = B * A. dualEncode(...) is the main function
     // config(...) should be called first.
     // 
@@ -93,6 +218,34 @@ namespace osuCrypto
         // into a small region. This region could be at the end and therefore small weight.
         bool mAccTwice = true;
 
+        // The number of 4KB accumulator coefficient chunks generated ahead
+        // of the accumulator.
+        u64 mCoeffRingSize = 8;
+
+        // generate the accumulator coefficients on a helper thread.
+        bool mCoeffThread = false;
+
+        // cycles spent in accumulateFixed and the number of elements it has
+        // accumulated. Used to report the cost per element.
+        u64 mAccCycles = 0;
+        u64 mAccElements = 0;
+
+        double accCyclesPerElement() const
+        {
+            return mAccElements ? double(mAccCycles) / mAccElements : 0;
+        }
+
+        // the cycle counter, or nanoseconds if rdtsc is not available.
+        static u64 cycleCount()
+        {
+#ifdef ENABLE_SSE
+            return __rdtsc();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
         // return n-k. code size n, message size k. 
         u64 parityRows() const { return mCodeSize - mMessageSize; }
 
@@ -583,23 +736,29 @@ namespace osuCrypto
         u64 i = 0;
         auto main = size - 1 - mAccumulatorSize;
 
-        PRNG prng(seed);
-        u8* mtxCoeffIter = (u8*)prng.mBuffer.data();
-        auto mtxCoeffEnd = mtxCoeffIter + prng.mBuffer.size() * sizeof(block) - divCeil(mAccumulatorSize, 8);
-
         // AccumulatorSize == 0 is the generic case, otherwise
         // AccumulatorSize should be equal to mAccumulatorSize.
         static_assert(AccumulatorSize % 8 == 0);
         if (AccumulatorSize && mAccumulatorSize != AccumulatorSize)
             throw RTE_LOC;
 
+        // each chunk of coefficients is used for perChunk elements.
+        auto coeffBytes = divCeil(mAccumulatorSize, 8);
+        auto perChunk = AccCoeffRing::ChunkBytes - coeffBytes + 1;
+        AccCoeffRing coeffs(seed, mCoeffRingSize, divCeil(size, perChunk), mCoeffThread);
+
+        u8* mtxCoeffIter = coeffs.next();
+        auto mtxCoeffEnd = mtxCoeffIter + AccCoeffRing::ChunkBytes - coeffBytes;
+
+        auto begin = cycleCount();
+
         while (i < main)
         {
             if (mtxCoeffIter > mtxCoeffEnd)
             {
-                // generate more mtx coefficients
-                refill(prng);
-                mtxCoeffIter = (u8*)prng.mBuffer.data();
+                // move to the next chunk of mtx coefficients
+                mtxCoeffIter = coeffs.next();
+                mtxCoeffEnd = mtxCoeffIter + AccCoeffRing::ChunkBytes - coeffBytes;
             }
 
             // add xi to the next positions
@@ -614,9 +773,9 @@ namespace osuCrypto
         {
             if (mtxCoeffIter > mtxCoeffEnd)
             {
-                // generate more mtx coefficients
-                refill(prng);
-                mtxCoeffIter = (u8*)prng.mBuffer.data();
+                // move to the next chunk of mtx coefficients
+                mtxCoeffIter = coeffs.next();
+                mtxCoeffEnd = mtxCoeffIter + AccCoeffRing::ChunkBytes - coeffBytes;
             }
 
             // add xi to the next positions
@@ -626,6 +785,9 @@ namespace osuCrypto
                 accOne<F, CoeffCtx, true, AccumulatorSize>(X, i, size, mtxCoeffIter++, ctx);
             ++i;
         }
+
+        mAccCycles += cycleCount() - begin;
+        mAccElements += size;
     }
 
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
 #include "ExConv_tests.h"
 #include "ExConvCodeTest/ExConvCodeTest.h"
 #include <iomanip>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
 #include "libOTe/Tools/CoeffCtx.h"
 #include "ExConvCodeTest/ExConvCheckerTest.h"
 
@@ -60,15 +65,16 @@ namespace osuCrypto
             @param bw       : expander weight
             @param aw       : accumulator size
             @param sys      : whether the code is systematic or not
+            @param thrd     : whether the accumulator coefficients are generated on a helper thread
             @param v        : verbose mode
     */
     template<typename F, typename CoeffCtx>
-    void exConvTest(u64 k, u64 n, u64 bw, u64 aw, bool sys, bool v = false)
+    void exConvTest(u64 k, u64 n, u64 bw, u64 aw, bool sys, bool thrd = false, bool v = false)
     {
         // if verbose print the test and its parameters
         if(v){
             std::cout << "->-> exConvTest" << std::endl;
-            std::cout << "     Params: k=" << k << "; n=" << n << "; bw=" << bw << "; aw=" << aw;
+            std::cout << "     Params: k=" << k << "; n=" << n << "; bw=" << bw << "; aw=" << aw << "; thrd=" << thrd;
             // std::cout << "; sys=" << sys << "; F=" << typeid(F).name() ;
             // std::cout << "; CoeffCtx=" << typeid(CoeffCtx).name();
             std::cout << std::endl;
@@ -76,6 +82,7 @@ namespace osuCrypto
         // The ExConv code instance
         ExConvCodeTest code;
         code.config(k, n, bw, aw, sys);
+        code.mCoeffThread = thrd;
         
         // Offset for systematic coding
         auto accOffset = sys * k;
@@ -368,10 +375,167 @@ Part 4: Dual Encoding
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // =====================================================================================================
         if(v){
+            std::cout << "     accumulate: " << code.accCyclesPerElement() << " cycles/elem" << std::endl;
             std::cout << "exConvTest ->->" << std::endl;
         }
     }
 
+    /*
+        Benchmarks the stages of ExConvCodeTest::dualEncode separately.
+
+        nt threads each encode their own vector with their own code instance for
+        the given number of trials. For each stage the cost per element is reported
+        in cycles (averaged over the threads) and the throughput in GB/s (over all
+        threads). An element of the accumulate stage is one of the n - sys * k
+        accumulated values while for expand and memcpy it is one of the k outputs.
+
+        Parameters:
+            @param F        : the field type
+            @param CoeffCtx : the coefficient context type
+            @param name     : the name of F that is printed
+            @param k        : message size
+            @param n        : code size
+            @param bw       : expander weight
+            @param aw       : accumulator size
+            @param sys      : whether the code is systematic or not
+            @param nt       : number of threads
+            @param trials   : number of encodings per thread
+    */
+    template<typename F, typename CoeffCtx>
+    void exConvBench(const char* name, u64 k, u64 n, u64 bw, u64 aw, bool sys, u64 nt, u64 trials)
+    {
+        enum Stage { Accumulate, Expand, Memcpy, NumStages };
+        const char* stageNames[NumStages] = { "accumulate", "expand", "memcpy" };
+
+        // per thread cycles and nanoseconds spent in each stage.
+        std::vector<std::array<u64, NumStages>> cycles(nt), nanos(nt);
+
+        auto size = n - sys * k;
+        u64 elements[NumStages] = { size, k, sys ? 0 : k };
+
+        auto routine = [&](u64 t)
+        {
+            ExConvCodeTest code;
+            code.config(k, n, bw, aw, sys, true, block(t, 4532345));
+            CoeffCtx ctx;
+
+            PRNG prng(block(t, 2342343));
+            std::vector<F> x(n), w(k);
+            for (auto& xx : x)
+                prng.get(&xx, 1);
+
+            cycles[t].fill(0);
+            nanos[t].fill(0);
+            auto e = x.data();
+            auto d = sys ? e + k : e;
+            auto c0 = ExConvCodeTest::cycleCount();
+            auto t0 = std::chrono::steady_clock::now();
+            auto mark = [&](Stage s)
+            {
+                auto c1 = ExConvCodeTest::cycleCount();
+                auto t1 = std::chrono::steady_clock::now();
+                cycles[t][s] += c1 - c0;
+                nanos[t][s] += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+                c0 = c1;
+                t0 = t1;
+            };
+
+            for (u64 i = 0; i < trials; ++i)
+            {
+                c0 = ExConvCodeTest::cycleCount();
+                t0 = std::chrono::steady_clock::now();
+
+                code.accumulate<F, CoeffCtx>(d, ctx);
+                mark(Accumulate);
+
+                if (sys)
+                {
+                    code.mExpander.expand<F, CoeffCtx, true>(d, e, ctx);
+                    mark(Expand);
+                }
+                else
+                {
+                    code.mExpander.expand<F, CoeffCtx, false>(d, w.data(), ctx);
+                    mark(Expand);
+
+                    ctx.copy(w.begin(), w.end(), e);
+                    mark(Memcpy);
+                }
+            }
+        };
+
+        std::vector<std::thread> thrds(nt - 1);
+        for (u64 t = 1; t < nt; ++t)
+            thrds[t - 1] = std::thread(routine, t);
+        routine(0);
+        for (auto& t : thrds)
+            t.join();
+
+        std::cout << std::setw(6) << name << " k " << std::setw(8) << k << " n " << std::setw(8) << n
+            << " bw " << std::setw(2) << bw << " aw " << std::setw(2) << aw << " sys " << sys
+            << " nt " << std::setw(2) << nt;
+        for (u64 s = 0; s < NumStages; ++s)
+        {
+            if (elements[s] == 0)
+                continue;
+
+            u64 totalCycles = 0, maxNanos = 0;
+            for (u64 t = 0; t < nt; ++t)
+            {
+                totalCycles += cycles[t][s];
+                maxNanos = std::max(maxNanos, nanos[t][s]);
+            }
+
+            auto cyclesPerElem = double(totalCycles) / (elements[s] * trials * nt);
+            auto gbps = maxNanos ? double(elements[s] * trials * nt * sizeof(F)) / maxNanos : 0;
+            std::cout << " | " << stageNames[s] << " " << std::fixed << std::setprecision(2)
+                << std::setw(7) << cyclesPerElem << " c/e " << std::setw(6) << gbps << " GB/s";
+        }
+        std::cout << std::defaultfloat << std::endl;
+    }
+
+    /*
+        A wrapper function to run exConvBench over a grid of parameters, element
+        types and thread counts.
+
+        Parameters:
+            @param cmd : the command line parser
+    */
+    void ExConvCode_bench(const oc::CLP& cmd)
+    {
+        // k: message size k
+        auto K = cmd.getManyOr<u64>("k", { 1ull << 16, 1ull << 20 });
+
+        // r: code rate for the code size n = k * r
+        auto R = cmd.getManyOr<double>("R", { 2.0 });
+
+        // bw: expander size
+        auto Bw = cmd.getManyOr<u64>("bw", { 7 });
+
+        // aw: accumulator size
+        auto Aw = cmd.getManyOr<u64>("aw", { 24 });
+
+        // nt: number of threads
+        auto Nt = cmd.getManyOr<u64>("nt", { 1 });
+
+        // t: encodings per thread
+        auto trials = cmd.getOr<u64>("t", 10);
+
+        // sys: only benchmark the systematic code if set, both otherwise
+        auto Sys = cmd.isSet("sys") ? std::vector<bool>{ true } : std::vector<bool>{ false, true };
+
+        for (auto k : K) for (auto r : R) for (auto bw : Bw) for (auto aw : Aw) for (auto sys : Sys) for (auto nt : Nt)
+        {
+            u64 n = k * r;
+            if (nt == 0)
+                throw RTE_LOC;
+
+            exConvBench<u8, CoeffCtxGF2>("u8", k, n, bw, aw, sys, nt, trials);
+            exConvBench<block, CoeffCtxGF2>("block", k, n, bw, aw, sys, nt, trials);
+            exConvBench<u64, CoeffCtxInteger>("u64", k, n, bw, aw, sys, nt, trials);
+        }
+    }
+
     /*
         A wrapper function to run exConvTest with the given parameters.
 
@@ -401,7 +565,7 @@ Part 4: Dual Encoding
             std::cout << "->-> ExConvCode_tester" << std::endl;
         }
 
-        for (auto k : K) for (auto r : R) for (auto bw : Bw) for (auto aw : Aw) for (auto sys : { false, true })
+        for (auto k : K) for (auto r : R) for (auto bw : Bw) for (auto aw : Aw) for (auto sys : { false, true }) for (auto thrd : { false, true })
         {
 
             auto n = k * r;
@@ -410,7 +574,7 @@ Part 4: Dual Encoding
             {
                 std::cout << "starting exConvTest with: F=block; CoeffCtx=CoeffCtxGF128" << std::endl;
             }
-            exConvTest<block, CoeffCtxGF128>(k, n, bw, aw, sys, v);
+            exConvTest<block, CoeffCtxGF128>(k, n, bw, aw, sys, thrd, v);
         }
         if (v)
         {
@@ -595,4 +759,235 @@ Part 4: Dual Encoding
 
     }
 
+    // the threaded weight searches must give the nt = 1 minimum and count
+    // every pair (row) exactly once for any thread count.
+    void ExConvCode_weight_thread_test(const oc::CLP& cmd)
+    {
+        u64 k = cmd.getOr("k", 256);
+        u64 n = k * 2;
+
+        ExConvCodeTest encoder;
+        encoder.config(k, n, 7, 24);
+
+        u64 c1 = 0, r1 = 0;
+        auto min1 = getGeneratorWeightx2<ExConvCodeTest, u64&>(encoder, false, c1, 1);
+        auto row1 = getGeneratorWeight2<ExConvCodeTest, u64&>(encoder, false, r1, 1);
+        if (c1 != k * k || r1 != n)
+            throw RTE_LOC;
+
+        for (u64 nt : { 2, 3, 8 })
+        {
+            u64 c = 0, r = 0;
+            auto min = getGeneratorWeightx2<ExConvCodeTest, u64&>(encoder, false, c, nt);
+            auto row = getGeneratorWeight2<ExConvCodeTest, u64&>(encoder, false, r, nt);
+            if (min != min1 || c != c1 || row != row1 || r != r1)
+                throw RTE_LOC;
+        }
+    }
+
+    // the minimum weight of a nonzero codeword of the k by n bit packed
+    // generator G. All 2^k - 1 messages are enumerated in Gray code order.
+    u64 bruteForceMinWeight(Matrix<block>& G, u64 n)
+    {
+        auto k = G.rows();
+        auto W = G.cols() * 2;
+        std::vector<u64> cw(W);
+        u64 min = n;
+        for (u64 i = 1; i < (1ull << k); ++i)
+        {
+            auto row = (u64*)G.data(popcount((i & (0 - i)) - 1));
+            u64 weight = 0;
+            for (u64 w = 0; w < W; ++w)
+            {
+                cw[w] ^= row[w];
+                weight += popcount(cw[w]);
+            }
+            min = std::min(min, weight);
+        }
+        return min;
+    }
+
+    // isdMinWeight must find the minimum distance of small codes whose
+    // distance is known: the first order Reed-Muller code RM(1,6), with
+    // d = 32, and random codes measured by brute force. Both Prange and Stern
+    // are run with 1 and 3 threads and restart every k iterations.
+    void ExConvCode_isd_test(const oc::CLP& cmd)
+    {
+        struct Code
+        {
+            Matrix<block> mG;
+            u64 mN, mD;
+        };
+        std::vector<Code> codes;
+
+        // RM(1,6): the all ones row and the 6 coordinate functions over F_2^6.
+        u64 m = 6, n = 1ull << m;
+        Matrix<block> rm(m + 1, divCeil(n, 128));
+        for (u64 j = 0; j < n; ++j)
+        {
+            *BitIterator((u8*)rm.data(0), j) = 1;
+            for (u64 i = 0; i < m; ++i)
+                *BitIterator((u8*)rm.data(i + 1), j) = (j >> i) & 1;
+        }
+        if (bruteForceMinWeight(rm, n) != n / 2)
+            throw RTE_LOC;
+        codes.push_back({ rm, n, n / 2 });
+
+        // random 16 by 100 codes. The bits past n are left set, isdMinWeight
+        // must ignore them.
+        u64 k = 16;
+        n = 100;
+        for (u64 s = 0; s < 4; ++s)
+        {
+            PRNG prng(block(s, 3245234));
+            Matrix<block> G(k, divCeil(n, 128));
+            prng.get(G.data(), G.size());
+            auto H = G;
+            for (u64 i = 0; i < k; ++i)
+                ((u64*)H.data(i))[n / 64] &= (1ull << (n % 64)) - 1;
+            codes.push_back({ G, n, bruteForceMinWeight(H, n) });
+        }
+
+        for (auto& code : codes)
+        {
+            for (bool stern : { false, true })
+            {
+                for (u64 nt : { 1, 3 })
+                {
+                    ISDParams params;
+                    params.mIters = 2000;
+                    params.mStern = stern;
+                    params.mThreads = nt;
+                    auto r = isdMinWeight(code.mG, code.mN, params);
+                    if (r.mMin != code.mD || r.mHits == 0 || r.mIters != params.mIters)
+                        throw RTE_LOC;
+
+                    // a fresh information set every k iterations.
+                    if (r.mRestarts != divCeil(params.mIters, code.mG.rows()))
+                        throw RTE_LOC;
+                }
+            }
+        }
+    }
+
+    // ExConvResultStore must give back the latest entry of each key after a
+    // reopen and drop corrupt or torn lines. An x2 search interrupted after
+    // its third checkpoint must resume from the store to the minimum of an
+    // uninterrupted search, and a stale checkpoint of another tiling must be
+    // ignored.
+    void ExConvResultStore_test(const oc::CLP& cmd)
+    {
+        auto path = cmd.getOr<std::string>("storePath", "ExConvResultStore_test.txt");
+        std::remove(path.c_str());
+
+        u64 k = 256, n = 512;
+        auto seed = block(21341234, 0);
+        auto kw = ExConvResultStore::key(k, n, 24, 7, true, true, true, seed, "w");
+        auto kx = ExConvResultStore::key(k, n, 24, 7, true, true, true, seed, "x2");
+        std::vector<u8> bits{ 1, 0, 1, 1, 0, 0, 0, 1, 1 };
+        std::vector<u64> vals;
+        TileCheckpoint ckpt;
+
+        {
+            ExConvResultStore store(path);
+            store.putResult(kw, { 5, 6 });
+            store.putResult(kw, { 7, 8, 9 });
+            ckpt.mDone = bits;
+            ckpt.mMin = 123;
+            store.putCheckpoint(kx, ckpt);
+        }
+        {
+            ExConvResultStore store(path);
+            if (!store.getResult(kw, vals) || vals != std::vector<u64>{ 7, 8, 9 })
+                throw RTE_LOC;
+            ckpt = {};
+            if (!store.getCheckpoint(kx, ckpt) || ckpt.mMin != 123 || ckpt.mDone != bits)
+                throw RTE_LOC;
+            if (store.getResult(kx, vals) || store.getCheckpoint(kw, ckpt))
+                throw RTE_LOC;
+
+            // the result of a trial replaces its checkpoint.
+            store.putResult(kx, { 42 });
+            if (store.getCheckpoint(kx, ckpt))
+                throw RTE_LOC;
+        }
+
+        {
+            std::ofstream out(path, std::ios::app);
+            out << "r bad1 12x\n"
+                << "r bad2\n"
+                << "c bad3 7 9:zz\n"
+                << "c bad4 7 99999999999999:0\n"
+                << "c bad5 7 5:1\n"
+                << "c bad6 7\n"
+                << "r " << kw << " 1 2 3";
+        }
+        {
+            ExConvResultStore store(path);
+            for (auto bad : { "bad1", "bad2" })
+                if (store.getResult(bad, vals))
+                    throw RTE_LOC;
+            for (auto bad : { "bad3", "bad4", "bad5", "bad6" })
+                if (store.getCheckpoint(bad, ckpt))
+                    throw RTE_LOC;
+            if (!store.getResult(kw, vals) || vals != std::vector<u64>{ 7, 8, 9 })
+                throw RTE_LOC;
+            if (!store.getResult(kx, vals) || vals != std::vector<u64>{ 42 })
+                throw RTE_LOC;
+        }
+
+        ExConvCodeTest encoder;
+        encoder.config(k, n, 7, 24);
+        u64 c0 = 0;
+        auto min0 = getGeneratorWeightx2<ExConvCodeTest, u64&>(encoder, false, c0);
+        auto ki = ExConvResultStore::key(k, n, 24, 7, true, true, true, seed, "x2-resume");
+
+        struct Interrupt {};
+        u64 saves = 0;
+        try
+        {
+            ExConvResultStore store(path);
+            ckpt = {};
+            ckpt.mInterval = 0;
+            ckpt.mSave = [&](const TileCheckpoint& c) {
+                store.putCheckpoint(ki, c);
+                if (++saves == 3)
+                    throw Interrupt{};
+            };
+            getGeneratorWeightx2<ExConvCodeTest>(encoder, false, u64{}, 1, &ckpt);
+            throw RTE_LOC;
+        }
+        catch (Interrupt&)
+        {
+        }
+
+        {
+            ExConvResultStore store(path);
+            ckpt = {};
+            if (!store.getCheckpoint(ki, ckpt))
+                throw RTE_LOC;
+            u64 done = std::count(ckpt.mDone.begin(), ckpt.mDone.end(), 1);
+            if (done == 0 || done == ckpt.mDone.size())
+                throw RTE_LOC;
+
+            u64 c = 0;
+            auto min = getGeneratorWeightx2<ExConvCodeTest, u64&>(encoder, false, c, 1, &ckpt);
+            done = std::count(ckpt.mDone.begin(), ckpt.mDone.end(), 1);
+            if (min != min0 || c != c0 || done != ckpt.mDone.size())
+                throw RTE_LOC;
+
+            // a checkpoint of another tiling is stale, its tiles and
+            // minimum must not be used.
+            ckpt = {};
+            ckpt.mDone.assign(3, 1);
+            ckpt.mMin = 0;
+            c = 0;
+            min = getGeneratorWeightx2<ExConvCodeTest, u64&>(encoder, false, c, 1, &ckpt);
+            if (min != min0 || c != c0)
+                throw RTE_LOC;
+        }
+
+        std::remove(path.c_str());
+    }
+
 }
\ No newline at end of file
@@ -8,6 +8,14 @@ namespace osuCrypto
 
     void ExConvCode_tester(const oc::CLP& cmd);
 
+    void ExConvCode_bench(const oc::CLP& cmd);
+
     void ExConvCode_weight_test(const oc::CLP& cmd);
 
+    void ExConvCode_weight_thread_test(const oc::CLP& cmd);
+
+    void ExConvCode_isd_test(const oc::CLP& cmd);
+
+    void ExConvResultStore_test(const oc::CLP& cmd);
+
 }
\ No newline at end of file
@@ -65,12 +65,28 @@ public:
   }
 };
 
+/*
+  Source of the random bit OTs of _2ROT other than the IKNP instances of
+  OTPack, e.g. silent OT (SilentRotSource in silentOTutils.h). rots() gives
+  this party num_ots random OTs in each direction, packed 8 per byte (LSB
+  first): s0, s1 of the OTs it sends and the choice bits b and r = s'_b of
+  the OTs it receives. Both parties call it with the same num_ots.
+*/
+class RotSource {
+public:
+  virtual ~RotSource() {}
+  virtual void rots(uint8_t *s0, uint8_t *s1, uint8_t *b, uint8_t *r,
+                    int num_ots) = 0;
+};
+
 class TripleGenerator {
 public:
   sci::IOPack *iopack;
   sci::OTPack *otpack;
   sci::PRG128 *prg;
   int party;
+  // If set, _2ROT takes its random OTs from here instead of IKNP.
+  RotSource *rot_source = nullptr;
 
   TripleGenerator(int party, sci::IOPack *iopack, sci::OTPack *otpack) {
     this->iopack = iopack;
@@ -80,6 +96,15 @@ public:
 
   ~TripleGenerator() { delete prg; }
 
+  // Moves bit t of x to bit 2t.
+  static uint16_t spread_bits(uint8_t x) {
+    uint16_t v = x;
+    v = (v | (v << 4)) & 0x0F0F;
+    v = (v | (v << 2)) & 0x3333;
+    v = (v | (v << 1)) & 0x5555;
+    return v;
+  }
+
   void generate(int party, uint8_t *ai, uint8_t *bi, uint8_t *ci,
                 int num_triples, TripleGenMethod method, bool packed = false,
                 int offset = 1) {
@@ -163,21 +188,61 @@ public:
       break;
     }
     case _2ROT: {
-      throw std::invalid_argument("To be implemented");
+      // One random bit OT in each direction per triple: from rot_source if
+      // set, else this party is the sender on iknp_straight and the
+      // receiver on iknp_reversed. The triples are independent, so
+      // correlated pairs (offset > 1) are not supported.
+      assert(offset == 1);
+      assert(!packed || num_triples % 8 == 0);
+      if (rot_source != nullptr) {
+        generate_2ROT_from_source(ai, bi, ci, num_triples, packed);
+        break;
+      }
+      uint8_t *s0 = new uint8_t[num_triples];
+      uint8_t *s1 = new uint8_t[num_triples];
+      uint8_t *r = new uint8_t[num_triples];
+      bool *b = new bool[num_triples];
+      prg->random_bool(b, num_triples);
+      if (party == sci::ALICE) {
+        otpack->iknp_straight->send_rot(s0, s1, num_triples);
+        otpack->iknp_reversed->recv_rot(r, b, num_triples);
+      } else {
+        otpack->iknp_straight->recv_rot(r, b, num_triples);
+        otpack->iknp_reversed->send_rot(s0, s1, num_triples);
+      }
+      if (packed) {
+        int num_bytes = num_triples / 8;
+        uint8_t *s0_p = new uint8_t[num_bytes];
+        uint8_t *s1_p = new uint8_t[num_bytes];
+        uint8_t *r_p = new uint8_t[num_bytes];
+        uint8_t *b_p = new uint8_t[num_bytes];
+        for (int i = 0; i < num_triples; i += 8) {
+          s0_p[i / 8] = sci::bool_to_uint8(s0 + i, 8);
+          s1_p[i / 8] = sci::bool_to_uint8(s1 + i, 8);
+          r_p[i / 8] = sci::bool_to_uint8(r + i, 8);
+          b_p[i / 8] = sci::bool_to_uint8((uint8_t *)b + i, 8);
+        }
+        triples_from_rots(ai, bi, ci, s0_p, s1_p, b_p, r_p, num_bytes);
+        delete[] s0_p;
+        delete[] s1_p;
+        delete[] r_p;
+        delete[] b_p;
+      } else {
+        triples_from_rots(ai, bi, ci, s0, s1, (uint8_t *)b, r, num_triples);
+      }
+      delete[] s0;
+      delete[] s1;
+      delete[] r;
+      delete[] b;
       break;
     }
     case _16KKOT_to_4OT: {
       assert((num_triples & 1) == 0); // num_triples is even
-      uint8_t *a, *b, *c;
       if (packed) {
-        a = new uint8_t[num_triples];
-        b = new uint8_t[num_triples];
-        c = new uint8_t[num_triples];
-      } else {
-        a = ai;
-        b = bi;
-        c = ci;
+        generate_16KKOT_to_4OT_packed(party, ai, bi, ci, num_triples);
+        break;
       }
+      uint8_t *a = ai, *b = bi, *c = ci;
       prg->random_bool((bool *)a, num_triples);
       prg->random_bool((bool *)b, num_triples);
       switch (party) {
@@ -222,16 +287,6 @@ public:
         break;
       }
       }
-      if (packed) {
-        for (int i = 0; i < num_triples; i += 8) {
-          ai[i / 8] = sci::bool_to_uint8(a + i, 8);
-          bi[i / 8] = sci::bool_to_uint8(b + i, 8);
-          ci[i / 8] = sci::bool_to_uint8(c + i, 8);
-        }
-        delete[] a;
-        delete[] b;
-        delete[] c;
-      }
       break;
     }
     case _8KKOT: {
@@ -315,6 +370,112 @@ public:
     }
   }
 
+  /*
+    Bit triples from one random OT in each direction. In the OT where this
+    party is the sender it holds random bits s0, s1, in the other one it
+    holds its choice bits b and r = s'_b of the other party's s'0, s'1. It
+    sets a = s0 ^ s1 and c = (a & b) ^ s0 ^ r: since r ^ s'0 = b & a', the
+    cross terms cancel and c ^ c' = (a ^ a') & (b ^ b').
+    Works bitwise, so the inputs and outputs are either num_bytes packed
+    bytes or one bit per byte. The random OTs can come from any source
+    (see RotSource) and need no communication here.
+  */
+  static void triples_from_rots(uint8_t *ai, uint8_t *bi, uint8_t *ci,
+                                const uint8_t *s0, const uint8_t *s1,
+                                const uint8_t *b, const uint8_t *r,
+                                int num_bytes) {
+    for (int i = 0; i < num_bytes; i++) {
+      ai[i] = s0[i] ^ s1[i];
+      bi[i] = b[i];
+      ci[i] = (ai[i] & b[i]) ^ s0[i] ^ r[i];
+    }
+  }
+
+  // _2ROT with the random OTs of rot_source.
+  void generate_2ROT_from_source(uint8_t *ai, uint8_t *bi, uint8_t *ci,
+                                 int num_triples, bool packed) {
+    const int num_bytes = (num_triples + 7) / 8;
+    uint8_t *rots = new uint8_t[(size_t)4 * num_bytes];
+    uint8_t *s0 = rots, *s1 = s0 + num_bytes, *b = s1 + num_bytes,
+            *r = b + num_bytes;
+    rot_source->rots(s0, s1, b, r, num_triples);
+    if (packed) {
+      triples_from_rots(ai, bi, ci, s0, s1, b, r, num_bytes);
+    } else {
+      uint8_t *abc = new uint8_t[(size_t)3 * num_bytes];
+      uint8_t *a_p = abc, *b_p = a_p + num_bytes, *c_p = b_p + num_bytes;
+      triples_from_rots(a_p, b_p, c_p, s0, s1, b, r, num_bytes);
+      for (int i = 0; i < num_triples; i += 8) {
+        int len = std::min(8, num_triples - i);
+        sci::uint8_to_bool(ai + i, a_p[i / 8], len);
+        sci::uint8_to_bool(bi + i, b_p[i / 8], len);
+        sci::uint8_to_bool(ci + i, c_p[i / 8], len);
+      }
+      delete[] abc;
+    }
+    delete[] rots;
+  }
+
+  /*
+    _16KKOT_to_4OT on packed triples (num_triples a multiple of 8). Triples
+    2i and 2i+1 share OT i, whose 16 messages only depend on the six bits
+    a, b and c of the two triples, so ALICE copies each message row from a
+    table of the 64 possible rows instead of evaluating it entry by entry.
+    Byte k of the packed arrays covers OTs 4k..4k+3, 2 bits each.
+  */
+  void generate_16KKOT_to_4OT_packed(int party, uint8_t *ai, uint8_t *bi,
+                                     uint8_t *ci, int num_triples) {
+    assert(num_triples % 8 == 0);
+    const int num_bytes = num_triples / 8, num_ots = num_triples / 2;
+    prg->random_data(ai, num_bytes);
+    prg->random_data(bi, num_bytes);
+    if (party == sci::ALICE) {
+      prg->random_data(ci, num_bytes);
+      // Row for a = a0 | a1 << 1, b and c (2 bits each) at index
+      // a | b << 2 | c << 4, entry j = a01 || b01 || a11 || b11 (LSB->MSB).
+      alignas(16) uint8_t rows[64][16];
+      for (int idx = 0; idx < 64; idx++) {
+        int a = idx & 3, b = (idx >> 2) & 3, c = idx >> 4;
+        for (int j = 0; j < 16; j++) {
+          int ja = (j & 1) | ((j >> 1) & 2), jb = ((j >> 1) & 1) | ((j >> 2) & 2);
+          rows[idx][j] = ((a ^ ja) & (b ^ jb)) ^ c;
+        }
+      }
+      uint8_t *msgs = new uint8_t[(size_t)num_ots * 16];
+      uint8_t **ot_messages = new uint8_t *[num_ots];
+      for (int k = 0; k < num_bytes; k++) {
+        for (int q = 0; q < 4; q++) {
+          int idx = ((ai[k] >> (2 * q)) & 3) | (((bi[k] >> (2 * q)) & 3) << 2) |
+                    (((ci[k] >> (2 * q)) & 3) << 4);
+          _mm_storeu_si128((__m128i *)(msgs + (size_t)(4 * k + q) * 16),
+                           _mm_load_si128((const __m128i *)rows[idx]));
+        }
+      }
+      for (int i = 0; i < num_ots; i++)
+        ot_messages[i] = msgs + (size_t)i * 16;
+      otpack->kkot[3]->send(ot_messages, num_ots, 2);
+      delete[] ot_messages;
+      delete[] msgs;
+    } else {
+      uint8_t *ot_selection = new uint8_t[num_ots];
+      uint8_t *ot_result = new uint8_t[num_ots];
+      for (int k = 0; k < num_bytes; k++) {
+        // Interleave a and b: bit 2t is a_t, bit 2t + 1 is b_t, so each
+        // nibble is the selection b11 || a11 || b01 || a01 of one OT.
+        uint16_t ab = spread_bits(ai[k]) | (spread_bits(bi[k]) << 1);
+        for (int q = 0; q < 4; q++)
+          ot_selection[4 * k + q] = (ab >> (4 * q)) & 15;
+      }
+      otpack->kkot[3]->recv(ot_result, ot_selection, num_ots, 2);
+      for (int k = 0; k < num_bytes; k++) {
+        ci[k] = ot_result[4 * k] | (ot_result[4 * k + 1] << 2) |
+                (ot_result[4 * k + 2] << 4) | (ot_result[4 * k + 3] << 6);
+      }
+      delete[] ot_selection;
+      delete[] ot_result;
+    }
+  }
+
   void generate(int party, Triple *triples, TripleGenMethod method) {
     generate(party, triples->ai, triples->bi, triples->ci, triples->num_triples,
              method, triples->packed, triples->offset);
@@ -72,26 +72,25 @@ public:
   void bitlen_lt_beta(uint8_t *res_eq, uint64_t *data, int num_eqs,
                       int bitlength, bool greater_than = true,
                       int radix_base = MILL_PARAM) {
-    uint8_t N = 1 << bitlength;
+    int N = 1 << bitlength;
     uint8_t mask = N - 1;
     if (party == sci::ALICE) {
       sci::PRG128 prg;
       prg.random_data(res_eq, num_eqs * sizeof(uint8_t));
-      uint8_t **leaf_messages = new uint8_t *[num_eqs];
+      uint8_t *leaf_messages = new uint8_t[(int64_t)num_eqs * N];
+      uint8_t *digit = new uint8_t[num_eqs];
       for (int i = 0; i < num_eqs; i++) {
         res_eq[i] &= 1;
-        leaf_messages[i] = new uint8_t[N];
-        this->set_leaf_ot_messages(leaf_messages[i], (data[i] & mask), N,
-                                   res_eq[i]);
+        digit[i] = data[i] & mask;
       }
+      this->set_leaf_ot_messages(leaf_messages, N, digit, num_eqs, N, res_eq);
       if (bitlength > 1) {
-        otpack->kkot[bitlength - 1]->send(leaf_messages, num_eqs, 1);
+        otpack->kkot[bitlength - 1]->send(leaf_messages, N, num_eqs, 1);
       } else {
-        otpack->iknp_straight->send(leaf_messages, num_eqs, 1);
+        otpack->iknp_straight->send(leaf_messages, N, num_eqs, 1);
       }
 
-      for (int i = 0; i < num_eqs; i++)
-        delete[] leaf_messages[i];
+      delete[] digit;
       delete[] leaf_messages;
     } else { // party == BOB
       uint8_t *choice = new uint8_t[num_eqs];
@@ -153,51 +152,46 @@ public:
 
     // Set leaf OT messages now
     if (party == sci::ALICE) {
-      uint8_t **leaf_ot_messages; // (num_digits * num_eqs) X beta_pow (=2^beta)
-      leaf_ot_messages = new uint8_t *[num_digits * num_eqs];
-      for (int i = 0; i < num_digits * num_eqs; i++)
-        leaf_ot_messages[i] = new uint8_t[beta_pow];
+      // (num_digits * num_eqs) X beta_pow (=2^beta), row-major
+      uint8_t *leaf_ot_messages =
+          new uint8_t[(int64_t)num_digits * num_eqs * beta_pow];
+      const int64_t last = (int64_t)num_eqs * (num_digits - 1);
 
       // Set Leaf OT messages
       triple_gen->prg->random_bool((bool *)leaf_res_eq, num_digits * num_eqs);
-      for (int i = 0; i < num_digits; i++) {
-        for (int j = 0; j < num_eqs; j++) {
-          if (i == (num_digits - 1) && (r > 0)) {
-            this->set_leaf_ot_messages(leaf_ot_messages[i * num_eqs + j],
-                                       digits[i * num_eqs + j], 1ULL << r,
-                                       leaf_res_eq[i * num_eqs + j]);
-          } else {
-            this->set_leaf_ot_messages(leaf_ot_messages[i * num_eqs + j],
-                                       digits[i * num_eqs + j], beta_pow,
-                                       leaf_res_eq[i * num_eqs + j]);
-          }
-        }
+      if (r > 0) {
+        this->set_leaf_ot_messages(leaf_ot_messages, beta_pow, digits, last,
+                                   beta_pow, leaf_res_eq);
+        this->set_leaf_ot_messages(leaf_ot_messages + last * beta_pow,
+                                   beta_pow, digits + last, num_eqs, 1 << r,
+                                   leaf_res_eq + last);
+      } else {
+        this->set_leaf_ot_messages(leaf_ot_messages, beta_pow, digits,
+                                   num_digits * num_eqs, beta_pow, leaf_res_eq);
       }
 
       // Perform Leaf OTs with comparison and equality
       if (r == 1) {
         // All branches except r
-        otpack->kkot[beta - 1]->send(leaf_ot_messages,
+        otpack->kkot[beta - 1]->send(leaf_ot_messages, beta_pow,
                                      num_eqs * (num_digits - 1), 1);
         // r branch
-        otpack->iknp_straight->send(
-            leaf_ot_messages + num_eqs * (num_digits - 1), num_eqs, 1);
+        otpack->iknp_straight->send(leaf_ot_messages + last * beta_pow,
+                                    beta_pow, num_eqs, 1);
       } else if (r != 0) {
         // All branches except r
-        otpack->kkot[beta - 1]->send(leaf_ot_messages,
+        otpack->kkot[beta - 1]->send(leaf_ot_messages, beta_pow,
                                      num_eqs * (num_digits - 1), 1);
         // r branch
-        otpack->kkot[r - 1]->send(leaf_ot_messages + num_eqs * (num_digits - 1),
+        otpack->kkot[r - 1]->send(leaf_ot_messages + last * beta_pow, beta_pow,
                                   num_eqs, 1);
       } else {
         // All branches including r, r is 0
-        otpack->kkot[beta - 1]->send(leaf_ot_messages, num_eqs * (num_digits),
-                                     1);
+        otpack->kkot[beta - 1]->send(leaf_ot_messages, beta_pow,
+                                     num_eqs * (num_digits), 1);
       }
 
       // Cleanup
-      for (int i = 0; i < num_digits * num_eqs; i++)
-        delete[] leaf_ot_messages[i];
       delete[] leaf_ot_messages;
     } else // party = sci::BOB
     {
@@ -250,7 +244,10 @@ public:
     Triple triples_std((num_triples)*num_eqs, true);
 
     // Generate required Bit-Triples
-    triple_gen->generate(party, &triples_std, _16KKOT_to_4OT);
+    if (mill->triple_bank != nullptr)
+      mill->triple_bank->lease(&triples_std);
+    else
+      triple_gen->generate(party, &triples_std, _16KKOT_to_4OT);
 
     // Combine leaf OT results in a bottom-up fashion
     int counter_triples_used = 0, old_counter_triples_used = 0;
@@ -348,6 +345,15 @@ public:
       ot_messages[i] = ((digit == i) ^ mask_eq);
     }
   }
+
+  // set_leaf_ot_messages for num comparisons at once, row k at
+  // ot_messages + k * stride.
+  void set_leaf_ot_messages(uint8_t *ot_messages, int stride,
+                            const uint8_t *digits, int num, int N,
+                            const uint8_t *mask_eq) {
+    fill_leaf_ot_messages(ot_messages, stride, digits, num, N, nullptr, mask_eq,
+                          true);
+  }
 };
 
 #endif // EQUALITY_H__
@@ -0,0 +1,212 @@
+/*
+Runtime choice of the MillParams of a comparison from a cost model.
+
+The model predicts the time of one compare call of num_cmps comparisons as
+
+  rounds * rtt / 2 + num_cmps * (bytes_per_cmp / bandwidth + compute_per_cmp)
+
+where rtt and bandwidth come from measure_link (a ping-pong and a bulk
+transfer timed against the NetIO byte counters) and rounds, bytes_per_cmp
+and compute_per_cmp are measured for each bitlength and candidate MillParams
+by autotune, which runs real comparisons on the deployment's channels. The
+compute term is what is left of the measured time once the link terms are
+taken out, so it covers the OT extensions, the triple generation and the
+traversal on this machine.
+
+Both parties must pick the same parameters, so ALICE's link profile and
+table are sent to BOB at the end of measure_link and autotune; choose is
+then deterministic on both sides.
+*/
+
+#ifndef MILL_TUNER_H__
+#define MILL_TUNER_H__
+#include "Millionaire/millionaire.h"
+#include <chrono>
+#include <vector>
+
+struct LinkProfile {
+  double rtt_us = 0;       // round-trip time
+  double bytes_per_us = 0; // one-way throughput
+};
+
+// Measured cost of compare for one bitlength and one MillParams.
+struct MillCost {
+  int bitlength;
+  MillParams params;
+  double rounds;             // direction changes per call on the io channel
+  double bytes_per_cmp;      // sent by both parties
+  double compute_us_per_cmp; // time not explained by the link
+};
+
+class MillTuner {
+public:
+  int party;
+  sci::IOPack *iopack;
+  LinkProfile link;
+  std::vector<MillCost> table;
+
+  // iopack must be the one the tuned MillionaireProtocol runs on.
+  MillTuner(int party, sci::IOPack *iopack) {
+    this->party = party;
+    this->iopack = iopack;
+  }
+
+  // Every radix with and without correlated triples, for both ways of
+  // generating standard triples.
+  static std::vector<MillParams> all_candidates() {
+    std::vector<MillParams> cands;
+    for (TripleGenMethod method : {_16KKOT_to_4OT, _2ROT})
+      for (int corr = 0; corr < 2; corr++)
+        for (int radix = 1; radix <= 8; radix++) {
+          MillParams p;
+          p.radix_base = radix;
+          p.corr_triples = corr;
+          p.std_method = method;
+          cands.push_back(p);
+        }
+    return cands;
+  }
+
+  LinkProfile measure_link(int num_pings = 32, int bulk_bytes = 1 << 22) {
+    sci::NetIO *io = iopack->io;
+    uint8_t ping = 0;
+    io->sync();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_pings; i++) {
+      if (party == sci::ALICE) {
+        io->send_data(&ping, 1);
+        io->recv_data(&ping, 1);
+      } else {
+        io->recv_data(&ping, 1);
+        io->send_data(&ping, 1);
+        io->flush();
+      }
+    }
+    double rtt = elapsed_us(t0) / num_pings;
+
+    uint8_t *bulk = new uint8_t[bulk_bytes];
+    memset(bulk, 0, bulk_bytes);
+    uint64_t sent = io->counter;
+    t0 = std::chrono::steady_clock::now();
+    if (party == sci::ALICE) {
+      io->send_data(bulk, bulk_bytes);
+      io->recv_data(&ping, 1);
+    } else {
+      io->recv_data(bulk, bulk_bytes);
+      io->send_data(&ping, 1);
+      io->flush();
+    }
+    double bulk_us = std::max(elapsed_us(t0) - rtt, 1.0);
+    delete[] bulk;
+
+    link.rtt_us = rtt;
+    link.bytes_per_us = (io->counter - sent) / bulk_us;
+    share(&link, sizeof(LinkProfile));
+    return link;
+  }
+
+  /*
+    Adds the costs of compare at bitlength for every candidate to the table,
+    each measured on a second call of sample_cmps comparisons of random
+    inputs (the first one warms up the OT precomputation). Call
+    measure_link first. Leaves mill with its previous parameters.
+  */
+  void autotune(MillionaireProtocol *mill, int bitlength,
+                int sample_cmps = 1 << 12,
+                const std::vector<MillParams> &cands = all_candidates()) {
+    assert(sample_cmps > 0 && link.bytes_per_us > 0);
+    MillParams saved;
+    saved.corr_triples = mill->corr_triples;
+    saved.std_method = mill->std_method;
+
+    uint64_t *data = new uint64_t[sample_cmps];
+    uint8_t *res = new uint8_t[sample_cmps];
+    sci::PRG128 prg;
+    prg.random_data(data, sample_cmps * sizeof(uint64_t));
+    for (int i = 0; i < sample_cmps; i++)
+      data[i] &= (bitlength == 64) ? ~0ULL : (1ULL << bitlength) - 1;
+
+    size_t first = table.size();
+    for (const MillParams &p : cands) {
+      mill->compare(res, data, sample_cmps, bitlength, true, p);
+      iopack->io->sync();
+      uint64_t comm = iopack->get_comm();
+      uint64_t rounds = iopack->io->num_rounds;
+      auto t0 = std::chrono::steady_clock::now();
+      mill->compare(res, data, sample_cmps, bitlength, true, p);
+      iopack->io->flush();
+      iopack->io_rev->flush();
+      rounds = iopack->io->num_rounds - rounds;
+      comm = iopack->get_comm() - comm;
+      iopack->io->sync();
+      double us = elapsed_us(t0) - link.rtt_us; // the closing sync
+
+      MillCost c;
+      c.bitlength = bitlength;
+      c.params = p;
+      c.rounds = rounds;
+      c.bytes_per_cmp = double(comm) / sample_cmps;
+      double link_us = c.rounds * link.rtt_us / 2 +
+                       c.bytes_per_cmp * sample_cmps / link.bytes_per_us;
+      c.compute_us_per_cmp = std::max(us - link_us, 0.0) / sample_cmps;
+      table.push_back(c);
+    }
+    mill->set_params(saved);
+
+    // Count the bytes sent by both parties, then make ALICE's table the
+    // common one.
+    int num = table.size() - first;
+    std::vector<double> peer_bytes(num), own_bytes(num);
+    for (int i = 0; i < num; i++)
+      own_bytes[i] = table[first + i].bytes_per_cmp;
+    if (party == sci::ALICE) {
+      iopack->io->recv_data(peer_bytes.data(), num * sizeof(double));
+      for (int i = 0; i < num; i++)
+        table[first + i].bytes_per_cmp += peer_bytes[i];
+    } else {
+      iopack->io->send_data(own_bytes.data(), num * sizeof(double));
+      iopack->io->flush();
+    }
+    share(table.data() + first, num * sizeof(MillCost));
+
+    delete[] data;
+    delete[] res;
+  }
+
+  double predict_us(const MillCost &c, uint64_t num_cmps) const {
+    return c.rounds * link.rtt_us / 2 +
+           num_cmps * (c.bytes_per_cmp / link.bytes_per_us +
+                       c.compute_us_per_cmp);
+  }
+
+  // Cheapest measured parameters for bitlength, or the compile-time
+  // defaults if autotune has not covered it.
+  MillParams choose(int bitlength, uint64_t num_cmps) const {
+    const MillCost *best = nullptr;
+    for (const MillCost &c : table)
+      if (c.bitlength == bitlength &&
+          (best == nullptr ||
+           predict_us(c, num_cmps) < predict_us(*best, num_cmps)))
+        best = &c;
+    return best ? best->params : MillParams();
+  }
+
+private:
+  static double elapsed_us(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - t0)
+        .count();
+  }
+
+  // Overwrites BOB's copy of a POD buffer with ALICE's.
+  void share(void *buf, int nbytes) {
+    if (party == sci::ALICE) {
+      iopack->io->send_data(buf, nbytes);
+      iopack->io->flush();
+    } else {
+      iopack->io->recv_data(buf, nbytes);
+    }
+  }
+};
+
+#endif // MILL_TUNER_H__
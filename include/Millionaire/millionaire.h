@@ -22,19 +22,121 @@ SOFTWARE.
 #ifndef MILLIONAIRE_H__
 #define MILLIONAIRE_H__
 #include "Millionaire/bit-triple-generator.h"
+#include "Millionaire/triple-bank.h"
 #include "OT/emp-ot.h"
 #include "utils/emp-tool.h"
+#include <climits>
 #include <cmath>
 #include <omp.h>
+#include <vector>
 
 #define MILL_PARAM 4
+// Comparisons per window of compare_stream. Each window allocates about
+// 3 * num_digits bytes per comparison plus the leaf OT messages.
+#define MILL_STREAM_WINDOW (1 << 20)
 #define WAN_EXEC
+// Default of MillParams::corr_triples. WAN_EXEC turns it off.
+#ifdef WAN_EXEC
+#define MILL_CORR_TRIPLES false
+#else
+#define MILL_CORR_TRIPLES true
+#endif
+
+/*
+  Parameters of MillionaireProtocol::compare that both parties must agree
+  on. radix_base is the digit size beta (1 to 8). With corr_triples the
+  non-leftmost ANDs of the traversal use _8KKOT correlated triples and the
+  leaf OTs are sized per digit, which sends less but takes more rounds;
+  without it every AND uses a standard triple and all leaf OTs are
+  1-out-of-2^beta (the WAN_EXEC setting). std_method generates the standard
+  triples (_16KKOT_to_4OT or _2ROT) when no TripleBank is attached.
+*/
+struct MillParams {
+  int radix_base = MILL_PARAM;
+  bool corr_triples = MILL_CORR_TRIPLES;
+  TripleGenMethod std_method = _16KKOT_to_4OT;
+};
+
+/*
+  Leaf OT messages of num comparisons, row k (at ot_messages + k * stride,
+  stride >= N) holding the N messages for digits[k]. Message j is
+  (digits[k] > j) ^ mask_cmp[k] ((digits[k] < j) if !greater_than) and, if
+  mask_eq is given, that bit shifted up with (digits[k] == j) ^ mask_eq[k]
+  below it. With mask_cmp null only the equality bit is set. Each AVX2 op
+  builds 32 messages, i.e. 32 / N whole rows when N < 32.
+*/
+inline void fill_leaf_ot_messages(uint8_t *ot_messages, int stride,
+                                  const uint8_t *digits, int num, int N,
+                                  const uint8_t *mask_cmp,
+                                  const uint8_t *mask_eq, bool greater_than) {
+  assert(N >= 2 && N <= 256 && (N & (N - 1)) == 0 && stride >= N);
+  const int rows = N < 32 ? 32 / N : 1;
+  // Lane i holds message i % N of row i / N.
+  alignas(32) uint8_t msg_idx[32], row_idx[32], out[32];
+  for (int i = 0; i < 32; i++) {
+    msg_idx[i] = i % N;
+    row_idx[i] = i / N;
+  }
+  const __m256i idx0 = _mm256_load_si256((const __m256i *)msg_idx);
+  const __m256i sel = _mm256_load_si256((const __m256i *)row_idx);
+  const __m256i one = _mm256_set1_epi8(1);
+  const __m256i flip = _mm256_set1_epi8((char)0x80); // unsigned compares
+  for (int k = 0; k < num; k += rows) {
+    int n = std::min(rows, num - k);
+    alignas(16) uint8_t d[16] = {0}, mc[16] = {0}, me[16] = {0};
+    memcpy(d, digits + k, n);
+    if (mask_cmp)
+      memcpy(mc, mask_cmp + k, n);
+    if (mask_eq)
+      memcpy(me, mask_eq + k, n);
+    auto spread = [&](const uint8_t *x) {
+      return _mm256_shuffle_epi8(
+          _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)x)),
+          sel);
+    };
+    const __m256i vd = spread(d), vmc = spread(mc), vme = spread(me);
+    const __m256i vd_s = _mm256_xor_si256(vd, flip);
+    for (int j = 0; j < N; j += 32) {
+      __m256i idx = _mm256_add_epi8(idx0, _mm256_set1_epi8((char)j));
+      __m256i m = _mm256_setzero_si256();
+      if (mask_cmp) {
+        __m256i idx_s = _mm256_xor_si256(idx, flip);
+        __m256i c = greater_than ? _mm256_cmpgt_epi8(vd_s, idx_s)
+                                 : _mm256_cmpgt_epi8(idx_s, vd_s);
+        m = _mm256_xor_si256(_mm256_and_si256(c, one), vmc);
+        if (mask_eq)
+          m = _mm256_add_epi8(m, m);
+      }
+      if (mask_eq) {
+        __m256i e = _mm256_and_si256(_mm256_cmpeq_epi8(vd, idx), one);
+        m = _mm256_or_si256(m, _mm256_xor_si256(e, vme));
+      }
+      if (N >= 32) {
+        _mm256_storeu_si256((__m256i *)(ot_messages + (int64_t)k * stride + j),
+                            m);
+      } else if (stride == N && n == rows) {
+        _mm256_storeu_si256((__m256i *)(ot_messages + (int64_t)k * N), m);
+      } else {
+        _mm256_store_si256((__m256i *)out, m);
+        for (int t = 0; t < n; t++)
+          memcpy(ot_messages + (int64_t)(k + t) * stride, out + t * N, N);
+      }
+    }
+  }
+}
 
 class MillionaireProtocol {
 public:
   sci::IOPack *iopack;
   sci::OTPack *otpack;
   TripleGenerator *triple_gen;
+  // If set, the standard triples of the traversals (also those of an
+  // Equality built on this object) are leased from it instead of being
+  // generated inline. Not owned.
+  TripleBank *triple_bank = nullptr;
+  // Set by set_params, see MillParams.
+  bool corr_triples = MILL_CORR_TRIPLES;
+  TripleGenMethod std_method = _16KKOT_to_4OT;
   int party;
   int l, r, log_alpha, beta, beta_pow;
   int num_digits, num_triples_corr, num_triples_std, log_num_digits;
@@ -73,37 +175,48 @@ public:
 
   ~MillionaireProtocol() { delete triple_gen; }
 
+  // Applies the triple settings of params to all later calls. The radix
+  // is still passed per call.
+  void set_params(const MillParams &params) {
+    assert(params.radix_base >= 1 && params.radix_base <= 8);
+    assert(params.std_method == _16KKOT_to_4OT || params.std_method == _2ROT);
+    this->corr_triples = params.corr_triples;
+    this->std_method = params.std_method;
+  }
+
+  void compare(uint8_t *res, uint64_t *data, int num_cmps, int bitlength,
+               bool greater_than, const MillParams &params) {
+    set_params(params);
+    compare(res, data, num_cmps, bitlength, greater_than, false,
+            params.radix_base);
+  }
+
   void compare(uint8_t *res, uint64_t *data, int num_cmps, int bitlength,
                bool greater_than = true, bool equality = false,
                int radix_base = MILL_PARAM) {
     configure(bitlength, radix_base);
 
     if (bitlength <= beta) {
-      uint8_t N = 1 << bitlength;
+      int N = 1 << bitlength;
       uint8_t mask = N - 1;
       if (party == sci::ALICE) {
         sci::PRG128 prg;
         prg.random_data(res, num_cmps * sizeof(uint8_t));
-        uint8_t **leaf_messages = new uint8_t *[num_cmps];
+        uint8_t *leaf_messages = new uint8_t[(int64_t)num_cmps * N];
+        uint8_t *digit = new uint8_t[num_cmps];
         for (int i = 0; i < num_cmps; i++) {
           res[i] &= 1;
-          leaf_messages[i] = new uint8_t[N];
-          for (int j = 0; j < N; j++) {
-            if (greater_than) {
-              leaf_messages[i][j] = ((uint8_t(data[i] & mask) > j) ^ res[i]);
-            } else {
-              leaf_messages[i][j] = ((uint8_t(data[i] & mask) < j) ^ res[i]);
-            }
-          }
+          digit[i] = data[i] & mask;
         }
+        set_leaf_ot_messages(leaf_messages, N, digit, num_cmps, N, res,
+                             nullptr, greater_than, false);
         if (bitlength > 1) {
-          otpack->kkot[bitlength - 1]->send(leaf_messages, num_cmps, 1);
+          otpack->kkot[bitlength - 1]->send(leaf_messages, N, num_cmps, 1);
         } else {
-          otpack->iknp_straight->send(leaf_messages, num_cmps, 1);
+          otpack->iknp_straight->send(leaf_messages, N, num_cmps, 1);
         }
 
-        for (int i = 0; i < num_cmps; i++)
-          delete[] leaf_messages[i];
+        delete[] digit;
         delete[] leaf_messages;
       } else { // party == BOB
         uint8_t *choice = new uint8_t[num_cmps];
@@ -154,110 +267,92 @@ public:
               (uint8_t)(data_ext[j] >> i * beta) & mask_beta;
 
     if (party == sci::ALICE) {
-      uint8_t *
-          *leaf_ot_messages; // (num_digits * num_cmps) X beta_pow (=2^beta)
-      leaf_ot_messages = new uint8_t *[num_digits * num_cmps];
-      for (int i = 0; i < num_digits * num_cmps; i++)
-        leaf_ot_messages[i] = new uint8_t[beta_pow];
+      // (num_digits * num_cmps) X beta_pow (=2^beta), row-major
+      uint8_t *leaf_ot_messages =
+          new uint8_t[(int64_t)num_digits * num_cmps * beta_pow];
 
       // Set Leaf OT messages
       triple_gen->prg->random_bool((bool *)leaf_res_cmp, num_digits * num_cmps);
       triple_gen->prg->random_bool((bool *)leaf_res_eq, num_digits * num_cmps);
-      for (int i = 0; i < num_digits; i++) {
-        for (int j = 0; j < num_cmps; j++) {
-          if (i == 0) {
-            set_leaf_ot_messages(leaf_ot_messages[i * num_cmps + j],
-                                 digits[i * num_cmps + j], beta_pow,
-                                 leaf_res_cmp[i * num_cmps + j], 0,
-                                 greater_than, false);
-          } else if (i == (num_digits - 1) && (r > 0)) {
-#ifdef WAN_EXEC
-            set_leaf_ot_messages(leaf_ot_messages[i * num_cmps + j],
-                                 digits[i * num_cmps + j], beta_pow,
-                                 leaf_res_cmp[i * num_cmps + j],
-                                 leaf_res_eq[i * num_cmps + j], greater_than);
-#else
-            set_leaf_ot_messages(leaf_ot_messages[i * num_cmps + j],
-                                 digits[i * num_cmps + j], 1 << r,
-                                 leaf_res_cmp[i * num_cmps + j],
-                                 leaf_res_eq[i * num_cmps + j], greater_than);
-#endif
-          } else {
-            set_leaf_ot_messages(leaf_ot_messages[i * num_cmps + j],
-                                 digits[i * num_cmps + j], beta_pow,
-                                 leaf_res_cmp[i * num_cmps + j],
-                                 leaf_res_eq[i * num_cmps + j], greater_than);
-          }
-        }
+      // The lowest digit only needs the comparison bit
+      set_leaf_ot_messages(leaf_ot_messages, beta_pow, digits, num_cmps,
+                           beta_pow, leaf_res_cmp, nullptr, greater_than,
+                           false);
+      // With corr_triples the last digit only needs 2^r messages
+      int last = num_cmps * (num_digits - 1);
+      int num_full = (corr_triples && r > 0) ? num_digits - 2 : num_digits - 1;
+      set_leaf_ot_messages(leaf_ot_messages + (int64_t)num_cmps * beta_pow,
+                           beta_pow, digits + num_cmps, num_cmps * num_full,
+                           beta_pow, leaf_res_cmp + num_cmps,
+                           leaf_res_eq + num_cmps, greater_than);
+      if (corr_triples && r > 0) {
+        set_leaf_ot_messages(leaf_ot_messages + (int64_t)last * beta_pow,
+                             beta_pow, digits + last, num_cmps, 1 << r,
+                             leaf_res_cmp + last, leaf_res_eq + last,
+                             greater_than);
       }
 
       // Perform Leaf OTs
-#ifdef WAN_EXEC
-      // otpack->kkot_beta->send(leaf_ot_messages, num_cmps*(num_digits), 2);
-      otpack->kkot[beta - 1]->send(leaf_ot_messages, num_cmps * (num_digits),
-                                   2);
-#else
-      // otpack->kkot_beta->send(leaf_ot_messages, num_cmps, 1);
-      otpack->kkot[beta - 1]->send(leaf_ot_messages, num_cmps, 1);
-      if (r == 1) {
-        // otpack->kkot_beta->send(leaf_ot_messages+num_cmps,
-        // num_cmps*(num_digits-2), 2);
-        otpack->kkot[beta - 1]->send(leaf_ot_messages + num_cmps,
-                                     num_cmps * (num_digits - 2), 2);
-        otpack->iknp_straight->send(
-            leaf_ot_messages + num_cmps * (num_digits - 1), num_cmps, 2);
-      } else if (r != 0) {
-        // otpack->kkot_beta->send(leaf_ot_messages+num_cmps,
-        // num_cmps*(num_digits-2), 2);
-        otpack->kkot[beta - 1]->send(leaf_ot_messages + num_cmps,
-                                     num_cmps * (num_digits - 2), 2);
-        otpack->kkot[r - 1]->send(
-            leaf_ot_messages + num_cmps * (num_digits - 1), num_cmps, 2);
+      if (!corr_triples) {
+        // otpack->kkot_beta->send(leaf_ot_messages, num_cmps*(num_digits),
+        // 2);
+        otpack->kkot[beta - 1]->send(leaf_ot_messages, beta_pow,
+                                     num_cmps * (num_digits), 2);
       } else {
-        // otpack->kkot_beta->send(leaf_ot_messages+num_cmps,
-        // num_cmps*(num_digits-1), 2);
-        otpack->kkot[beta - 1]->send(leaf_ot_messages + num_cmps,
-                                     num_cmps * (num_digits - 1), 2);
+        // otpack->kkot_beta->send(leaf_ot_messages, num_cmps, 1);
+        otpack->kkot[beta - 1]->send(leaf_ot_messages, beta_pow, num_cmps, 1);
+        if (r == 1) {
+          otpack->kkot[beta - 1]->send(
+              leaf_ot_messages + (int64_t)num_cmps * beta_pow, beta_pow,
+              num_cmps * (num_digits - 2), 2);
+          otpack->iknp_straight->send(
+              leaf_ot_messages + (int64_t)last * beta_pow, beta_pow, num_cmps,
+              2);
+        } else if (r != 0) {
+          otpack->kkot[beta - 1]->send(
+              leaf_ot_messages + (int64_t)num_cmps * beta_pow, beta_pow,
+              num_cmps * (num_digits - 2), 2);
+          otpack->kkot[r - 1]->send(leaf_ot_messages + (int64_t)last * beta_pow,
+                                    beta_pow, num_cmps, 2);
+        } else {
+          otpack->kkot[beta - 1]->send(
+              leaf_ot_messages + (int64_t)num_cmps * beta_pow, beta_pow,
+              num_cmps * (num_digits - 1), 2);
+        }
       }
-#endif
       // Cleanup
-      for (int i = 0; i < num_digits * num_cmps; i++)
-        delete[] leaf_ot_messages[i];
       delete[] leaf_ot_messages;
     } else // party = sci::BOB
     {
       // Perform Leaf OTs
-#ifdef WAN_EXEC
-      // otpack->kkot_beta->recv(leaf_res_cmp, digits, num_cmps*(num_digits),
-      // 2);
-      otpack->kkot[beta - 1]->recv(leaf_res_cmp, digits,
-                                   num_cmps * (num_digits), 2);
-#else
-      // otpack->kkot_beta->recv(leaf_res_cmp, digits, num_cmps, 1);
-      otpack->kkot[beta - 1]->recv(leaf_res_cmp, digits, num_cmps, 1);
-      if (r == 1) {
-        // otpack->kkot_beta->recv(leaf_res_cmp+num_cmps, digits+num_cmps,
-        // num_cmps*(num_digits-2), 2);
-        otpack->kkot[beta - 1]->recv(leaf_res_cmp + num_cmps, digits + num_cmps,
-                                     num_cmps * (num_digits - 2), 2);
-        otpack->iknp_straight->recv(leaf_res_cmp + num_cmps * (num_digits - 1),
+      if (!corr_triples) {
+        // otpack->kkot_beta->recv(leaf_res_cmp, digits,
+        // num_cmps*(num_digits), 2);
+        otpack->kkot[beta - 1]->recv(leaf_res_cmp, digits,
+                                     num_cmps * (num_digits), 2);
+      } else {
+        // otpack->kkot_beta->recv(leaf_res_cmp, digits, num_cmps, 1);
+        otpack->kkot[beta - 1]->recv(leaf_res_cmp, digits, num_cmps, 1);
+        if (r == 1) {
+          otpack->kkot[beta - 1]->recv(leaf_res_cmp + num_cmps,
+                                       digits + num_cmps,
+                                       num_cmps * (num_digits - 2), 2);
+          otpack->iknp_straight->recv(
+              leaf_res_cmp + num_cmps * (num_digits - 1),
+              digits + num_cmps * (num_digits - 1), num_cmps, 2);
+        } else if (r != 0) {
+          otpack->kkot[beta - 1]->recv(leaf_res_cmp + num_cmps,
+                                       digits + num_cmps,
+                                       num_cmps * (num_digits - 2), 2);
+          otpack->kkot[r - 1]->recv(leaf_res_cmp + num_cmps * (num_digits - 1),
                                     digits + num_cmps * (num_digits - 1),
                                     num_cmps, 2);
-      } else if (r != 0) {
-        // otpack->kkot_beta->recv(leaf_res_cmp+num_cmps, digits+num_cmps,
-        // num_cmps*(num_digits-2), 2);
-        otpack->kkot[beta - 1]->recv(leaf_res_cmp + num_cmps, digits + num_cmps,
-                                     num_cmps * (num_digits - 2), 2);
-        otpack->kkot[r - 1]->recv(leaf_res_cmp + num_cmps * (num_digits - 1),
-                                  digits + num_cmps * (num_digits - 1),
-                                  num_cmps, 2);
-      } else {
-        // otpack->kkot_beta->recv(leaf_res_cmp+num_cmps, digits+num_cmps,
-        // num_cmps*(num_digits-1), 2);
-        otpack->kkot[beta - 1]->recv(leaf_res_cmp + num_cmps, digits + num_cmps,
-                                     num_cmps * (num_digits - 1), 2);
+        } else {
+          otpack->kkot[beta - 1]->recv(leaf_res_cmp + num_cmps,
+                                       digits + num_cmps,
+                                       num_cmps * (num_digits - 1), 2);
+        }
       }
-#endif
 
       // Extract equality result from leaf_res_cmp
       for (int i = num_cmps; i < num_digits * num_cmps; i++) {
@@ -279,6 +374,192 @@ public:
     delete[] leaf_res_eq;
   }
 
+  /*
+    compare for batches of any size: runs compare on windows of window
+    comparisons (rounded up to a multiple of 8) one after another, so the
+    memory use is bounded by the window and the count may exceed INT_MAX.
+  */
+  void compare_stream(uint8_t *res, uint64_t *data, uint64_t num_cmps,
+                      int bitlength, bool greater_than = true,
+                      int radix_base = MILL_PARAM,
+                      uint64_t window = MILL_STREAM_WINDOW) {
+    window = (std::max<uint64_t>(window, 1) + 7) / 8 * 8;
+    assert(window * 128 <= INT_MAX); // num_triples * window must fit an int
+    for (uint64_t start = 0; start < num_cmps; start += window) {
+      int len = (int)std::min(window, num_cmps - start);
+      compare(res + start, data + start, len, bitlength, greater_than, false,
+              radix_base);
+    }
+  }
+
+  /*
+    compare for num_groups groups of different bitlengths in one call: group
+    g compares the num_cmps[g] values of bitlengths[g] bits in data[g] and
+    writes its results to res[g]. The digits of all groups, each group's top
+    digit padded to radix_base bits, go through a single leaf OT call, and
+    the levels of all the digit trees are evaluated together, one exchange
+    per level. The rounds are those of a compare of the widest group alone,
+    however many groups there are. The ANDs use standard triples even with
+    corr_triples set, since a pair of correlated triples spans exactly one
+    group's num_cmps.
+  */
+  void compare_batch(uint8_t **res, uint64_t **data, const int *num_cmps,
+                     const int *bitlengths, int num_groups,
+                     bool greater_than = true, int radix_base = MILL_PARAM) {
+    int max_bitlength = 1;
+    for (int g = 0; g < num_groups; g++)
+      max_bitlength = std::max(max_bitlength, bitlengths[g]);
+    configure(max_bitlength, radix_base);
+
+    // Group g owns the digits [leaf_off[g], leaf_off[g] + nd[g] * nc[g]),
+    // stored digit-major from LSB to MSB like in compare.
+    std::vector<int> nd(num_groups), nc(num_groups), leaf_off(num_groups);
+    int num_leaves = 0, max_digits = 1;
+    for (int g = 0; g < num_groups; g++) {
+      assert(bitlengths[g] >= 1 && bitlengths[g] <= 64);
+      nd[g] = (bitlengths[g] + beta - 1) / beta;
+      nc[g] = (num_cmps[g] + 7) / 8 * 8;
+      leaf_off[g] = num_leaves;
+      num_leaves += nd[g] * nc[g];
+      max_digits = std::max(max_digits, nd[g]);
+    }
+    if (num_leaves == 0)
+      return;
+
+    uint8_t *digits = new uint8_t[num_leaves];
+    uint8_t *leaf_res_cmp = new uint8_t[num_leaves];
+    uint8_t *leaf_res_eq = new uint8_t[num_leaves];
+    for (int g = 0; g < num_groups; g++) {
+      uint64_t mask_l =
+          (bitlengths[g] == 64) ? -1 : (1ULL << bitlengths[g]) - 1;
+      for (int i = 0; i < nd[g]; i++)
+        for (int j = 0; j < nc[g]; j++)
+          digits[leaf_off[g] + i * nc[g] + j] =
+              (j < num_cmps[g])
+                  ? (uint8_t)((data[g][j] & mask_l) >> i * beta) & mask_beta
+                  : 0;
+    }
+
+    if (party == sci::ALICE) {
+      uint8_t *leaf_ot_messages = new uint8_t[(int64_t)num_leaves * beta_pow];
+      triple_gen->prg->random_bool((bool *)leaf_res_cmp, num_leaves);
+      triple_gen->prg->random_bool((bool *)leaf_res_eq, num_leaves);
+      set_leaf_ot_messages(leaf_ot_messages, beta_pow, digits, num_leaves,
+                           beta_pow, leaf_res_cmp, leaf_res_eq, greater_than);
+      otpack->kkot[beta - 1]->send(leaf_ot_messages, beta_pow, num_leaves, 2);
+      delete[] leaf_ot_messages;
+    } else { // party == sci::BOB
+      otpack->kkot[beta - 1]->recv(leaf_res_cmp, digits, num_leaves, 2);
+      for (int i = 0; i < num_leaves; i++) {
+        leaf_res_eq[i] = leaf_res_cmp[i] & 1;
+        leaf_res_cmp[i] >>= 1;
+      }
+    }
+
+    // Every node of every tree: cmp_j AND eq_j+i, and eq_j AND eq_j+i
+    // unless j is the leftmost node of its level.
+    int num_ANDs = 0;
+    for (int i = 1; i < max_digits; i *= 2)
+      for (int g = 0; g < num_groups; g++)
+        for (int j = 0; j + i < nd[g]; j += 2 * i)
+          num_ANDs += (j == 0 ? 1 : 2) * nc[g];
+
+    Triple triples_std(num_ANDs, true);
+    if (num_ANDs > 0) {
+      if (triple_bank != nullptr)
+        triple_bank->lease(&triples_std);
+      else
+        triple_gen->generate(party, &triples_std, std_method);
+    }
+    uint8_t *ei = new uint8_t[num_ANDs / 8];
+    uint8_t *fi = new uint8_t[num_ANDs / 8];
+    uint8_t *e = new uint8_t[num_ANDs / 8];
+    uint8_t *f = new uint8_t[num_ANDs / 8];
+
+    int counter = 0; // ANDs done by the previous levels
+    for (int i = 1; i < max_digits; i *= 2) {
+      int idx = counter;
+      for (int g = 0; g < num_groups; g++) {
+        uint8_t *cmp = leaf_res_cmp + leaf_off[g];
+        uint8_t *eq = leaf_res_eq + leaf_off[g];
+        for (int j = 0; j + i < nd[g]; j += 2 * i) {
+          AND_step_1(ei + idx / 8, fi + idx / 8, eq + (j + i) * nc[g],
+                     cmp + j * nc[g], triples_std.ai + idx / 8,
+                     triples_std.bi + idx / 8, nc[g]);
+          idx += nc[g];
+          if (j > 0) {
+            AND_step_1(ei + idx / 8, fi + idx / 8, eq + (j + i) * nc[g],
+                       eq + j * nc[g], triples_std.ai + idx / 8,
+                       triples_std.bi + idx / 8, nc[g]);
+            idx += nc[g];
+          }
+        }
+      }
+      int offset = counter / 8;
+      int size_used = (idx - counter) / 8;
+
+#pragma omp parallel num_threads(2)
+      {
+        if (omp_get_thread_num() == 1) {
+          if (party == sci::ALICE) {
+            iopack->io_rev->recv_data(e + offset, size_used);
+            iopack->io_rev->recv_data(f + offset, size_used);
+          } else { // party == sci::BOB
+            iopack->io_rev->send_data(ei + offset, size_used);
+            iopack->io_rev->send_data(fi + offset, size_used);
+          }
+        } else {
+          if (party == sci::ALICE) {
+            iopack->io->send_data(ei + offset, size_used);
+            iopack->io->send_data(fi + offset, size_used);
+          } else { // party == sci::BOB
+            iopack->io->recv_data(e + offset, size_used);
+            iopack->io->recv_data(f + offset, size_used);
+          }
+        }
+      }
+      for (int k = 0; k < size_used; k++) {
+        e[k + offset] ^= ei[k + offset];
+        f[k + offset] ^= fi[k + offset];
+      }
+
+      idx = counter;
+      for (int g = 0; g < num_groups; g++) {
+        uint8_t *cmp = leaf_res_cmp + leaf_off[g];
+        uint8_t *eq = leaf_res_eq + leaf_off[g];
+        for (int j = 0; j + i < nd[g]; j += 2 * i) {
+          AND_step_2(cmp + j * nc[g], e + idx / 8, f + idx / 8, nullptr,
+                     nullptr, triples_std.ai + idx / 8,
+                     triples_std.bi + idx / 8, triples_std.ci + idx / 8,
+                     nc[g]);
+          idx += nc[g];
+          if (j > 0) {
+            AND_step_2(eq + j * nc[g], e + idx / 8, f + idx / 8, nullptr,
+                       nullptr, triples_std.ai + idx / 8,
+                       triples_std.bi + idx / 8, triples_std.ci + idx / 8,
+                       nc[g]);
+            idx += nc[g];
+          }
+          for (int k = 0; k < nc[g]; k++)
+            cmp[j * nc[g] + k] ^= cmp[(j + i) * nc[g] + k];
+        }
+      }
+      counter = idx;
+    }
+    assert(counter == num_ANDs);
+
+    for (int g = 0; g < num_groups; g++)
+      memcpy(res[g], leaf_res_cmp + leaf_off[g], num_cmps[g]);
+
+    delete[] ei;
+    delete[] fi;
+    delete[] e;
+    delete[] f;
+    delete[] digits;
+    delete[] leaf_res_cmp;
+    delete[] leaf_res_eq;
+  }
+
   void set_leaf_ot_messages(uint8_t *ot_messages, uint8_t digit, int N,
                             uint8_t mask_cmp, uint8_t mask_eq,
                             bool greater_than, bool eq = true) {
@@ -294,26 +575,34 @@ public:
     }
   }
 
+  // set_leaf_ot_messages for num comparisons at once, row k at
+  // ot_messages + k * stride (see fill_leaf_ot_messages).
+  void set_leaf_ot_messages(uint8_t *ot_messages, int stride,
+                            const uint8_t *digits, int num, int N,
+                            const uint8_t *mask_cmp, const uint8_t *mask_eq,
+                            bool greater_than, bool eq = true) {
+    fill_leaf_ot_messages(ot_messages, stride, digits, num, N, mask_cmp,
+                          eq ? mask_eq : nullptr, greater_than);
+  }
+
   /**************************************************************************************************
    *                         AND computation related functions
    **************************************************************************************************/
 
   void traverse_and_compute_ANDs(int num_cmps, uint8_t *leaf_res_eq,
                                  uint8_t *leaf_res_cmp) {
-#ifdef WAN_EXEC
-    Triple triples_std((num_triples)*num_cmps, true);
-#else
-    Triple triples_corr(num_triples_corr * num_cmps, true, num_cmps);
-    Triple triples_std(num_triples_std * num_cmps, true);
-#endif
+    Triple *triples_corr = nullptr;
+    if (corr_triples)
+      triples_corr = new Triple(num_triples_corr * num_cmps, true, num_cmps);
+    Triple triples_std(
+        (corr_triples ? num_triples_std : num_triples) * num_cmps, true);
     // Generate required Bit-Triples
-#ifdef WAN_EXEC
-    // std::cout<<"Running on WAN_EXEC; Skipping correlated triples"<<std::endl;
-    triple_gen->generate(party, &triples_std, _16KKOT_to_4OT);
-#else
-    triple_gen->generate(party, &triples_corr, _8KKOT);
-    triple_gen->generate(party, &triples_std, _16KKOT_to_4OT);
-#endif
+    if (corr_triples)
+      triple_gen->generate(party, triples_corr, _8KKOT);
+    if (triple_bank != nullptr)
+      triple_bank->lease(&triples_std);
+    else
+      triple_gen->generate(party, &triples_std, std_method);
     // std::cout << "Bit Triples Generated" << std::endl;
 
     // Combine leaf OT results in a bottom-up fashion
@@ -325,60 +614,58 @@ public:
     uint8_t *e = new uint8_t[(num_triples * num_cmps) / 8];
     uint8_t *f = new uint8_t[(num_triples * num_cmps) / 8];
 
+    // Triple used by an AND: the leftmost node of a level takes the next
+    // standard triple and the others a pair of correlated triples, or, with
+    // corr_triples off, every AND takes the next standard triple. A
+    // correlated pair opens one e (see below), independent triples one per
+    // AND.
+    const int e_per_pair = corr_triples ? 1 : 2;
+    Triple *tr_left, *tr_pair;
+    int idx_left, idx_pair;
+    auto pick_triples = [&](bool left) {
+      if (!corr_triples) {
+        tr_left = tr_pair = &triples_std;
+        idx_left = idx_pair = counter_combined;
+        counter_combined += left ? 1 : 2;
+      } else if (left) {
+        tr_left = &triples_std;
+        idx_left = counter_std;
+      } else {
+        tr_pair = triples_corr;
+        idx_pair = 2 * counter_corr;
+      }
+    };
+
     for (int i = 1; i < num_digits; i *= 2) {
       for (int j = 0; j < num_digits and j + i < num_digits; j += 2 * i) {
         if (j == 0) {
-#ifdef WAN_EXEC
-          AND_step_1(
-              ei + (counter_std * num_cmps) / 8,
-              fi + (counter_std * num_cmps) / 8, leaf_res_cmp + j * num_cmps,
-              leaf_res_eq + (j + i) * num_cmps,
-              (triples_std.ai) + (counter_combined * num_cmps) / 8,
-              (triples_std.bi) + (counter_combined * num_cmps) / 8, num_cmps);
-          counter_std++;
-          counter_combined++;
-#else
+          pick_triples(true);
           AND_step_1(ei + (counter_std * num_cmps) / 8,
                      fi + (counter_std * num_cmps) / 8,
                      leaf_res_cmp + j * num_cmps,
                      leaf_res_eq + (j + i) * num_cmps,
-                     (triples_std.ai) + (counter_std * num_cmps) / 8,
-                     (triples_std.bi) + (counter_std * num_cmps) / 8, num_cmps);
+                     (tr_left->ai) + (idx_left * num_cmps) / 8,
+                     (tr_left->bi) + (idx_left * num_cmps) / 8, num_cmps);
           counter_std++;
-#endif
         } else {
-#ifdef WAN_EXEC
+          // eq_j+i is the first operand of both ANDs: a correlated pair
+          // shares its a, which must mask the same value in both, so both
+          // write the same e and it is opened once.
+          pick_triples(false);
           AND_step_1(
-              ei + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
+              ei + ((num_triples_std + e_per_pair * counter_corr) * num_cmps) / 8,
               fi + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
-              leaf_res_cmp + j * num_cmps, leaf_res_eq + (j + i) * num_cmps,
-              (triples_std.ai) + (counter_combined * num_cmps) / 8,
-              (triples_std.bi) + (counter_combined * num_cmps) / 8, num_cmps);
-          counter_combined++;
+              leaf_res_eq + (j + i) * num_cmps, leaf_res_cmp + j * num_cmps,
+              (tr_pair->ai) + (idx_pair * num_cmps) / 8,
+              (tr_pair->bi) + (idx_pair * num_cmps) / 8, num_cmps);
           AND_step_1(
-              ei + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
+              ei + ((num_triples_std + e_per_pair * (counter_corr + 1) - 1) *
+                    num_cmps) / 8,
               fi + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
-              leaf_res_eq + j * num_cmps, leaf_res_eq + (j + i) * num_cmps,
-              (triples_std.ai) + (counter_combined * num_cmps) / 8,
-              (triples_std.bi) + (counter_combined * num_cmps) / 8, num_cmps);
-          counter_combined++;
+              leaf_res_eq + (j + i) * num_cmps, leaf_res_eq + j * num_cmps,
+              (tr_pair->ai) + ((idx_pair + 1) * num_cmps) / 8,
+              (tr_pair->bi) + ((idx_pair + 1) * num_cmps) / 8, num_cmps);
           counter_corr++;
-#else
-          AND_step_1(
-              ei + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
-              fi + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
-              leaf_res_cmp + j * num_cmps, leaf_res_eq + (j + i) * num_cmps,
-              (triples_corr.ai) + (2 * counter_corr * num_cmps) / 8,
-              (triples_corr.bi) + (2 * counter_corr * num_cmps) / 8, num_cmps);
-          AND_step_1(
-              ei + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
-              fi + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
-              leaf_res_eq + j * num_cmps, leaf_res_eq + (j + i) * num_cmps,
-              (triples_corr.ai) + ((2 * counter_corr + 1) * num_cmps) / 8,
-              (triples_corr.bi) + ((2 * counter_corr + 1) * num_cmps) / 8,
-              num_cmps);
-          counter_corr++;
-#endif
         }
       }
       int offset_std = (old_counter_std * num_cmps) / 8;
@@ -386,30 +673,34 @@ public:
       int offset_corr =
           ((num_triples_std + 2 * old_counter_corr) * num_cmps) / 8;
       int size_corr = (2 * (counter_corr - old_counter_corr) * num_cmps) / 8;
+      int offset_corr_e =
+          ((num_triples_std + e_per_pair * old_counter_corr) * num_cmps) / 8;
+      int size_corr_e =
+          (e_per_pair * (counter_corr - old_counter_corr) * num_cmps) / 8;
 
 #pragma omp parallel num_threads(2)
       {
         if (omp_get_thread_num() == 1) {
           if (party == sci::ALICE) {
             iopack->io_rev->recv_data(e + offset_std, size_std);
-            iopack->io_rev->recv_data(e + offset_corr, size_corr);
+            iopack->io_rev->recv_data(e + offset_corr_e, size_corr_e);
             iopack->io_rev->recv_data(f + offset_std, size_std);
             iopack->io_rev->recv_data(f + offset_corr, size_corr);
           } else { // party == sci::BOB
             iopack->io_rev->send_data(ei + offset_std, size_std);
-            iopack->io_rev->send_data(ei + offset_corr, size_corr);
+            iopack->io_rev->send_data(ei + offset_corr_e, size_corr_e);
             iopack->io_rev->send_data(fi + offset_std, size_std);
             iopack->io_rev->send_data(fi + offset_corr, size_corr);
           }
         } else {
           if (party == sci::ALICE) {
             iopack->io->send_data(ei + offset_std, size_std);
-            iopack->io->send_data(ei + offset_corr, size_corr);
+            iopack->io->send_data(ei + offset_corr_e, size_corr_e);
             iopack->io->send_data(fi + offset_std, size_std);
             iopack->io->send_data(fi + offset_corr, size_corr);
           } else { // party == sci::BOB
             iopack->io->recv_data(e + offset_std, size_std);
-            iopack->io->recv_data(e + offset_corr, size_corr);
+            iopack->io->recv_data(e + offset_corr_e, size_corr_e);
             iopack->io->recv_data(f + offset_std, size_std);
             iopack->io->recv_data(f + offset_corr, size_corr);
           }
@@ -419,85 +710,52 @@ public:
         e[i + offset_std] ^= ei[i + offset_std];
         f[i + offset_std] ^= fi[i + offset_std];
       }
-      for (int i = 0; i < size_corr; i++) {
-        e[i + offset_corr] ^= ei[i + offset_corr];
+      for (int i = 0; i < size_corr_e; i++)
+        e[i + offset_corr_e] ^= ei[i + offset_corr_e];
+      for (int i = 0; i < size_corr; i++)
         f[i + offset_corr] ^= fi[i + offset_corr];
-      }
 
       counter_std = old_counter_std;
       counter_corr = old_counter_corr;
-#ifdef WAN_EXEC
       counter_combined = old_counter_combined;
-#endif
       for (int j = 0; j < num_digits and j + i < num_digits; j += 2 * i) {
         if (j == 0) {
-#ifdef WAN_EXEC
-          AND_step_2(
-              leaf_res_cmp + j * num_cmps, e + (counter_std * num_cmps) / 8,
-              f + (counter_std * num_cmps) / 8,
-              ei + (counter_std * num_cmps) / 8,
-              fi + (counter_std * num_cmps) / 8,
-              (triples_std.ai) + (counter_combined * num_cmps) / 8,
-              (triples_std.bi) + (counter_combined * num_cmps) / 8,
-              (triples_std.ci) + (counter_combined * num_cmps) / 8, num_cmps);
-          counter_combined++;
-#else
+          pick_triples(true);
           AND_step_2(leaf_res_cmp + j * num_cmps,
                      e + (counter_std * num_cmps) / 8,
                      f + (counter_std * num_cmps) / 8,
                      ei + (counter_std * num_cmps) / 8,
                      fi + (counter_std * num_cmps) / 8,
-                     (triples_std.ai) + (counter_std * num_cmps) / 8,
-                     (triples_std.bi) + (counter_std * num_cmps) / 8,
-                     (triples_std.ci) + (counter_std * num_cmps) / 8, num_cmps);
-#endif
+                     (tr_left->ai) + (idx_left * num_cmps) / 8,
+                     (tr_left->bi) + (idx_left * num_cmps) / 8,
+                     (tr_left->ci) + (idx_left * num_cmps) / 8, num_cmps);
           for (int k = 0; k < num_cmps; k++)
             leaf_res_cmp[j * num_cmps + k] ^=
                 leaf_res_cmp[(j + i) * num_cmps + k];
           counter_std++;
         } else {
-#ifdef WAN_EXEC
+          pick_triples(false);
           AND_step_2(leaf_res_cmp + j * num_cmps,
-                     e + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
+                     e + ((num_triples_std + e_per_pair * counter_corr) *
+                          num_cmps) / 8,
                      f + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
-                     ei + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
+                     ei + ((num_triples_std + e_per_pair * counter_corr) *
+                           num_cmps) / 8,
                      fi + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
-                     (triples_std.ai) + (counter_combined * num_cmps) / 8,
-                     (triples_std.bi) + (counter_combined * num_cmps) / 8,
-                     (triples_std.ci) + (counter_combined * num_cmps) / 8,
-                     num_cmps);
-          counter_combined++;
+                     (tr_pair->ai) + (idx_pair * num_cmps) / 8,
+                     (tr_pair->bi) + (idx_pair * num_cmps) / 8,
+                     (tr_pair->ci) + (idx_pair * num_cmps) / 8, num_cmps);
           AND_step_2(
               leaf_res_eq + j * num_cmps,
-              e + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
+              e + ((num_triples_std + e_per_pair * (counter_corr + 1) - 1) *
+                   num_cmps) / 8,
               f + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
-              ei + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
+              ei + ((num_triples_std + e_per_pair * (counter_corr + 1) - 1) *
+                    num_cmps) / 8,
               fi + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
-              (triples_std.ai) + (counter_combined * num_cmps) / 8,
-              (triples_std.bi) + (counter_combined * num_cmps) / 8,
-              (triples_std.ci) + (counter_combined * num_cmps) / 8, num_cmps);
-          counter_combined++;
-#else
-          AND_step_2(leaf_res_cmp + j * num_cmps,
-                     e + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
-                     f + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
-                     ei + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
-                     fi + ((num_triples_std + 2 * counter_corr) * num_cmps) / 8,
-                     (triples_corr.ai) + (2 * counter_corr * num_cmps) / 8,
-                     (triples_corr.bi) + (2 * counter_corr * num_cmps) / 8,
-                     (triples_corr.ci) + (2 * counter_corr * num_cmps) / 8,
-                     num_cmps);
-          AND_step_2(
-              leaf_res_eq + j * num_cmps,
-              e + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
-              f + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
-              ei + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
-              fi + ((num_triples_std + (2 * counter_corr + 1)) * num_cmps) / 8,
-              (triples_corr.ai) + ((2 * counter_corr + 1) * num_cmps) / 8,
-              (triples_corr.bi) + ((2 * counter_corr + 1) * num_cmps) / 8,
-              (triples_corr.ci) + ((2 * counter_corr + 1) * num_cmps) / 8,
-              num_cmps);
-#endif
+              (tr_pair->ai) + ((idx_pair + 1) * num_cmps) / 8,
+              (tr_pair->bi) + ((idx_pair + 1) * num_cmps) / 8,
+              (tr_pair->ci) + ((idx_pair + 1) * num_cmps) / 8, num_cmps);
           for (int k = 0; k < num_cmps; k++)
             leaf_res_cmp[j * num_cmps + k] ^=
                 leaf_res_cmp[(j + i) * num_cmps + k];
@@ -506,19 +764,18 @@ public:
       }
       old_counter_std = counter_std;
       old_counter_corr = counter_corr;
-#ifdef WAN_EXEC
       old_counter_combined = counter_combined;
-#endif
     }
 
-#ifdef WAN_EXEC
-    assert(counter_combined == num_triples);
-#else
-    assert(counter_std == num_triples_std);
-    assert(2 * counter_corr == num_triples_corr);
-#endif
+    if (!corr_triples) {
+      assert(counter_combined == num_triples);
+    } else {
+      assert(counter_std == num_triples_std);
+      assert(2 * counter_corr == num_triples_corr);
+    }
 
     // cleanup
+    delete triples_corr;
     delete[] ei;
     delete[] fi;
     delete[] e;
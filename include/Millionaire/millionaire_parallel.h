@@ -0,0 +1,122 @@
+/*
+Multi-threaded MillionaireProtocol::compare.
+
+Worker 0 runs on the caller's IOPack and OTPack. Every other worker t gets
+its own IOPack at port + t * MILL_WORKER_PORT_STRIDE and an OTPack derived
+from the caller's with OTPack::DeriveFrom(otpack, t), so no base OTs are run
+and no two workers share a channel or a PRG stream. compare splits the
+comparisons into one contiguous shard per worker (multiples of 8, the same
+split on both parties) and every worker writes its results in place, so the
+output is in input order.
+*/
+
+#ifndef MILLIONAIRE_PARALLEL_H__
+#define MILLIONAIRE_PARALLEL_H__
+#include "Millionaire/millionaire.h"
+#include <string>
+#include <vector>
+
+// Room for the io, io_rev and io_GC ports of each worker's IOPack.
+#define MILL_WORKER_PORT_STRIDE 150
+
+class ParallelMillionaire {
+public:
+  int party, num_threads;
+  std::vector<sci::IOPack *> iopacks;
+  std::vector<sci::OTPack *> otpacks;
+  std::vector<MillionaireProtocol *> mills;
+
+  ParallelMillionaire(int party, sci::IOPack *iopack, sci::OTPack *otpack,
+                      int num_threads, int port,
+                      std::string address = "127.0.0.1", int bitlength = 32,
+                      int radix_base = MILL_PARAM) {
+    assert(num_threads >= 1);
+    this->party = party;
+    this->num_threads = num_threads;
+    iopacks.push_back(iopack);
+    otpacks.push_back(otpack);
+    for (int t = 1; t < num_threads; t++) {
+      sci::IOPack *iop = new sci::IOPack(
+          party, port + t * MILL_WORKER_PORT_STRIDE, address);
+      sci::OTPack *otp = new sci::OTPack(iop, party, false);
+      otp->DeriveFrom(otpack, t);
+      iopacks.push_back(iop);
+      otpacks.push_back(otp);
+    }
+    for (int t = 0; t < num_threads; t++)
+      mills.push_back(new MillionaireProtocol(party, iopacks[t], otpacks[t],
+                                              bitlength, radix_base));
+  }
+
+  ~ParallelMillionaire() {
+    for (int t = 0; t < num_threads; t++) {
+      delete mills[t];
+      if (t > 0) {
+        delete otpacks[t];
+        delete iopacks[t];
+      }
+    }
+  }
+
+  void set_params(const MillParams &params) {
+    for (MillionaireProtocol *mill : mills)
+      mill->set_params(params);
+  }
+
+  // Same as MillionaireProtocol::compare, with the comparisons spread over
+  // the workers.
+  void compare(uint8_t *res, uint64_t *data, int num_cmps, int bitlength,
+               bool greater_than = true, bool equality = false,
+               int radix_base = MILL_PARAM) {
+    if (num_cmps <= 0)
+      return;
+    int per_worker = (num_cmps + num_threads - 1) / num_threads;
+    per_worker = (per_worker + 7) / 8 * 8;
+    int nt = (num_cmps + per_worker - 1) / per_worker;
+    sci::ot_parallel_for(nt, nt, [&](int t) {
+      int start = t * per_worker;
+      int len = std::min(per_worker, num_cmps - start);
+      mills[t]->compare(res + start, data + start, len, bitlength,
+                        greater_than, equality, radix_base);
+      iopacks[t]->io->flush();
+      iopacks[t]->io_rev->flush();
+    });
+  }
+
+  /*
+    Streams num_cmps comparisons (any 64-bit count) in windows of window
+    comparisons dealt round-robin to the workers, each of which runs its
+    windows one after another. Memory is bounded by num_threads windows,
+    and with two or more workers the leaf OTs of one window overlap the
+    AND rounds of the previous one, which run on another channel.
+  */
+  void compare_stream(uint8_t *res, uint64_t *data, uint64_t num_cmps,
+                      int bitlength, bool greater_than = true,
+                      int radix_base = MILL_PARAM,
+                      uint64_t window = MILL_STREAM_WINDOW) {
+    if (num_cmps == 0)
+      return;
+    window = (std::max<uint64_t>(window, 1) + 7) / 8 * 8;
+    uint64_t num_windows = (num_cmps + window - 1) / window;
+    int nt = (int)std::min<uint64_t>(num_threads, num_windows);
+    sci::ot_parallel_for(nt, nt, [&](int t) {
+      for (uint64_t w = t; w < num_windows; w += nt) {
+        uint64_t start = w * window;
+        mills[t]->compare_stream(res + start, data + start,
+                                 std::min(window, num_cmps - start), bitlength,
+                                 greater_than, radix_base, window);
+      }
+      iopacks[t]->io->flush();
+      iopacks[t]->io_rev->flush();
+    });
+  }
+
+  uint64_t get_comm() {
+    uint64_t comm = 0;
+    for (sci::IOPack *iop : iopacks)
+      comm += iop->get_comm();
+    return comm;
+  }
+};
+
+#endif // MILLIONAIRE_PARALLEL_H__
@@ -72,29 +72,28 @@ public:
   void bitlen_lt_beta(uint8_t *res_cmp, uint8_t *res_eq, uint64_t *data,
                       int num_cmps, int bitlength, bool greater_than = true,
                       int radix_base = MILL_PARAM) {
-    uint8_t N = 1 << bitlength;
+    int N = 1 << bitlength;
     uint8_t mask = N - 1;
     if (party == sci::ALICE) {
       sci::PRG128 prg;
       prg.random_data(res_cmp, num_cmps * sizeof(uint8_t));
       prg.random_data(res_eq, num_cmps * sizeof(uint8_t));
-      uint8_t **leaf_messages = new uint8_t *[num_cmps];
+      uint8_t *leaf_messages = new uint8_t[(int64_t)num_cmps * N];
+      uint8_t *digit = new uint8_t[num_cmps];
       for (int i = 0; i < num_cmps; i++) {
         res_cmp[i] &= 1;
         res_eq[i] &= 1;
-        leaf_messages[i] = new uint8_t[N];
-        this->mill->set_leaf_ot_messages(leaf_messages[i], (data[i] & mask), N,
-                                         res_cmp[i], res_eq[i], greater_than,
-                                         true);
+        digit[i] = data[i] & mask;
       }
+      this->mill->set_leaf_ot_messages(leaf_messages, N, digit, num_cmps, N,
+                                       res_cmp, res_eq, greater_than, true);
       if (bitlength > 1) {
-        otpack->kkot[bitlength - 1]->send(leaf_messages, num_cmps, 2);
+        otpack->kkot[bitlength - 1]->send(leaf_messages, N, num_cmps, 2);
       } else {
-        otpack->iknp_straight->send(leaf_messages, num_cmps, 2);
+        otpack->iknp_straight->send(leaf_messages, N, num_cmps, 2);
       }
 
-      for (int i = 0; i < num_cmps; i++)
-        delete[] leaf_messages[i];
+      delete[] digit;
       delete[] leaf_messages;
     } else { // party == BOB
       uint8_t *choice = new uint8_t[num_cmps];
@@ -115,6 +114,22 @@ public:
     return;
   }
 
+  // compare_with_eq on windows of window comparisons (see
+  // MillionaireProtocol::compare_stream).
+  void compare_with_eq_stream(uint8_t *res_cmp, uint8_t *res_eq,
+                              uint64_t *data, uint64_t num_cmps, int bitlength,
+                              bool greater_than = true,
+                              int radix_base = MILL_PARAM,
+                              uint64_t window = MILL_STREAM_WINDOW) {
+    window = (std::max<uint64_t>(window, 1) + 7) / 8 * 8;
+    assert(window * 128 <= INT_MAX); // num_triples * window must fit an int
+    for (uint64_t start = 0; start < num_cmps; start += window) {
+      int len = (int)std::min(window, num_cmps - start);
+      compare_with_eq(res_cmp + start, res_eq + start, data + start, len,
+                      bitlength, greater_than, radix_base);
+    }
+  }
+
   void compare_with_eq(uint8_t *res_cmp, uint8_t *res_eq, uint64_t *data,
                        int num_cmps, int bitlength, bool greater_than = true,
                        int radix_base = MILL_PARAM) {
@@ -162,55 +177,50 @@ public:
 
     // Set leaf OT messages now
     if (party == sci::ALICE) {
-      uint8_t *
-          *leaf_ot_messages; // (num_digits * num_cmps) X beta_pow (=2^beta)
-      leaf_ot_messages = new uint8_t *[num_digits * num_cmps];
-      for (int i = 0; i < num_digits * num_cmps; i++)
-        leaf_ot_messages[i] = new uint8_t[beta_pow];
+      // (num_digits * num_cmps) X beta_pow (=2^beta), row-major
+      uint8_t *leaf_ot_messages =
+          new uint8_t[(int64_t)num_digits * num_cmps * beta_pow];
+      const int64_t last = (int64_t)num_cmps * (num_digits - 1);
 
       // Set Leaf OT messages
       triple_gen->prg->random_bool((bool *)leaf_res_cmp, num_digits * num_cmps);
       triple_gen->prg->random_bool((bool *)leaf_res_eq, num_digits * num_cmps);
-      for (int i = 0; i < num_digits; i++) {
-        for (int j = 0; j < num_cmps; j++) {
-          if (i == (num_digits - 1) && (r > 0)) {
-            this->mill->set_leaf_ot_messages(
-                leaf_ot_messages[i * num_cmps + j], digits[i * num_cmps + j],
-                1ULL << r, leaf_res_cmp[i * num_cmps + j],
-                leaf_res_eq[i * num_cmps + j], greater_than);
-          } else {
-            this->mill->set_leaf_ot_messages(
-                leaf_ot_messages[i * num_cmps + j], digits[i * num_cmps + j],
-                beta_pow, leaf_res_cmp[i * num_cmps + j],
-                leaf_res_eq[i * num_cmps + j], greater_than);
-          }
-        }
+      if (r > 0) {
+        this->mill->set_leaf_ot_messages(leaf_ot_messages, beta_pow, digits,
+                                         last, beta_pow, leaf_res_cmp,
+                                         leaf_res_eq, greater_than);
+        this->mill->set_leaf_ot_messages(
+            leaf_ot_messages + last * beta_pow, beta_pow, digits + last,
+            num_cmps, 1 << r, leaf_res_cmp + last, leaf_res_eq + last,
+            greater_than);
+      } else {
+        this->mill->set_leaf_ot_messages(
+            leaf_ot_messages, beta_pow, digits, num_digits * num_cmps,
+            beta_pow, leaf_res_cmp, leaf_res_eq, greater_than);
       }
 
       // Perform Leaf OTs with comparison and equality
       if (r == 1) {
         // All branches except r
-        otpack->kkot[beta - 1]->send(leaf_ot_messages,
+        otpack->kkot[beta - 1]->send(leaf_ot_messages, beta_pow,
                                      num_cmps * (num_digits - 1), 2);
         // r branch
-        otpack->iknp_straight->send(
-            leaf_ot_messages + num_cmps * (num_digits - 1), num_cmps, 2);
+        otpack->iknp_straight->send(leaf_ot_messages + last * beta_pow,
+                                    beta_pow, num_cmps, 2);
       } else if (r != 0) {
         // All branches except r
-        otpack->kkot[beta - 1]->send(leaf_ot_messages,
+        otpack->kkot[beta - 1]->send(leaf_ot_messages, beta_pow,
                                      num_cmps * (num_digits - 1), 2);
         // r branch
-        otpack->kkot[r - 1]->send(
-            leaf_ot_messages + num_cmps * (num_digits - 1), num_cmps, 2);
+        otpack->kkot[r - 1]->send(leaf_ot_messages + last * beta_pow, beta_pow,
+                                  num_cmps, 2);
       } else {
         // All branches including r, r is 0
-        otpack->kkot[beta - 1]->send(leaf_ot_messages, num_cmps * (num_digits),
-                                     2);
+        otpack->kkot[beta - 1]->send(leaf_ot_messages, beta_pow,
+                                     num_cmps * (num_digits), 2);
       }
 
       // Cleanup
-      for (int i = 0; i < num_digits * num_cmps; i++)
-        delete[] leaf_ot_messages[i];
       delete[] leaf_ot_messages;
     } else // party = sci::BOB
     {
@@ -259,10 +269,37 @@ public:
     delete[] leaf_res_eq;
   }
 
+  /*
+    Shares of x < y, x == y and x <= y for ALICE's x and BOB's y, from one
+    compare_with_eq pass: a single set of leaf OTs carrying both bits and a
+    single AND tree. x <= y is the XOR of the two disjoint events and costs
+    no communication. Any of the outputs may be nullptr.
+  */
+  void compare_lt_eq_le(uint8_t *res_lt, uint8_t *res_eq, uint8_t *res_le,
+                        uint64_t *data, int num_cmps, int bitlength,
+                        int radix_base = MILL_PARAM) {
+    uint8_t *lt = (res_lt != nullptr) ? res_lt : new uint8_t[num_cmps];
+    uint8_t *eq = (res_eq != nullptr) ? res_eq : new uint8_t[num_cmps];
+    compare_with_eq(lt, eq, data, num_cmps, bitlength, false, radix_base);
+    if (res_le != nullptr)
+      for (int i = 0; i < num_cmps; i++)
+        res_le[i] = lt[i] ^ eq[i];
+    if (res_lt == nullptr)
+      delete[] lt;
+    if (res_eq == nullptr)
+      delete[] eq;
+  }
+
   /**************************************************************************************************
    *                         AND computation related functions
    **************************************************************************************************/
 
+  /*
+    Both ANDs of a node, cmp_j & eq_j+i and eq_j & eq_j+i, take eq_j+i as
+    their first operand, which the pair of correlated triples masks with the
+    same a. Their e = a + eq_j+i is therefore opened once per pair, and only
+    the two f = b + cmp_j and f' = b' + eq_j are opened separately.
+  */
   void traverse_and_compute_ANDs(int num_cmps, uint8_t *leaf_res_eq,
                                  uint8_t *leaf_res_cmp) {
     Triple triples_corr((num_triples)*num_cmps, true, num_cmps);
@@ -272,9 +309,9 @@ public:
 
     // Combine leaf OT results in a bottom-up fashion
     int counter_triples_used = 0, old_counter_triples_used = 0;
-    uint8_t *ei = new uint8_t[(num_triples * num_cmps) / 8];
+    uint8_t *ei = new uint8_t[(num_triples * num_cmps) / 16];
     uint8_t *fi = new uint8_t[(num_triples * num_cmps) / 8];
-    uint8_t *e = new uint8_t[(num_triples * num_cmps) / 8];
+    uint8_t *e = new uint8_t[(num_triples * num_cmps) / 16];
     uint8_t *f = new uint8_t[(num_triples * num_cmps) / 8];
 
     for (int i = 1; i < num_digits;
@@ -283,63 +320,56 @@ public:
       for (int j = 0; j < num_digits and j + i < num_digits;
            j += 2 * i) { // j=0 is LSD and j=num_digits-1 is MSD
 
-        // CMP_j: Use 1 triple for opening e = a + cmp_j and f = b + eq_j+i.
+        // CMP_j: Use 1 triple for opening e = a + eq_j+i and f = b + cmp_j.
         this->mill->AND_step_1(
-            ei + (2 * counter_triples_used * num_cmps) / 8,
+            ei + (counter_triples_used * num_cmps) / 8,
             fi + (2 * counter_triples_used * num_cmps) / 8,
-            leaf_res_cmp + j * num_cmps, leaf_res_eq + (j + i) * num_cmps,
+            leaf_res_eq + (j + i) * num_cmps, leaf_res_cmp + j * num_cmps,
             (triples_corr.ai) + (2 * counter_triples_used * num_cmps) / 8,
             (triples_corr.bi) + (2 * counter_triples_used * num_cmps) / 8,
             num_cmps);
-        // EQ_j: Use 1 triple for opening e = a + eq_j and f = b + eq_j+i.
+        // EQ_j: Use 1 triple for opening f = b + eq_j; rewrites the same e.
         this->mill->AND_step_1(
-            ei + ((2 * counter_triples_used + 1) * num_cmps) / 8,
+            ei + (counter_triples_used * num_cmps) / 8,
             fi + ((2 * counter_triples_used + 1) * num_cmps) / 8,
-            leaf_res_eq + j * num_cmps, leaf_res_eq + (j + i) * num_cmps,
+            leaf_res_eq + (j + i) * num_cmps, leaf_res_eq + j * num_cmps,
             (triples_corr.ai) + ((2 * counter_triples_used + 1) * num_cmps) / 8,
             (triples_corr.bi) + ((2 * counter_triples_used + 1) * num_cmps) / 8,
             num_cmps);
         counter_triples_used++;
       }
-      int offset = (2 * old_counter_triples_used * num_cmps) / 8;
-      int size_used =
-          (2 * (counter_triples_used - old_counter_triples_used) * num_cmps) /
-          8;
+      int offset_e = (old_counter_triples_used * num_cmps) / 8;
+      int size_e =
+          ((counter_triples_used - old_counter_triples_used) * num_cmps) / 8;
+      int offset_f = 2 * offset_e;
+      int size_f = 2 * size_e;
 
 #pragma omp parallel num_threads(2)
       {
         if (omp_get_thread_num() == 1) {
           if (party == sci::ALICE) {
-            iopack->io_rev->recv_data(e + offset, size_used);
-            iopack->io_rev->recv_data(e + offset, size_used);
-            iopack->io_rev->recv_data(f + offset, size_used);
-            iopack->io_rev->recv_data(f + offset, size_used);
+            iopack->io_rev->recv_data(e + offset_e, size_e);
+            iopack->io_rev->recv_data(f + offset_f, size_f);
           } else { // party == sci::BOB
-            iopack->io_rev->send_data(ei + offset, size_used);
-            iopack->io_rev->send_data(ei + offset, size_used);
-            iopack->io_rev->send_data(fi + offset, size_used);
-            iopack->io_rev->send_data(fi + offset, size_used);
+            iopack->io_rev->send_data(ei + offset_e, size_e);
+            iopack->io_rev->send_data(fi + offset_f, size_f);
           }
         } else {
           if (party == sci::ALICE) {
-            iopack->io->send_data(ei + offset, size_used);
-            iopack->io->send_data(ei + offset, size_used);
-            iopack->io->send_data(fi + offset, size_used);
-            iopack->io->send_data(fi + offset, size_used);
+            iopack->io->send_data(ei + offset_e, size_e);
+            iopack->io->send_data(fi + offset_f, size_f);
           } else { // party == sci::BOB
-            iopack->io->recv_data(e + offset, size_used);
-            iopack->io->recv_data(e + offset, size_used);
-            iopack->io->recv_data(f + offset, size_used);
-            iopack->io->recv_data(f + offset, size_used);
+            iopack->io->recv_data(e + offset_e, size_e);
+            iopack->io->recv_data(f + offset_f, size_f);
           }
         }
       }
 
       // Reconstruct e and f
-      for (int i = 0; i < size_used; i++) {
-        e[i + offset] ^= ei[i + offset];
-        f[i + offset] ^= fi[i + offset];
-      }
+      for (int i = 0; i < size_e; i++)
+        e[i + offset_e] ^= ei[i + offset_e];
+      for (int i = 0; i < size_f; i++)
+        f[i + offset_f] ^= fi[i + offset_f];
 
       counter_triples_used = old_counter_triples_used;
 
@@ -349,7 +379,7 @@ public:
         // CMP_j: Use 1 triple compute cmp_j AND eq_j+i.
         this->mill->AND_step_2(
             leaf_res_cmp + j * num_cmps,
-            e + (2 * counter_triples_used * num_cmps) / 8,
+            e + (counter_triples_used * num_cmps) / 8,
             f + (2 * counter_triples_used * num_cmps) / 8,
             nullptr, // not used in function
             nullptr, // not used in function
@@ -360,7 +390,7 @@ public:
         // EQ_j: Use 1 triple compute eq_j AND eq_j+i.
         this->mill->AND_step_2(
             leaf_res_eq + j * num_cmps,
-            e + ((2 * counter_triples_used + 1) * num_cmps) / 8,
+            e + (counter_triples_used * num_cmps) / 8,
             f + ((2 * counter_triples_used + 1) * num_cmps) / 8,
             nullptr, // not used in function
             nullptr, // not used in function
@@ -0,0 +1,156 @@
+/*
+Pool of packed bit triples filled ahead of time by a background thread, so
+that the AND rounds of the Millionaire and Equality traversals do not wait
+for triple generation.
+
+The producer runs its own TripleGenerator, which must sit on an IOPack and
+OTPack used by nothing else, because it talks to the peer's producer while
+the online protocol uses the main channels. ALICE's producer decides when
+the next batch is generated (whenever her pool is below max_batches
+batches) and tells BOB's with a one-byte flag, so both produce the same
+sequence of batches. Consumers lease bytes from the front of the pool in
+the order they call lease; both parties must lease the same amounts in the
+same order, which holds as long as they run the same sequence of protocol
+calls. BOB's destructor returns once ALICE's bank has been destroyed.
+*/
+
+#ifndef TRIPLE_BANK_H__
+#define TRIPLE_BANK_H__
+#include "Millionaire/bit-triple-generator.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+class TripleBank {
+public:
+  int party;
+  TripleGenerator *triple_gen;
+  TripleGenMethod method;
+  int batch_triples, max_batches;
+
+  // Batches produced, bytes leased and total time consumers spent waiting
+  // for the producer.
+  uint64_t num_batches = 0, num_leased = 0, wait_us = 0;
+
+  TripleBank(int party, TripleGenerator *triple_gen,
+             TripleGenMethod method = _16KKOT_to_4OT,
+             int batch_triples = 1 << 17, int max_batches = 4) {
+    assert(method != _8KKOT); // correlated triples cannot be leased piecewise
+    assert(batch_triples > 0 && batch_triples % 8 == 0 && max_batches > 0);
+    this->party = party;
+    this->triple_gen = triple_gen;
+    this->method = method;
+    this->batch_triples = batch_triples;
+    this->max_batches = max_batches;
+    producer = std::thread([this] { produce(); });
+  }
+
+  ~TripleBank() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      stop = true;
+    }
+    cv.notify_all();
+    producer.join();
+    for (Triple *t : pool)
+      delete t;
+  }
+
+  // Copies the next num_bytes packed bytes of triples into ai, bi and ci.
+  void lease(uint8_t *ai, uint8_t *bi, uint8_t *ci, int num_bytes) {
+    auto t0 = std::chrono::steady_clock::now();
+    bool waited = false;
+    std::unique_lock<std::mutex> lock(mtx);
+    for (int done = 0; done < num_bytes;) {
+      if (pool.empty()) {
+        waited = true;
+        cv.wait(lock, [this] { return !pool.empty(); });
+      }
+      Triple *t = pool.front();
+      int n = std::min(num_bytes - done, t->num_bytes - front_pos);
+      memcpy(ai + done, t->ai + front_pos, n);
+      memcpy(bi + done, t->bi + front_pos, n);
+      memcpy(ci + done, t->ci + front_pos, n);
+      done += n;
+      front_pos += n;
+      pool_bytes -= n;
+      if (front_pos == t->num_bytes) {
+        pool.pop_front();
+        delete t;
+        front_pos = 0;
+      }
+    }
+    num_leased += num_bytes;
+    if (waited)
+      wait_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - t0)
+                     .count();
+    lock.unlock();
+    cv.notify_all();
+  }
+
+  void lease(Triple *triples) {
+    assert(triples->packed && triples->offset == 1);
+    lease(triples->ai, triples->bi, triples->ci, triples->num_bytes);
+  }
+
+  // Packed bytes currently in the pool.
+  uint64_t available() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return pool_bytes;
+  }
+
+private:
+  void produce() {
+#ifdef __linux__
+    // Only use cycles the online phase leaves idle.
+    sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+    sci::IOPack *iopack = triple_gen->iopack;
+    const uint64_t max_bytes = (uint64_t)max_batches * batch_triples / 8;
+    for (;;) {
+      uint8_t go;
+      if (party == sci::ALICE) {
+        {
+          std::unique_lock<std::mutex> lock(mtx);
+          cv.wait(lock, [&] { return stop || pool_bytes < max_bytes; });
+          go = !stop;
+        }
+        iopack->io->send_data(&go, 1);
+        iopack->io->flush();
+      } else {
+        iopack->io->recv_data(&go, 1);
+      }
+      if (!go)
+        return;
+      Triple *t = new Triple(batch_triples, true);
+      triple_gen->generate(party, t, method);
+      iopack->io->flush();
+      iopack->io_rev->flush();
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        pool.push_back(t);
+        pool_bytes += t->num_bytes;
+        num_batches++;
+      }
+      cv.notify_all();
+    }
+  }
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<Triple *> pool;
+  int front_pos = 0;
+  uint64_t pool_bytes = 0;
+  bool stop = false;
+  std::thread producer;
+};
+
+#endif // TRIPLE_BANK_H__
@@ -0,0 +1,101 @@
+/*
+Base-OT backend used by the OT extensions (IKNP, KKOT and their split
+variants) for their setup.
+
+BASE_OT_NP is Naor-Pinkas over OpenSSL P-256 (OT/np.h), BASE_OT_CO is
+Chou-Orlandi over libsodium's ristretto255 (OT/co.h). Both parties of an
+instance must use the same backend. The backend object is only created
+when the first base OTs run, so instances that are seeded with
+setup_send/setup_recv keys never pay for it.
+*/
+
+#ifndef OT_BASE_OT_H__
+#define OT_BASE_OT_H__
+#include "OT/co.h"
+#include "OT/np.h"
+#include <stdexcept>
+
+namespace sci {
+
+enum BaseOTKind { BASE_OT_NP = 0, BASE_OT_CO };
+
+inline const char *base_ot_kind_name(BaseOTKind k) {
+  switch (k) {
+  case BASE_OT_CO:
+    return "co-ristretto255";
+  default:
+    return "np-p256";
+  }
+}
+
+inline bool base_ot_kind_supported(BaseOTKind k) {
+#ifdef OT_CO_AVAILABLE
+  return true;
+#else
+  return k == BASE_OT_NP;
+#endif
+}
+
+template <typename IO> class BaseOT : public OT<BaseOT<IO>> {
+public:
+  IO *io;
+  BaseOTKind kind;
+  OTNP<IO> *np = nullptr;
+#ifdef OT_CO_AVAILABLE
+  OTCO<IO> *co = nullptr;
+#endif
+
+  BaseOT(IO *io, BaseOTKind kind = BASE_OT_NP) {
+    this->io = io;
+    set_kind(kind);
+  }
+
+  ~BaseOT() {
+    delete np;
+#ifdef OT_CO_AVAILABLE
+    delete co;
+#endif
+  }
+
+  void set_kind(BaseOTKind kind) {
+    if (!base_ot_kind_supported(kind))
+      throw std::invalid_argument(std::string("base OT backend ") +
+                                  base_ot_kind_name(kind) +
+                                  " was not compiled in");
+    this->kind = kind;
+  }
+
+  void send_impl(const block128 *data0, const block128 *data1, int length) {
+    dispatch([&](auto *ot) { ot->send(data0, data1, length); });
+  }
+
+  void send_impl(const block256 *data0, const block256 *data1, int length) {
+    dispatch([&](auto *ot) { ot->send(data0, data1, length); });
+  }
+
+  void recv_impl(block128 *data, const bool *b, int length) {
+    dispatch([&](auto *ot) { ot->recv(data, b, length); });
+  }
+
+  void recv_impl(block256 *data, const bool *b, int length) {
+    dispatch([&](auto *ot) { ot->recv(data, b, length); });
+  }
+
+private:
+  template <typename F> void dispatch(F &&f) {
+#ifdef OT_CO_AVAILABLE
+    if (kind == BASE_OT_CO) {
+      if (co == nullptr)
+        co = new OTCO<IO>(io);
+      f(co);
+      return;
+    }
+#endif
+    if (np == nullptr)
+      np = new OTNP<IO>(io);
+    f(np);
+  }
+};
+
+} // namespace sci
+#endif // OT_BASE_OT_H__
@@ -0,0 +1,255 @@
+/*
+Bit-packing kernels for the OT message helpers in ot-utils.h and
+split-utils.h.
+
+All of them use the same layout: values of bitsize bits stored back to
+back, least significant bit first, in a little-endian byte stream. A
+stream of uint64_t or uint8_t words is therefore the same bytes, whatever
+the carrier type. Widths 1, 2, 4, 8, 16, 32 and 64 are specialised at
+compile time (see dispatch_bit_width), so no value straddles a word and the
+shifts are constants. Contiguous uint8_t/uint64_t arrays also have AVX2
+(movemask) and, where the CPU has it, BMI2 (pdep/pext) paths for the
+narrow widths.
+*/
+
+#ifndef OT_BIT_PACK_H__
+#define OT_BIT_PACK_H__
+#include "utils/block.h"
+#include <cstring>
+#include <type_traits>
+
+namespace sci {
+
+inline uint64_t bit_mask(int bitsize) {
+  return (bitsize >= 64) ? ~0ULL : ((1ULL << bitsize) - 1);
+}
+
+inline bool bit_pack_has_bmi2() {
+  static const bool has = __builtin_cpu_supports("bmi2");
+  return has;
+}
+
+/*
+  Calls f with std::integral_constant<int, bitsize> for the specialised
+  widths and std::integral_constant<int, 0> (runtime width) otherwise.
+*/
+template <typename F> void dispatch_bit_width(int bitsize, F &&f) {
+  switch (bitsize) {
+  case 1:
+    f(std::integral_constant<int, 1>());
+    break;
+  case 2:
+    f(std::integral_constant<int, 2>());
+    break;
+  case 4:
+    f(std::integral_constant<int, 4>());
+    break;
+  case 8:
+    f(std::integral_constant<int, 8>());
+    break;
+  case 16:
+    f(std::integral_constant<int, 16>());
+    break;
+  case 32:
+    f(std::integral_constant<int, 32>());
+    break;
+  case 64:
+    f(std::integral_constant<int, 64>());
+    break;
+  default:
+    f(std::integral_constant<int, 0>());
+    break;
+  }
+}
+
+/*
+  Appends values to a bit stream at out. Values passed to put must already
+  be masked to the width. W is the width if known at compile time, else 0.
+*/
+template <int W> class BitWriter {
+public:
+  BitWriter(uint8_t *out, int bitsize) : out(out), w(W ? W : bitsize) {}
+
+  inline void put(uint64_t x) {
+    acc |= x << fill;
+    fill += w;
+    if (fill >= 64) {
+      memcpy(out, &acc, 8);
+      out += 8;
+      fill -= 64;
+      // Only widths that do not divide 64 carry bits over.
+      acc = (W == 0 && fill > 0) ? x >> (w - fill) : 0;
+    }
+  }
+
+  // Flushes the last partial word and zeroes the stream up to end.
+  void finish(uint8_t *end) {
+    int nbytes = (fill + 7) / 8;
+    memcpy(out, &acc, nbytes);
+    out += nbytes;
+    if (out < end)
+      memset(out, 0, end - out);
+  }
+
+private:
+  uint8_t *out;
+  const int w;
+  uint64_t acc = 0;
+  int fill = 0;
+};
+
+/*
+  Value of bitsize bits at bit position pos of a stream of nbytes bytes.
+  One unaligned load when the 8 bytes at pos / 8 are inside the stream and
+  hold the whole value.
+*/
+inline uint64_t read_bits(const uint8_t *in, uint64_t nbytes, uint64_t pos,
+                          int bitsize) {
+  const uint64_t byte = pos / 8;
+  const int off = pos % 8;
+  uint64_t v;
+  if (byte + 8 <= nbytes && off + bitsize <= 64) {
+    memcpy(&v, in + byte, 8);
+    v >>= off;
+  } else {
+    int need = (off + bitsize + 7) / 8;
+    uint64_t lo = 0, hi = 0;
+    for (int j = 0; j < need && byte + j < nbytes; j++) {
+      if (j < 8)
+        lo |= (uint64_t)in[byte + j] << (8 * j);
+      else
+        hi = in[byte + j];
+    }
+    v = (lo >> off) | (off ? hi << (64 - off) : 0);
+  }
+  return v & bit_mask(bitsize);
+}
+
+// Narrow widths of uint8_t values with BMI2: 8 values per pext/pdep.
+__attribute__((target("bmi2"))) inline uint64_t
+pack_u8_bmi2(uint8_t *out, const uint8_t *v, uint64_t n, int bitsize) {
+  const uint64_t lanes = 0x0101010101010101ULL * bit_mask(bitsize);
+  uint64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t x;
+    memcpy(&x, v + i, 8);
+    uint64_t p = _pext_u64(x, lanes);
+    memcpy(out + i * bitsize / 8, &p, bitsize);
+  }
+  return i;
+}
+
+__attribute__((target("bmi2"))) inline uint64_t
+unpack_u8_bmi2(uint8_t *v, const uint8_t *in, uint64_t n, int bitsize) {
+  const uint64_t lanes = 0x0101010101010101ULL * bit_mask(bitsize);
+  uint64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t p = 0;
+    memcpy(&p, in + i * bitsize / 8, bitsize);
+    uint64_t x = _pdep_u64(p, lanes);
+    memcpy(v + i, &x, 8);
+  }
+  return i;
+}
+
+// Width 1 with AVX2: bit 0 of 32 bytes (or 4 words) per movemask.
+inline uint64_t pack_u8_bits_avx2(uint8_t *out, const uint8_t *v, uint64_t n) {
+  uint64_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(v + i));
+    uint32_t m = _mm256_movemask_epi8(_mm256_slli_epi16(x, 7));
+    memcpy(out + i / 8, &m, 4);
+  }
+  return i;
+}
+
+inline uint64_t pack_u64_bits_avx2(uint8_t *out, const uint64_t *v,
+                                   uint64_t n) {
+  uint64_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    uint64_t word = 0;
+    for (int j = 0; j < 16; j++) {
+      __m256i x = _mm256_loadu_si256((const __m256i *)(v + i + 4 * j));
+      word |= (uint64_t)_mm256_movemask_pd(
+                  _mm256_castsi256_pd(_mm256_slli_epi64(x, 63)))
+              << (4 * j);
+    }
+    memcpy(out + i / 8, &word, 8);
+  }
+  return i;
+}
+
+/*
+  Packs the low bitsize bits of v[0..n) into the stream at out and zeroes it
+  up to nbytes, which must hold at least n * bitsize bits.
+*/
+template <typename T>
+void pack_bits(uint8_t *out, uint64_t nbytes, const T *v, uint64_t n,
+               int bitsize) {
+  static_assert(std::is_unsigned<T>::value, "pack_bits needs unsigned values");
+  uint64_t done = 0;
+  if (bitsize == 8 * (int)sizeof(T)) {
+    memcpy(out, v, n * sizeof(T));
+    done = n;
+  } else if (bitsize == 1 && sizeof(T) == 1) {
+    done = pack_u8_bits_avx2(out, (const uint8_t *)v, n);
+  } else if (bitsize == 1 && sizeof(T) == 8) {
+    done = pack_u64_bits_avx2(out, (const uint64_t *)v, n);
+  } else if (sizeof(T) == 1 && bitsize < 8 && bit_pack_has_bmi2()) {
+    done = pack_u8_bmi2(out, (const uint8_t *)v, n, bitsize);
+  }
+  // done is a multiple of 8 values, so the rest starts on a byte.
+  uint8_t *rest = out + done * bitsize / 8;
+  const uint64_t mask = bit_mask(bitsize);
+  dispatch_bit_width(bitsize, [&](auto W) {
+    BitWriter<decltype(W)::value> bw(rest, bitsize);
+    for (uint64_t i = done; i < n; i++)
+      bw.put(v[i] & mask);
+    bw.finish(out + nbytes);
+  });
+}
+
+/*
+  Reads n values of bitsize bits from the stream at in (at least
+  n * bitsize bits long) into v.
+*/
+template <typename T>
+void unpack_bits(T *v, const uint8_t *in, uint64_t n, int bitsize) {
+  static_assert(std::is_unsigned<T>::value,
+                "unpack_bits needs unsigned values");
+  const uint64_t nbytes = (n * bitsize + 7) / 8;
+  uint64_t done = 0;
+  if (bitsize == 8 * (int)sizeof(T)) {
+    memcpy(v, in, n * sizeof(T));
+    return;
+  }
+  if (sizeof(T) == 1 && bitsize < 8 && bit_pack_has_bmi2())
+    done = unpack_u8_bmi2((uint8_t *)v, in, n, bitsize);
+  dispatch_bit_width(bitsize, [&](auto W) {
+    constexpr int w = decltype(W)::value;
+    if constexpr (w != 0 && w <= 32) {
+      // Whole words of 64 / w values, then the tail.
+      const uint64_t mask = bit_mask(w);
+      for (; done + 64 / w <= n; done += 64 / w) {
+        uint64_t word;
+        memcpy(&word, in + done * w / 8, 8);
+        for (int j = 0; j < 64 / w; j++)
+          v[done + j] = (T)((word >> (j * w)) & mask);
+      }
+    } else if (w == 0 && bitsize <= 56) {
+      // Any value of at most 56 bits fits in the 8 bytes from its first one.
+      const uint64_t mask = bit_mask(bitsize);
+      for (uint64_t pos = done * bitsize; done < n && pos / 8 + 8 <= nbytes;
+           done++, pos += bitsize) {
+        uint64_t word;
+        memcpy(&word, in + pos / 8, 8);
+        v[done] = (T)((word >> (pos % 8)) & mask);
+      }
+    }
+    for (uint64_t i = done; i < n; i++)
+      v[i] = (T)read_bits(in, nbytes, i * bitsize, bitsize);
+  });
+}
+
+} // namespace sci
+#endif // OT_BIT_PACK_H__
@@ -0,0 +1,161 @@
+/*
+Chou-Orlandi ("simplest") base OT over ristretto255, using libsodium.
+
+The sender publishes A = aG. For choice bit c the receiver sends
+B = bG + cA and keeps K = bA, and the sender derives K0 = aB and
+K1 = aB - aA, so K_c = K and K_{1-c} is unknown to the receiver. Keys are
+hashed together with A, B and the OT index. Points are fixed 32-byte
+ristretto255 encodings, so each round carries all OTs of a batch in one
+buffer, and the scalar multiplications of a batch are spread over
+num_threads threads.
+
+Only compiled when the build found libsodium and defines SCI_USE_SODIUM
+(see the SCI_ENABLE_SODIUM CMake option); OT_CO_AVAILABLE tells whether it
+is.
+*/
+
+#ifndef OT_CO_H__
+#define OT_CO_H__
+#ifdef SCI_USE_SODIUM
+#include "OT/ot-utils.h"
+#include <sodium.h>
+#define OT_CO_AVAILABLE 1
+
+/** @addtogroup OT
+        @{
+*/
+namespace sci {
+template <typename IO> class OTCO : public OT<OTCO<IO>> {
+public:
+  static const int PT_BYTES = crypto_core_ristretto255_BYTES;
+  static const int SC_BYTES = crypto_core_ristretto255_SCALARBYTES;
+  IO *io;
+  // Threads used for the scalar multiplications of a batch.
+  int num_threads;
+  OTCO(IO *io) {
+    this->io = io;
+    num_threads =
+        std::max(1, std::min(8, (int)std::thread::hardware_concurrency()));
+    if (sodium_init() < 0)
+      error("sodium_init failed");
+  }
+
+  void send_impl(const block128 *data0, const block128 *data1, int length) {
+    send_batched(data0, data1, length);
+  }
+
+  void send_impl(const block256 *data0, const block256 *data1, int length) {
+    send_batched(data0, data1, length);
+  }
+
+  void recv_impl(block128 *data, const bool *b, int length) {
+    recv_batched(data, b, length);
+  }
+
+  void recv_impl(block256 *data, const bool *b, int length) {
+    recv_batched(data, b, length);
+  }
+
+private:
+  static block128 kdf(const uint8_t *in, int nbyte, block128 *) {
+    return Hash::hash_for_block128(in, nbyte);
+  }
+  static block256 kdf(const uint8_t *in, int nbyte, block256 *) {
+    return Hash::hash_for_block256(in, nbyte);
+  }
+
+  // H(A || B || K || i)
+  template <typename T>
+  static T key(const uint8_t *A, const uint8_t *B, const uint8_t *K,
+               uint64_t i) {
+    uint8_t in[3 * PT_BYTES + 8];
+    memcpy(in, A, PT_BYTES);
+    memcpy(in + PT_BYTES, B, PT_BYTES);
+    memcpy(in + 2 * PT_BYTES, K, PT_BYTES);
+    memcpy(in + 3 * PT_BYTES, &i, 8);
+    return kdf(in, sizeof(in), (T *)nullptr);
+  }
+
+  template <typename T>
+  void send_batched(const T *data0, const T *data1, int length) {
+    uint8_t a[SC_BYTES], A[PT_BYTES], aA[PT_BYTES];
+    crypto_core_ristretto255_scalar_random(a);
+    crypto_scalarmult_ristretto255_base(A, a);
+    io->send_data(A, PT_BYTES);
+    io->flush();
+    if (crypto_scalarmult_ristretto255(aA, a, A) != 0)
+      error("OTCO: invalid scalar");
+
+    uint8_t *B = new uint8_t[length * PT_BYTES];
+    io->recv_data(B, length * PT_BYTES);
+
+    T *m = new T[2 * length];
+    std::atomic<bool> bad(false);
+    int nt = std::max(1, std::min(length, num_threads));
+    ot_parallel_for(nt, nt, [&](int t) {
+      uint8_t K0[PT_BYTES], K1[PT_BYTES];
+      for (int i = t; i < length; i += nt) {
+        const uint8_t *Bi = B + i * PT_BYTES;
+        if (!crypto_core_ristretto255_is_valid_point(Bi) ||
+            crypto_scalarmult_ristretto255(K0, a, Bi) != 0) {
+          bad = true;
+          continue;
+        }
+        crypto_core_ristretto255_sub(K1, K0, aA);
+        m[2 * i] = xorBlocks(data0[i], key<T>(A, Bi, K0, i));
+        m[2 * i + 1] = xorBlocks(data1[i], key<T>(A, Bi, K1, i));
+      }
+    });
+    sodium_memzero(a, SC_BYTES);
+    if (bad)
+      error("OTCO: receiver sent an invalid point");
+    io->send_data(m, 2 * length * sizeof(T));
+
+    delete[] m;
+    delete[] B;
+  }
+
+  template <typename T> void recv_batched(T *data, const bool *b, int length) {
+    uint8_t A[PT_BYTES];
+    io->recv_data(A, PT_BYTES);
+    if (!crypto_core_ristretto255_is_valid_point(A))
+      error("OTCO: sender sent an invalid point");
+
+    uint8_t *B = new uint8_t[length * PT_BYTES];
+    uint8_t *K = new uint8_t[length * PT_BYTES];
+    int nt = std::max(1, std::min(length, num_threads));
+    ot_parallel_for(nt, nt, [&](int t) {
+      uint8_t k[SC_BYTES], G[PT_BYTES];
+      for (int i = t; i < length; i += nt) {
+        uint8_t *Bi = B + i * PT_BYTES;
+        do {
+          crypto_core_ristretto255_scalar_random(k);
+        } while (crypto_scalarmult_ristretto255(K + i * PT_BYTES, k, A) != 0);
+        crypto_scalarmult_ristretto255_base(G, k);
+        if (b[i])
+          crypto_core_ristretto255_add(Bi, G, A);
+        else
+          memcpy(Bi, G, PT_BYTES);
+      }
+      sodium_memzero(k, SC_BYTES);
+    });
+    io->send_data(B, length * PT_BYTES);
+    io->flush();
+
+    T *m = new T[2 * length];
+    io->recv_data(m, 2 * length * sizeof(T));
+    for (int i = 0; i < length; ++i) {
+      int ind = b[i] ? 1 : 0;
+      data[i] = xorBlocks(m[2 * i + ind],
+                          key<T>(A, B + i * PT_BYTES, K + i * PT_BYTES, i));
+    }
+    sodium_memzero(K, length * PT_BYTES);
+    delete[] m;
+    delete[] B;
+    delete[] K;
+  }
+};
+/**@}*/
+} // namespace sci
+#endif // SCI_USE_SODIUM
+#endif // OT_CO_H__
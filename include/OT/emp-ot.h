@@ -6,6 +6,7 @@
 
 #include "OT/iknp.h"
 #include "OT/np.h"
+#include "OT/base-ot.h"
 
 #include "OT/kkot.h"
 #include "OT/ot_pack.h"
@@ -27,20 +27,29 @@ Modified by Nishant Kumar
 
 #ifndef OT_IKNP_H__
 #define OT_IKNP_H__
-#include "OT/np.h"
+#include "OT/base-ot.h"
+#include "OT/ot-utils.h"
 #include "OT/ot.h"
 #include <algorithm>
 namespace sci {
 template <typename IO> class IKNP : public OT<IKNP<IO>> {
 public:
-  OTNP<IO> *base_ot;
+  BaseOT<IO> *base_ot;
   PRG128 prg;
   const int lambda = 128;
   const int block_size = 1024 * 16;
   int l;
+  // number of threads used to generate the extension matrix in
+  // send_pre/recv_pre. The transcript does not depend on it.
+  int num_threads = 1;
 
   block128 *k0 = nullptr, *k1 = nullptr, *qT = nullptr, *tT = nullptr,
            *tmp = nullptr, block_s;
+  // pooled storage behind qT/tT and the per-call scratch arrays. They only
+  // grow, so repeated calls of the same length do not allocate.
+  OTBuffer<Block128> qT_buf, tT_buf, block_r_buf, msgs_buf, scratch_buf,
+      post_buf;
+  OTBuffer<bool> r2_buf;
   PRG128 *G0, *G1;
   bool *s = nullptr, *extended_r = nullptr, setup = false;
   IO *io = nullptr;
@@ -48,7 +57,7 @@ public:
 
   IKNP(IO *io) {
     this->io = io;
-    base_ot = new OTNP<IO>(io);
+    base_ot = new BaseOT<IO>(io);
     s = new bool[lambda];
     k0 = new block128[lambda];
     k1 = new block128[lambda];
@@ -106,57 +115,34 @@ public:
 
   void send_pre(int length) {
     length = padded_length(length);
-    block128 q[block_size];
-    qT = new block128[length];
+    qT = qT_buf.get(length);
     if (!setup)
       setup_send();
 
-    for (int j = 0; j < length / block_size; ++j) {
-      for (int i = 0; i < lambda; ++i) {
-        G0[i].random_data(q + (i * block_size / 128), block_size / 8);
-        io->recv_data(tmp, block_size / 8);
-        if (s[i])
-          xorBlocks_arr(q + (i * block_size / 128), q + (i * block_size / 128),
-                        tmp, block_size / 128);
-      }
-      sse_trans((uint8_t *)(qT + j * block_size), (uint8_t *)q, 128,
-                block_size);
-    }
+    iknp_send_pre_chunks(io, G0, s, lambda, block_size, length / block_size,
+                         qT, num_threads, msgs_buf, scratch_buf);
   }
 
   void recv_pre(const bool *r, int length) {
     int old_length = length;
     length = padded_length(length);
-    block128 t[block_size];
-    tT = new block128[length];
+    tT = tT_buf.get(length);
 
     if (not setup)
       setup_recv();
 
-    bool *r2 = new bool[length];
+    bool *r2 = r2_buf.get(length);
     prg.random_bool(extended_r, block_size);
     memcpy(r2, r, old_length);
     memcpy(r2 + old_length, extended_r, length - old_length);
 
-    block128 *block_r = new block128[length / 128];
+    block128 *block_r = block_r_buf.get(length / 128);
     for (int i = 0; i < length / 128; ++i) {
       block_r[i] = bool_to128(r2 + i * 128);
     }
-    for (int j = 0; j * block_size < length; ++j) {
-      for (int i = 0; i < lambda; ++i) {
-        G0[i].random_data(t + (i * block_size / 128), block_size / 8);
-        G1[i].random_data(tmp, block_size / 8);
-        xorBlocks_arr(tmp, t + (i * block_size / 128), tmp, block_size / 128);
-        xorBlocks_arr(tmp, block_r + (j * block_size / 128), tmp,
-                      block_size / 128);
-        io->send_data(tmp, block_size / 8);
-      }
-      sse_trans((uint8_t *)(tT + j * block_size), (uint8_t *)t, 128,
-                block_size);
-    }
-
-    delete[] block_r;
-    delete[] r2;
+    iknp_recv_pre_chunks(io, G0, G1, block_r, lambda, block_size,
+                         length / block_size, tT, num_threads, msgs_buf,
+                         scratch_buf);
   }
 
   void got_send_post(const block128 *data0, const block128 *data1, int length) {
@@ -174,7 +160,6 @@ public:
       }
       io->send_data(pad, 2 * sizeof(block128) * std::min(bsize, length - i));
     }
-    delete[] qT;
   }
 
   void got_recv_post(block128 *data, const bool *r, int length) {
@@ -190,7 +175,6 @@ public:
         data[i + j] = xorBlocks(res[2 * j + r[i + j]], tT[i + j]);
       }
     }
-    delete[] tT;
   }
 
   void got_send_post(uint64_t **data, int length) {
@@ -273,7 +257,6 @@ public:
                          ((float)sizeof(uint64_t) * 8));
       io->send_data(pad2, sizeof(uint64_t) * (pad2_size_correct));
     }
-    delete[] qT;
   }
 
   void got_recv_post(uint64_t *data, const uint8_t *r, int length) {
@@ -324,7 +307,6 @@ public:
         }
       }
     }
-    delete[] tT;
   }
 
   void cot_send_post(block128 *data0, block128 delta, int length) {
@@ -344,7 +326,6 @@ public:
       }
       io->send_data(tmp, sizeof(block128) * std::min(bsize, length - i));
     }
-    delete[] qT;
   }
 
   void cot_recv_post(block128 *data, const bool *r, int length) {
@@ -361,7 +342,6 @@ public:
           data[i + j] = xorBlocks(res[j], data[i + j]);
       }
     }
-    delete[] tT;
   }
 
   void rot_send_post(block128 *data0, block128 *data1, int length) {
@@ -378,7 +358,6 @@ public:
         data1[j] = pad[2 * (j - i) + 1];
       }
     }
-    delete[] qT;
   }
 
   void rot_recv_post(block128 *data, const bool *r, int length) {
@@ -389,7 +368,6 @@ public:
       else
         crh.Hn(data + i, tT + i, length - i);
     }
-    delete[] tT;
   }
 
   void send_impl(const block128 *data0, const block128 *data1, int length) {
@@ -491,7 +469,7 @@ public:
                             //  get added in one OT. So, declare an array of
                             //  size AES_BATCH_SIZE + 130.
     block128 *dataToBeSent =
-        new block128[AES_BATCH_SIZE + (senderMatmulDims / 2) + 10];
+        post_buf.get(AES_BATCH_SIZE + (senderMatmulDims / 2) + 10);
     uint64_t dataToBeSentByteAlignedPtr = 0;
     uint64_t corrPtr = 0;
     for (int i = 0; i < numOTs; i++) {
@@ -540,8 +518,6 @@ public:
         dataToBeSentByteAlignedPtr = 0;
       }
     }
-    delete[] dataToBeSent;
-    delete[] qT;
   }
 
   template <typename intType>
@@ -568,7 +544,7 @@ public:
             Also, since this can be a large array, allocating on heap is better.
     */
     block128 *hashesStored =
-        new block128[AES_BATCH_SIZE + (senderMatmulDims / 2) + 10 + numOTs];
+        post_buf.get(AES_BATCH_SIZE + (senderMatmulDims / 2) + 10 + numOTs);
     uint64_t hashesStoredPtr =
         0; // Indexes into hashesStored to keep track of which hash block to be
            // used to start storing hashes
@@ -672,8 +648,6 @@ public:
       totalChunks += numChunks[i];
     assert(dataPtr == totalChunks);
     assert(otDataStartCtr == numOTs);
-    delete[] hashesStored;
-    delete[] tT;
   }
 
   /*
@@ -732,7 +706,6 @@ public:
       }
       io->send_data(tmp, sizeof(intType) * std::min(bsize, length - i));
     }
-    delete[] qT;
   }
 
   template <typename intType>
@@ -755,7 +728,6 @@ public:
         }
       }
     }
-    delete[] tT;
   }
 
   /*
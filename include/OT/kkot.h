@@ -21,13 +21,14 @@ SOFTWARE.
 
 #ifndef OT_KKOT_H__
 #define OT_KKOT_H__
-#include "OT/np.h"
+#include "OT/base-ot.h"
+#include "OT/ot-utils.h"
 #include "OT/ot.h"
 
 namespace sci {
 template <typename IO> class KKOT : public OT<KKOT<IO>> {
 public:
-  OTNP<IO> *base_ot;
+  BaseOT<IO> *base_ot;
   PRG128 prg;
   const int lambda = 256;
   int block_size = 1024 * 16;
@@ -36,6 +37,11 @@ public:
 
   block256 *k0 = nullptr, *k1 = nullptr, *d = nullptr, *c_AND_s = nullptr,
            *qT = nullptr, *tT = nullptr, *tmp = nullptr, block_s;
+  // pooled storage behind qT/tT and the per-call scratch arrays. They only
+  // grow, so steady-state calls do not allocate.
+  OTBuffer<Block256> qT_buf, tT_buf, dT_buf, key_buf;
+  OTBuffer<Block128> pad_buf, res_buf;
+  OTBuffer<uint8_t> r2_buf;
   PRG256 *G0, *G1;
   bool *s = nullptr, setup = false, precomp_masks = false;
   uint8_t *extended_r = nullptr;
@@ -43,15 +49,16 @@ public:
 
   KKOT(IO *io) {
     this->io = io;
-    base_ot = new OTNP<IO>(io);
+    base_ot = new BaseOT<IO>(io);
     s = new bool[lambda];
-    k0 = new (std::align_val_t(32)) block256[lambda];
-    k1 = new (std::align_val_t(32)) block256[lambda];
-    d = new (std::align_val_t(32)) block256[block_size];
-    c_AND_s = new (std::align_val_t(32)) block256[lambda];
+    // new[] honours alignof(block256) and pairs with the delete[] below
+    k0 = new block256[lambda];
+    k1 = new block256[lambda];
+    d = new block256[block_size];
+    c_AND_s = new block256[lambda];
     G0 = new PRG256[lambda];
     G1 = new PRG256[lambda];
-    tmp = new (std::align_val_t(32)) block256[block_size / 256];
+    tmp = new block256[block_size / 256];
     extended_r = new uint8_t[block_size];
   }
 
@@ -117,7 +124,7 @@ public:
   void send_pre(int length) {
     length = padded_length(length);
     alignas(32) block256 q[block_size];
-    qT = new (std::align_val_t(32)) block256[length];
+    qT = qT_buf.get(length);
     if (!setup)
       setup_send();
     if (!precomp_masks)
@@ -131,7 +138,7 @@ public:
           xorBlocks_arr(q + (i * block_size / 256), q + (i * block_size / 256),
                         tmp, block_size / 256);
       }
-      sse_trans((uint8_t *)(qT + j * block_size), (uint8_t *)q, 256,
+      bit_trans((uint8_t *)(qT + j * block_size), (uint8_t *)q, 256,
                 block_size);
     }
   }
@@ -140,22 +147,22 @@ public:
     int old_length = length;
     length = padded_length(length);
     alignas(32) block256 t[block_size];
-    tT = new (std::align_val_t(32)) block256[length];
+    tT = tT_buf.get(length);
 
     if (not setup)
       setup_recv();
 
-    uint8_t *r2 = new uint8_t[length];
+    uint8_t *r2 = r2_buf.get(length);
     prg.random_data(extended_r, block_size);
     memcpy(r2, r, old_length);
     memcpy(r2 + old_length, extended_r, length - old_length);
 
-    block256 *dT = new (std::align_val_t(32)) block256[length];
+    block256 *dT = dT_buf.get(length);
     for (int i = 0; i < length; i++)
       dT[i] = _mm256_lddqu_si256((const __m256i *)WH_Code[r2[i]]);
 
     for (int j = 0; j * block_size < length; ++j) {
-      sse_trans((uint8_t *)d, (uint8_t *)(dT + j * block_size), block_size,
+      bit_trans((uint8_t *)d, (uint8_t *)(dT + j * block_size), block_size,
                 256);
       for (int i = 0; i < lambda; ++i) {
         G0[i].random_data(t + (i * block_size / 256), block_size / 8);
@@ -164,18 +171,15 @@ public:
         xorBlocks_arr(tmp, d + (i * block_size / 256), tmp, block_size / 256);
         io->send_data(tmp, block_size / 8);
       }
-      sse_trans((uint8_t *)(tT + j * block_size), (uint8_t *)t, 256,
+      bit_trans((uint8_t *)(tT + j * block_size), (uint8_t *)t, 256,
                 block_size);
     }
-
-    delete[] dT;
-    delete[] r2;
   }
 
   void got_send_post(block128 **data, int length) {
     const int bsize = ro_batch_size;
-    block256 *key = new (std::align_val_t(32)) block256[N * bsize];
-    block128 *y = new block128[N * bsize];
+    block256 *key = key_buf.get(N * bsize);
+    block128 *y = pad_buf.get(N * bsize);
     for (int i = 0; i < length; i += bsize) {
       for (int j = i; j < i + bsize and j < length; ++j) {
         for (int k = 0; k < N; k++) {
@@ -190,15 +194,12 @@ public:
       }
       io->send_data(y, N * sizeof(block128) * std::min(bsize, length - i));
     }
-    delete[] key;
-    delete[] y;
-    delete[] qT;
   }
 
   void got_recv_post(block128 *data, const uint8_t *r, int length) {
     const int bsize = ro_batch_size;
-    block128 *pad = new block128[bsize];
-    block128 *res = new block128[N * bsize];
+    block128 *pad = pad_buf.get(bsize);
+    block128 *res = res_buf.get(N * bsize);
     for (int i = 0; i < length; i += bsize) {
       io->recv_data(res, N * sizeof(block128) * std::min(bsize, length - i));
       if (bsize <= length - i)
@@ -209,9 +210,6 @@ public:
         data[i + j] = xorBlocks(res[N * j + r[i + j]], pad[j]);
       }
     }
-    delete[] pad;
-    delete[] res;
-    delete[] tT;
   }
 
   void send_impl(block128 **data, int length, int N) {
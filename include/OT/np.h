@@ -27,7 +27,7 @@ Modified by Deevashwer Rathee
 
 #ifndef OT_NP_H__
 #define OT_NP_H__
-#include "OT/ot.h"
+#include "OT/ot-utils.h"
 /** @addtogroup OT
         @{
 */
@@ -37,8 +37,12 @@ public:
   IO *io;
   emp::Group *G = nullptr;
   bool delete_G = true;
+  // Threads used for the scalar multiplications of a batch.
+  int num_threads;
   OTNP(IO *io, emp::Group *_G = nullptr) {
     this->io = io;
+    num_threads =
+        std::max(1, std::min(8, (int)std::thread::hardware_concurrency()));
     if (_G == nullptr)
       G = new emp::Group();
     else {
@@ -52,164 +56,122 @@ public:
   }
 
   void send_impl(const block128 *data0, const block128 *data1, int length) {
-    emp::BigInt d;
-    G->get_rand_bn(d);
-    emp::Point C = G->mul_gen(d);
-    io->send_pt(&C);
-    io->flush();
+    send_batched(data0, data1, length);
+  }
 
-    emp::BigInt *r = new emp::BigInt[length];
-    emp::BigInt *rc = new emp::BigInt[length];
-    emp::Point *pk0 = new emp::Point[length], pk1, *gr = new emp::Point[length],
-               *Cr = new emp::Point[length];
-    for (int i = 0; i < length; ++i) {
-      G->get_rand_bn(r[i]);
-      gr[i] = G->mul_gen(r[i]);
-      rc[i] = r[i].mul(d, G->bn_ctx);
-      rc[i] = rc[i].mod(G->order, G->bn_ctx);
-      Cr[i] = G->mul_gen(rc[i]);
-    }
+  void send_impl(const block256 *data0, const block256 *data1, int length) {
+    send_batched(data0, data1, length);
+  }
 
-    for (int i = 0; i < length; ++i) {
-      io->recv_pt(G, &pk0[i]);
-    }
-    for (int i = 0; i < length; ++i) {
-      io->send_pt(&gr[i]);
-    }
-    io->flush();
+  void recv_impl(block128 *data, const bool *b, int length) {
+    recv_batched(data, b, length);
+  }
 
-    block128 m[2];
-    for (int i = 0; i < length; ++i) {
-      pk0[i] = pk0[i].mul(r[i]);
-      emp::Point inv = pk0[i].inv();
-      pk1 = Cr[i].add(inv);
-      m[0] = Hash::KDF128(pk0[i]);
-      m[0] = xorBlocks(data0[i], m[0]);
-      m[1] = Hash::KDF128(pk1);
-      m[1] = xorBlocks(data1[i], m[1]);
-      io->send_data(m, 2 * sizeof(block128));
-    }
+  void recv_impl(block256 *data, const bool *b, int length) {
+    recv_batched(data, b, length);
+  }
 
-    delete[] r;
-    delete[] gr;
-    delete[] Cr;
-    delete[] rc;
-    delete[] pk0;
+private:
+  static block128 kdf(emp::Point &p, block128 *) { return Hash::KDF128(p); }
+  static block256 kdf(emp::Point &p, block256 *) { return Hash::KDF256(p); }
+
+  /*
+    Runs f(i, ctx) for i in [0, length) on num_threads threads. The points
+    are shared with G, so every thread brings its own BN_CTX.
+  */
+  template <typename F> void parallel_ec(int length, F &&f) {
+    int nt = std::max(1, std::min(length, num_threads));
+    ot_parallel_for(nt, nt, [&](int t) {
+      BN_CTX *ctx = BN_CTX_new();
+      for (int i = t; i < length; i += nt)
+        f(i, ctx);
+      BN_CTX_free(ctx);
+    });
   }
 
-  void send_impl(const block256 *data0, const block256 *data1, int length) {
+  /*
+    Every round carries all length points in one buffer (send_pts/recv_pts)
+    and the masked messages in one send_data, so the protocol costs three
+    messages regardless of length. Scalar multiplications are spread over
+    num_threads threads; encoding and hashing stay on the calling thread
+    since they use the group's scratch space.
+  */
+  template <typename T>
+  void send_batched(const T *data0, const T *data1, int length) {
     emp::BigInt d;
     G->get_rand_bn(d);
     emp::Point C = G->mul_gen(d);
-    io->send_pt(&C);
+    io->send_pts(&C, 1);
     io->flush();
 
     emp::BigInt *r = new emp::BigInt[length];
-    emp::BigInt *rc = new emp::BigInt[length];
-    emp::Point *pk0 = new emp::Point[length], pk1, *gr = new emp::Point[length],
-               *Cr = new emp::Point[length];
-    for (int i = 0; i < length; ++i) {
+    emp::Point *pk0 = new emp::Point[length], *pk1 = new emp::Point[length],
+               *gr = new emp::Point[length], *Cr = new emp::Point[length];
+    parallel_ec(length, [&](int i, BN_CTX *ctx) {
       G->get_rand_bn(r[i]);
-      gr[i] = G->mul_gen(r[i]);
-      rc[i] = r[i].mul(d, G->bn_ctx);
-      rc[i] = rc[i].mod(G->order, G->bn_ctx);
-      Cr[i] = G->mul_gen(rc[i]);
-    }
+      gr[i] = G->mul_gen(r[i], ctx);
+      emp::BigInt rc = r[i].mul_mod(d, G->order, ctx);
+      Cr[i] = G->mul_gen(rc, ctx);
+    });
 
-    for (int i = 0; i < length; ++i) {
-      io->recv_pt(G, &pk0[i]);
-    }
-    for (int i = 0; i < length; ++i) {
-      io->send_pt(&gr[i]);
-    }
+    io->recv_pts(G, pk0, length);
+    io->send_pts(gr, length);
     io->flush();
 
-    alignas(32) block256 m[2];
+    parallel_ec(length, [&](int i, BN_CTX *ctx) {
+      pk0[i] = pk0[i].mul(r[i], ctx);
+      emp::Point inv = pk0[i].inv(ctx);
+      pk1[i] = Cr[i].add(inv, ctx);
+    });
+
+    T *m = new T[2 * length];
     for (int i = 0; i < length; ++i) {
-      pk0[i] = pk0[i].mul(r[i]);
-      emp::Point inv = pk0[i].inv();
-      pk1 = Cr[i].add(inv);
-      m[0] = Hash::KDF256(pk0[i]);
-      m[0] = xorBlocks(data0[i], m[0]);
-      m[1] = Hash::KDF256(pk1);
-      m[1] = xorBlocks(data1[i], m[1]);
-      io->send_data(m, 2 * sizeof(block256));
+      m[2 * i] = xorBlocks(data0[i], kdf(pk0[i], m));
+      m[2 * i + 1] = xorBlocks(data1[i], kdf(pk1[i], m));
     }
+    io->send_data(m, 2 * length * sizeof(T));
 
+    delete[] m;
     delete[] r;
     delete[] gr;
     delete[] Cr;
-    delete[] rc;
     delete[] pk0;
+    delete[] pk1;
   }
 
-  void recv_impl(block128 *data, const bool *b, int length) {
+  template <typename T> void recv_batched(T *data, const bool *b, int length) {
     emp::BigInt *k = new emp::BigInt[length];
-    emp::Point *gr = new emp::Point[length];
-    emp::Point pk[2];
-    block128 m[2];
+    emp::Point *pk = new emp::Point[length], *gr = new emp::Point[length];
     emp::Point C;
     for (int i = 0; i < length; ++i)
       G->get_rand_bn(k[i]);
 
-    io->recv_pt(G, &C);
+    io->recv_pts(G, &C, 1);
 
-    for (int i = 0; i < length; ++i) {
+    parallel_ec(length, [&](int i, BN_CTX *ctx) {
       if (b[i]) {
-        pk[1] = G->mul_gen(k[i]);
-        emp::Point inv = pk[1].inv();
-        pk[0] = C.add(inv);
+        emp::Point inv = G->mul_gen(k[i], ctx).inv(ctx);
+        pk[i] = C.add(inv, ctx);
       } else {
-        pk[0] = G->mul_gen(k[i]);
+        pk[i] = G->mul_gen(k[i], ctx);
       }
-      io->send_pt(&pk[0]);
-    }
-
-    for (int i = 0; i < length; ++i) {
-      io->recv_pt(G, &gr[i]);
-      gr[i] = gr[i].mul(k[i]);
-    }
-    for (int i = 0; i < length; ++i) {
-      int ind = b[i] ? 1 : 0;
-      io->recv_data(m, 2 * sizeof(block128));
-      data[i] = xorBlocks(m[ind], Hash::KDF128(gr[i]));
-    }
-    delete[] k;
-    delete[] gr;
-  }
-
-  void recv_impl(block256 *data, const bool *b, int length) {
-    emp::BigInt *k = new emp::BigInt[length];
-    emp::Point *gr = new emp::Point[length];
-    emp::Point pk[2];
-    alignas(32) block256 m[2];
-    emp::Point C;
-    for (int i = 0; i < length; ++i)
-      G->get_rand_bn(k[i]);
+    });
+    io->send_pts(pk, length);
+    io->flush();
 
-    io->recv_pt(G, &C);
+    io->recv_pts(G, gr, length);
+    parallel_ec(length,
+                [&](int i, BN_CTX *ctx) { gr[i] = gr[i].mul(k[i], ctx); });
 
-    for (int i = 0; i < length; ++i) {
-      if (b[i]) {
-        pk[1] = G->mul_gen(k[i]);
-        emp::Point inv = pk[1].inv();
-        pk[0] = C.add(inv);
-      } else {
-        pk[0] = G->mul_gen(k[i]);
-      }
-      io->send_pt(&pk[0]);
-    }
-
-    for (int i = 0; i < length; ++i) {
-      io->recv_pt(G, &gr[i]);
-      gr[i] = gr[i].mul(k[i]);
-    }
+    T *m = new T[2 * length];
+    io->recv_data(m, 2 * length * sizeof(T));
     for (int i = 0; i < length; ++i) {
       int ind = b[i] ? 1 : 0;
-      io->recv_data(m, 2 * sizeof(block256));
-      data[i] = xorBlocks(m[ind], Hash::KDF256(gr[i]));
+      data[i] = xorBlocks(m[2 * i + ind], kdf(gr[i], m));
     }
+    delete[] m;
     delete[] k;
+    delete[] pk;
     delete[] gr;
   }
 };
@@ -21,196 +21,461 @@ SOFTWARE.
 
 #ifndef OT_UTIL_H__
 #define OT_UTIL_H__
+#include "OT/bit-pack.h"
 #include "OT/ot.h"
+#include "utils/ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace sci {
-template <typename basetype>
-void pack_ot_messages(basetype *y, basetype **data, block128 *pad, int ysize,
-                      int bsize, int bitsize, int N) {
-  assert(y != nullptr && data != nullptr && pad != nullptr);
-  uint64_t start_pos = 0;
-  uint64_t end_pos = 0;
-  uint64_t start_block = 0;
-  uint64_t end_block = 0;
-  basetype temp_bl = 0;
-  basetype mask = (1 << bitsize) - 1;
-  if (8 * sizeof(basetype) == 64) {
-    mask = (basetype)((1ULL << bitsize) - 1ULL);
-  }
-  if (8 * sizeof(basetype) == bitsize) {
-    if (bitsize == 64) {
-      mask = (basetype)(-1ULL);
-    } else {
-      mask = (basetype)(-1);
+// Runs f(i) for i in [0, n) on up to num_threads threads. The calling thread
+// takes part in the work.
+template <typename F> void ot_parallel_for(int n, int num_threads, F &&f) {
+  int nt = std::max(1, std::min(n, num_threads));
+  auto routine = [&](int t) {
+    for (int i = t; i < n; i += nt)
+      f(i);
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < nt; ++t)
+    threads.emplace_back(routine, t);
+  routine(0);
+  for (auto &t : threads)
+    t.join();
+}
+
+// Runs f(i) for i in [0, n) on the workers of pool and the calling thread.
+// With a null pool everything runs on the calling thread. Unlike the version
+// above no threads are created, so it suits loops that run many rounds.
+template <typename F> void ot_parallel_for(int n, ThreadPool *pool, F &&f) {
+  int nt = std::max(1, std::min(n, pool ? pool->size() + 1 : 1));
+  auto routine = [&](int t) {
+    for (int i = t; i < n; i += nt)
+      f(i);
+  };
+  std::vector<std::future<void>> done;
+  for (int t = 1; t < nt; ++t)
+    done.push_back(pool->enqueue(routine, t));
+  routine(0);
+  for (auto &d : done)
+    d.get();
+}
+
+// Number of heap allocations made by all OTBuffers so far. Once the buffers of
+// an OT instance have grown to the largest length it is called with, further
+// calls do not change it.
+inline std::atomic<uint64_t> &ot_buffer_allocs() {
+  static std::atomic<uint64_t> allocs(0);
+  return allocs;
+}
+
+/*
+  Element tags for OTBuffers of SIMD blocks. __m128i and __m256i lose their
+  attributes when used as template arguments (-Wignored-attributes), so
+  OTBuffer<Block128> hands out block128 pointers instead.
+*/
+struct Block128 {
+  typedef block128 type;
+};
+struct Block256 {
+  typedef block256 type;
+};
+template <typename T> struct OTBufferElem {
+  typedef T type;
+};
+template <> struct OTBufferElem<Block128> : Block128 {};
+template <> struct OTBufferElem<Block256> : Block256 {};
+
+/*
+  Growth-only scratch buffer for the OT extension arrays (qT, tT, pads, ...).
+  get(n) returns 64-byte aligned storage for at least n elements. The storage
+  is only reallocated when n exceeds the current capacity, and the old
+  contents are not preserved. It is released by the destructor.
+*/
+template <typename Elem> class OTBuffer {
+  typedef typename OTBufferElem<Elem>::type T;
+  static_assert(std::is_trivially_copyable<Elem>::value,
+                "OTBuffer only holds trivially copyable types");
+
+public:
+  OTBuffer() = default;
+  OTBuffer(const OTBuffer &) = delete;
+  OTBuffer &operator=(const OTBuffer &) = delete;
+  ~OTBuffer() { std::free(ptr); }
+
+  T *get(uint64_t n) {
+    if (n > cap) {
+      std::free(ptr);
+      uint64_t bytes = ((n * sizeof(T) + 63) / 64) * 64;
+      ptr = (T *)std::aligned_alloc(64, bytes);
+      if (ptr == nullptr) {
+        cap = 0;
+        throw std::bad_alloc();
+      }
+      cap = n;
+      ot_buffer_allocs()++;
     }
+    return ptr;
   }
-  uint64_t carriersize = 8 * (sizeof(basetype));
-  for (int i = 0; i < ysize; i++) {
-    y[i] = 0;
+
+  uint64_t capacity() const { return cap; }
+
+private:
+  T *ptr = nullptr;
+  uint64_t cap = 0;
+};
+
+/*
+  OT messages kept in one row-major buffer: row i (the N messages of OT i)
+  starts at base + i * stride. Indexes like a T ** table, so the send paths
+  take either.
+*/
+template <typename T> struct StridedRows {
+  const T *base;
+  int64_t stride;
+  StridedRows(const T *base, int64_t stride) : base(base), stride(stride) {}
+  const T *operator[](int64_t i) const { return base + i * stride; }
+  StridedRows operator+(int64_t i) const {
+    return StridedRows(base + i * stride, stride);
   }
-  for (int i = 0; i < bsize; i++) {
-    for (int k = 0; k < N; k++) {
-      // OT message k
-      start_pos = i * N * bitsize + k * bitsize; // inclusive
-      end_pos = start_pos + bitsize;
-      end_pos -= 1; // inclusive
-      start_block = start_pos / carriersize;
-      end_block = end_pos / carriersize;
-      if (carriersize == 64) {
-        if (start_block == end_block) {
-          y[start_block] ^=
-              ((((basetype)_mm_extract_epi64(pad[(N * i) + k], 0)) ^
-                data[i][k]) &
-               mask)
-              << (start_pos % carriersize);
-        } else {
-          temp_bl = ((((basetype)_mm_extract_epi64(pad[(N * i) + k], 0)) ^
-                      data[i][k]) &
-                     mask);
-          y[start_block] ^= (temp_bl) << (start_pos % carriersize);
-          y[end_block] ^=
-              (temp_bl) >> (carriersize - (start_pos % carriersize));
-        }
-      } else if (carriersize == 8) {
-        if (start_block == end_block) {
-          y[start_block] ^=
-              ((((basetype)_mm_extract_epi8(pad[(N * i) + k], 0)) ^
-                data[i][k]) &
-               mask)
-              << (start_pos % carriersize);
-        } else {
-          temp_bl = ((((basetype)_mm_extract_epi8(pad[(N * i) + k], 0)) ^
-                      data[i][k]) &
-                     mask);
-          y[start_block] ^= (temp_bl) << (start_pos % carriersize);
-          y[end_block] ^=
-              (temp_bl) >> (carriersize - (start_pos % carriersize));
-        }
-      } else {
-        throw std::invalid_argument("Not implemented");
-      }
+};
+
+/*
+  Stands in for the channel when an extension helper runs in the background:
+  send_data appends to buf and recv_data reads the next bytes of it. The
+  correction rows of a precomputed batch are recorded or replayed this way
+  and exchanged on the real channel in one message.
+*/
+struct OTCursorIO {
+  uint8_t *buf;
+  uint64_t pos = 0;
+  explicit OTCursorIO(uint8_t *buf) : buf(buf) {}
+  void send_data(const void *data, uint64_t nbyte) {
+    memcpy(buf + pos, data, nbyte);
+    pos += nbyte;
+  }
+  void recv_data(void *data, uint64_t nbyte) {
+    memcpy(data, buf + pos, nbyte);
+    pos += nbyte;
+  }
+};
+
+/*
+  One precomputed batch of a split OT: the hashes h/h64 (N rows for the
+  sender, 1 for the receiver), the receiver's random choices r_off, the
+  correction rows corr exchanged for the batch and the extension matrix.
+*/
+template <typename BlockT> struct PrecompSlot {
+  OTBuffer<uint8_t> h_buf, r_off_buf, corr_buf;
+  OTBuffer<uint64_t> h64_buf;
+  OTBuffer<BlockT> mat_buf;
+  std::vector<uint8_t *> h;
+  std::vector<uint64_t *> h64;
+  uint8_t *r_off = nullptr;
+
+  void map_rows(int rows, int batch_size) {
+    uint8_t *hb = h_buf.get((uint64_t)rows * batch_size);
+    uint64_t *h64b = h64_buf.get((uint64_t)rows * batch_size);
+    h.resize(rows);
+    h64.resize(rows);
+    for (int i = 0; i < rows; i++) {
+      h[i] = hb + (uint64_t)i * batch_size;
+      h64[i] = h64b + (uint64_t)i * batch_size;
     }
   }
-}
+};
 
-template <typename basetype>
-void unpack_ot_messages(basetype *data, const uint8_t *r, basetype *recvd,
-                        block128 *pad, int bsize, int bitsize, int N) {
-  assert(data != nullptr && recvd != nullptr && pad != nullptr);
-  uint64_t start_pos = 0;
-  uint64_t end_pos = 0;
-  uint64_t start_block = 0;
-  uint64_t end_block = 0;
-  basetype mask = (1 << bitsize) - 1;
-  if (8 * sizeof(basetype) == 64) {
-    mask = (basetype)((1ULL << bitsize) - 1ULL);
+// Reseed id of the background PRGs of start_precomp_thread. The PRG keys of
+// start e are the base-OT keys under id PRECOMP_PRG_DOMAIN | e, which no
+// small seed-derivation tag (OTPack::derive_seed) or plain reseed reaches.
+const uint64_t PRECOMP_PRG_DOMAIN = 1ULL << 63;
+
+// Smallest depth of a PrecompRing. With precomp_next_batch exchanging the
+// rows of batch j + 1 at the switch to batch j, the receiver's producer needs
+// a third slot to have batch j + 1 ready without stalling that switch.
+const int PRECOMP_MIN_DEPTH = 3;
+
+/*
+  Lock-free single-producer/single-consumer ring of depth precomputation
+  slots, filled by a background thread. Batch n lives in slot n % depth.
+  The producer computes batch n once the consumer has fed its input (only
+  if needs_input is set) and released batch n - depth. The consumer pops
+  batches in order and releases each one when it moves to the next.
+  All waits spin briefly and then back off to short sleeps. On Linux the
+  producer runs under SCHED_IDLE, so it never delays the online phase.
+  depth is raised to PRECOMP_MIN_DEPTH.
+*/
+template <typename Slot> class PrecompRing {
+public:
+  PrecompRing(const PrecompRing &) = delete;
+  PrecompRing &operator=(const PrecompRing &) = delete;
+
+  template <typename F>
+  PrecompRing(int depth, bool needs_input, F &&produce)
+      : depth(std::max(PRECOMP_MIN_DEPTH, depth)), needs_input(needs_input),
+        slots(new Slot[std::max(PRECOMP_MIN_DEPTH, depth)]) {
+    worker = std::thread([this, produce] {
+#ifdef __linux__
+      // Only use cycles the online phase leaves idle.
+      sched_param param = {};
+      pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+      for (uint64_t n = 0;; ++n) {
+        wait([&] {
+          return stop.load(std::memory_order_acquire) ||
+                 ((!this->needs_input ||
+                   fed.load(std::memory_order_acquire) > n) &&
+                  n - used.load(std::memory_order_acquire) <
+                      (uint64_t)this->depth);
+        });
+        if (stop.load(std::memory_order_acquire))
+          return;
+        produce(slot(n), n);
+        ready.store(n + 1, std::memory_order_release);
+      }
+    });
+  }
+
+  ~PrecompRing() {
+    stop.store(true, std::memory_order_release);
+    worker.join();
+  }
+
+  Slot &slot(uint64_t n) { return slots[n % depth]; }
+
+  // Consumer side.
+  void feed(uint64_t n) { fed.store(n + 1, std::memory_order_release); }
+  Slot &wait_ready(uint64_t n) {
+    wait([&] { return ready.load(std::memory_order_acquire) > n; });
+    return slot(n);
   }
-  if (8 * sizeof(basetype) == bitsize) {
-    if (bitsize == 64) {
-      mask = (basetype)(-1ULL);
+  void release(uint64_t n) { used.store(n + 1, std::memory_order_release); }
+
+  // Index of the next batch the consumer pops.
+  uint64_t next = 0;
+
+private:
+  template <typename P> static void wait(P &&pred) {
+    for (int spins = 0; !pred(); ++spins) {
+      if (spins < 1024)
+        std::this_thread::yield();
+      else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  const int depth;
+  const bool needs_input;
+  std::unique_ptr<Slot[]> slots;
+  std::atomic<uint64_t> fed{0}, ready{0}, used{0};
+  std::atomic<bool> stop{false};
+  std::thread worker;
+};
+
+/*
+  Consumer step of the background precomputation of the split OTs: moves to
+  the next batch j and exchanges correction rows one batch ahead (those of
+  batches 0 and 1 at the first step), so the sender's producer always has
+  the rows of the batch after the current one. The receiver sends the rows
+  its producer recorded, the sender receives them and feeds its producer.
+  Returns the slot of batch j once it is ready.
+  The receiver's producer may start batch j + 1 once batch j + 1 - depth is
+  released, i.e. at the switch to batch j + 2 - depth. With depth >= 3 that
+  is at least one batch before the rows of j + 1 are due here, so neither
+  party waits for a whole extension at a switch once the thread keeps up.
+*/
+template <typename IO, typename Slot>
+Slot &precomp_next_batch(IO *io, PrecompRing<Slot> &ring, bool sender,
+                         uint64_t corr_bytes) {
+  uint64_t j = ring.next++;
+  if (j > 0)
+    ring.release(j - 1);
+  for (uint64_t n = (j == 0) ? 0 : j + 1; n <= j + 1; ++n) {
+    if (sender) {
+      io->recv_data(ring.slot(n).corr_buf.get(corr_bytes), corr_bytes);
+      ring.feed(n);
     } else {
-      mask = (basetype)(-1);
+      io->send_data(ring.wait_ready(n).corr_buf.get(corr_bytes), corr_bytes);
     }
   }
-  uint64_t carriersize = 8 * (sizeof(basetype));
+  return ring.wait_ready(j);
+}
 
-  for (int i = 0; i < bsize; i++) {
-    start_pos = i * N * bitsize + r[i] * bitsize;
-    end_pos = start_pos + bitsize - 1; // inclusive
-    start_block = start_pos / carriersize;
-    end_block = end_pos / carriersize;
-    if (carriersize == 64) {
-      if (start_block == end_block) {
-        data[i] = ((recvd[start_block] >> (start_pos % carriersize)) ^
-                   ((basetype)_mm_extract_epi64(pad[i], 0))) &
-                  mask;
-      } else {
-        data[i] = 0;
-        data[i] ^= (recvd[start_block] >> (start_pos % carriersize));
-        data[i] ^=
-            (recvd[end_block] << (carriersize - (start_pos % carriersize)));
-        data[i] = (data[i] ^ ((basetype)_mm_extract_epi64(pad[i], 0))) & mask;
+/*
+  IKNP extension for the sender (see IKNP::send_pre).
+  The num_chunks chunks of block_size OTs are processed in waves of
+  num_threads chunks. The lambda correction rows of a wave are received with
+  a single recv_data into one contiguous buffer. Each thread then expands the
+  lambda PRGs for its chunk, starting from the PRG counter that chunk would
+  see in a serial loop, and transposes it into qT with its own scratch. The
+  PRG counters are advanced past all the chunks, so the transcript and the
+  output do not depend on num_threads. The num_threads - 1 worker threads are
+  created once per call and serve all the waves. msgs_buf and scratch_buf
+  are the caller's pooled buffers for the correction rows and the
+  untransposed chunk.
+*/
+template <typename IO>
+void iknp_send_pre_chunks(IO *io, PRG128 *G0, const bool *s, int lambda,
+                          int block_size, int num_chunks, block128 *qT,
+                          int num_threads, OTBuffer<Block128> &msgs_buf,
+                          OTBuffer<Block128> &scratch_buf) {
+  assert(lambda == 128);
+  const int row_blocks = block_size / 128;
+  const int chunk_blocks = lambda * row_blocks;
+  const int wave = std::max(1, std::min(num_threads, num_chunks));
+
+  uint64_t base[128];
+  for (int i = 0; i < lambda; ++i)
+    base[i] = G0[i].counter;
+
+  std::unique_ptr<ThreadPool> pool(wave > 1 ? new ThreadPool(wave - 1)
+                                            : nullptr);
+  block128 *msgs = msgs_buf.get((uint64_t)wave * chunk_blocks);
+  block128 *q = scratch_buf.get((uint64_t)wave * chunk_blocks);
+  for (int c0 = 0; c0 < num_chunks; c0 += wave) {
+    int cnt = std::min(wave, num_chunks - c0);
+    io->recv_data(msgs, (uint64_t)cnt * chunk_blocks * sizeof(block128));
+    ot_parallel_for(cnt, pool.get(), [&](int w) {
+      int j = c0 + w;
+      block128 *qw = q + (uint64_t)w * chunk_blocks;
+      block128 *mw = msgs + (uint64_t)w * chunk_blocks;
+      for (int i = 0; i < lambda; ++i) {
+        PRG128 g = G0[i];
+        g.counter = base[i] + (uint64_t)j * row_blocks;
+        g.random_data(qw + i * row_blocks, block_size / 8);
+        if (s[i])
+          xorBlocks_arr(qw + i * row_blocks, qw + i * row_blocks,
+                        mw + i * row_blocks, row_blocks);
       }
-    } else if (carriersize == 8) {
-      if (start_block == end_block) {
-        data[i] = ((recvd[start_block] >> (start_pos % carriersize)) ^
-                   ((basetype)_mm_extract_epi8(pad[i], 0))) &
-                  mask;
-      } else {
-        data[i] = 0;
-        data[i] ^= (recvd[start_block] >> (start_pos % carriersize));
-        data[i] ^=
-            (recvd[end_block] << (carriersize - (start_pos % carriersize)));
-        data[i] = (data[i] ^ ((basetype)_mm_extract_epi8(pad[i], 0))) & mask;
+      bit_trans((uint8_t *)(qT + (uint64_t)j * block_size), (uint8_t *)qw,
+                128, block_size);
+    });
+  }
+
+  for (int i = 0; i < lambda; ++i)
+    G0[i].counter = base[i] + (uint64_t)num_chunks * row_blocks;
+}
+
+/*
+  IKNP extension for the receiver (see IKNP::recv_pre).
+  Each thread computes the correction rows and the transposed tT for one
+  chunk of a wave, on the same per-call workers as the sender. The rows of
+  the wave are assembled in one contiguous buffer and sent with a single
+  send_data.
+*/
+template <typename IO>
+void iknp_recv_pre_chunks(IO *io, PRG128 *G0, PRG128 *G1,
+                          const block128 *block_r, int lambda, int block_size,
+                          int num_chunks, block128 *tT, int num_threads,
+                          OTBuffer<Block128> &msgs_buf,
+                          OTBuffer<Block128> &scratch_buf) {
+  assert(lambda == 128);
+  const int row_blocks = block_size / 128;
+  const int chunk_blocks = lambda * row_blocks;
+  const int wave = std::max(1, std::min(num_threads, num_chunks));
+
+  uint64_t base0[128], base1[128];
+  for (int i = 0; i < lambda; ++i) {
+    base0[i] = G0[i].counter;
+    base1[i] = G1[i].counter;
+  }
+
+  std::unique_ptr<ThreadPool> pool(wave > 1 ? new ThreadPool(wave - 1)
+                                            : nullptr);
+  block128 *msgs = msgs_buf.get((uint64_t)wave * chunk_blocks);
+  block128 *t = scratch_buf.get((uint64_t)wave * chunk_blocks);
+  for (int c0 = 0; c0 < num_chunks; c0 += wave) {
+    int cnt = std::min(wave, num_chunks - c0);
+    ot_parallel_for(cnt, pool.get(), [&](int w) {
+      int j = c0 + w;
+      block128 *tw = t + (uint64_t)w * chunk_blocks;
+      block128 *mw = msgs + (uint64_t)w * chunk_blocks;
+      for (int i = 0; i < lambda; ++i) {
+        PRG128 g0 = G0[i], g1 = G1[i];
+        g0.counter = base0[i] + (uint64_t)j * row_blocks;
+        g1.counter = base1[i] + (uint64_t)j * row_blocks;
+        g0.random_data(tw + i * row_blocks, block_size / 8);
+        g1.random_data(mw + i * row_blocks, block_size / 8);
+        xorBlocks_arr(mw + i * row_blocks, tw + i * row_blocks,
+                      mw + i * row_blocks, row_blocks);
+        xorBlocks_arr(mw + i * row_blocks, block_r + (uint64_t)j * row_blocks,
+                      mw + i * row_blocks, row_blocks);
+      }
+      bit_trans((uint8_t *)(tT + (uint64_t)j * block_size), (uint8_t *)tw,
+                128, block_size);
+    });
+    io->send_data(msgs, (uint64_t)cnt * chunk_blocks * sizeof(block128));
+  }
+
+  for (int i = 0; i < lambda; ++i) {
+    G0[i].counter = base0[i] + (uint64_t)num_chunks * row_blocks;
+    G1[i].counter = base1[i] + (uint64_t)num_chunks * row_blocks;
+  }
+}
+
+template <typename basetype, typename Rows = basetype **>
+void pack_ot_messages(basetype *y, Rows data, block128 *pad, int ysize,
+                      int bsize, int bitsize, int N) {
+  assert(y != nullptr && pad != nullptr);
+  static_assert(sizeof(basetype) == 1 || sizeof(basetype) == 8,
+                "Not implemented");
+  const uint64_t mask = bit_mask(bitsize);
+  dispatch_bit_width(bitsize, [&](auto W) {
+    BitWriter<decltype(W)::value> bw((uint8_t *)y, bitsize);
+    for (int i = 0; i < bsize; i++) {
+      for (int k = 0; k < N; k++) {
+        // OT message k
+        uint64_t p = (uint64_t)_mm_extract_epi64(pad[(N * i) + k], 0);
+        bw.put((p ^ (uint64_t)data[i][k]) & mask);
       }
-    } else {
-      throw std::invalid_argument("Not implemented");
     }
+    bw.finish((uint8_t *)(y + ysize));
+  });
+}
+
+template <typename basetype>
+void unpack_ot_messages(basetype *data, const uint8_t *r, basetype *recvd,
+                        block128 *pad, int bsize, int bitsize, int N) {
+  assert(data != nullptr && recvd != nullptr && pad != nullptr);
+  static_assert(sizeof(basetype) == 1 || sizeof(basetype) == 8,
+                "Not implemented");
+  const uint64_t carriersize = 8 * sizeof(basetype);
+  const uint64_t nbytes =
+      ((uint64_t)bsize * N * bitsize + carriersize - 1) / carriersize *
+      sizeof(basetype);
+  const uint64_t mask = bit_mask(bitsize);
+  for (int i = 0; i < bsize; i++) {
+    uint64_t pos = ((uint64_t)i * N + r[i]) * bitsize;
+    uint64_t p = (uint64_t)_mm_extract_epi64(pad[i], 0);
+    data[i] = (basetype)((read_bits((const uint8_t *)recvd, nbytes, pos,
+                                    bitsize) ^
+                          p) &
+                         mask);
   }
 }
 
 inline void pack_cot_messages(uint64_t *y, uint64_t *corr_data, int ysize,
                               int bsize, int bitsize) {
   assert(y != nullptr && corr_data != nullptr);
-  uint64_t start_pos = 0;
-  uint64_t end_pos = 0;
-  uint64_t start_block = 0;
-  uint64_t end_block = 0;
-  uint64_t temp_bl = 0;
-  uint64_t mask = (1ULL << bitsize) - 1;
-  if (bitsize == 64)
-    mask = -1;
-
-  uint64_t carriersize = 64;
-  for (int i = 0; i < ysize; i++) {
-    y[i] = 0;
-  }
-  for (int i = 0; i < bsize; i++) {
-    start_pos = i * bitsize; // inclusive
-    end_pos = start_pos + bitsize;
-    end_pos -= 1; // inclusive
-    start_block = start_pos / carriersize;
-    end_block = end_pos / carriersize;
-    if (carriersize == 64) {
-      if (start_block == end_block) {
-        y[start_block] ^= (corr_data[i] & mask) << (start_pos % carriersize);
-      } else {
-        temp_bl = (corr_data[i] & mask);
-        y[start_block] ^= (temp_bl) << (start_pos % carriersize);
-        y[end_block] ^= (temp_bl) >> (carriersize - (start_pos % carriersize));
-      }
-    }
-  }
+  pack_bits((uint8_t *)y, (uint64_t)ysize * sizeof(uint64_t), corr_data,
+            bsize, bitsize);
 }
 
 inline void unpack_cot_messages(uint64_t *corr_data, uint64_t *recvd, int bsize,
                                 int bitsize) {
   assert(corr_data != nullptr && recvd != nullptr);
-  uint64_t start_pos = 0;
-  uint64_t end_pos = 0;
-  uint64_t start_block = 0;
-  uint64_t end_block = 0;
-  uint64_t mask = (1ULL << bitsize) - 1;
-  if (bitsize == 64)
-    mask = -1;
-  uint64_t carriersize = 64;
-
-  for (int i = 0; i < bsize; i++) {
-    start_pos = i * bitsize;
-    end_pos = start_pos + bitsize - 1; // inclusive
-    start_block = start_pos / carriersize;
-    end_block = end_pos / carriersize;
-    if (carriersize == 64) {
-      if (start_block == end_block) {
-        corr_data[i] = (recvd[start_block] >> (start_pos % carriersize)) & mask;
-      } else {
-        corr_data[i] = 0;
-        corr_data[i] ^= (recvd[start_block] >> (start_pos % carriersize));
-        corr_data[i] ^=
-            (recvd[end_block] << (carriersize - (start_pos % carriersize)));
-      }
-    }
-  }
+  unpack_bits(corr_data, (const uint8_t *)recvd, bsize, bitsize);
 }
 } // namespace sci
 
@@ -61,6 +61,10 @@ public:
   void send(uint8_t **data, int length, int l) {
     static_cast<T *>(this)->send_impl(data, length, l);
   }
+  // Same as above with the messages of OT i at data + i * stride.
+  void send(const uint8_t *data, int stride, int length, int l) {
+    static_cast<T *>(this)->send_impl(data, stride, length, l);
+  }
   void recv(uint8_t *data, const uint8_t *b, int length, int l) {
     static_cast<T *>(this)->recv_impl(data, b, length, l);
   }
@@ -23,8 +23,15 @@ SOFTWARE.
 #define OT_PACK_H__
 #include "OT/emp-ot.h"
 #include "utils/emp-tool.h"
+#include "utils/sealed_file.h"
+#include <string>
+#include <thread>
+#include <vector>
 
 #define KKOT_TYPES 8
+// PRG counters of a resumed OTPack start at a multiple of this stride, above
+// everything the sessions of the saved setup could have used (see LoadSetup).
+#define OT_RESUME_STRIDE (1ULL << 40)
 
 namespace sci {
 class OTPack {
@@ -39,18 +46,33 @@ public:
   IOPack *iopack;
   int party;
   bool do_setup = false;
+  // If set, SetupBaseOTs runs a single set of base OTs on io and derives the
+  // seeds of the other io-side instances from it (see DeriveBaseOTs), while
+  // iknp_reversed runs its base OTs concurrently on io_rev. Otherwise every
+  // instance runs its own base OTs one after another, as before the derived
+  // mode was added; callers opt in to it. Both parties must use the same mode.
+  bool derive_setup = false;
+  // Protocol used for the base OTs (see OT/base-ot.h). Both parties must use
+  // the same one.
+  BaseOTKind base_ot_kind = BASE_OT_NP;
 
-  OTPack(IOPack *iopack, int party, bool do_setup = true) {
+  OTPack(IOPack *iopack, int party, bool do_setup = true,
+         bool derive_setup = false, BaseOTKind base_ot_kind = BASE_OT_NP) {
     this->party = party;
     this->do_setup = do_setup;
+    this->derive_setup = derive_setup;
+    this->base_ot_kind = base_ot_kind;
     this->iopack = iopack;
 
     for (int i = 0; i < KKOT_TYPES; i++) {
       kkot[i] = new SplitKKOT<NetIO>(party, iopack->io, 1 << (i + 1));
+      kkot[i]->base_ot->set_kind(base_ot_kind);
     }
 
     iknp_straight = new SplitIKNP<NetIO>(party, iopack->io);
     iknp_reversed = new SplitIKNP<NetIO>(3 - party, iopack->io_rev);
+    iknp_straight->base_ot->set_kind(base_ot_kind);
+    iknp_reversed->base_ot->set_kind(base_ot_kind);
 
     if (do_setup) {
       SetupBaseOTs();
@@ -65,6 +87,10 @@ public:
   }
 
   void SetupBaseOTs() {
+    if (derive_setup) {
+      SetupBaseOTsDerived();
+      return;
+    }
     switch (party) {
     case 1:
       kkot[0]->setup_send();
@@ -85,6 +111,174 @@ public:
     }
   }
 
+  /*
+   * Setup with one base-OT run per channel. kkot[0] runs the base OTs on io
+   * and the remaining io-side instances are derived from it, so the setup
+   * costs a constant number of rounds instead of one base-OT protocol per
+   * instance. iknp_reversed needs base OTs in the other direction and runs
+   * them on io_rev in a second thread.
+   */
+  void SetupBaseOTsDerived() {
+    std::thread rev([this] {
+      if (party == ALICE)
+        iknp_reversed->setup_recv();
+      else
+        iknp_reversed->setup_send();
+    });
+    if (party == ALICE)
+      kkot[0]->setup_send();
+    else
+      kkot[0]->setup_recv();
+    DeriveBaseOTs();
+    rev.join();
+  }
+
+  /*
+   * Seeds kkot[1..KKOT_TYPES-1] and iknp_straight from the base OTs of
+   * kkot[0]. Instance t gets, for every base-OT key k of kkot[0], the first
+   * block of PRG256(k, t), and the sender keeps the choice bits of kkot[0].
+   * iknp_straight uses the first 128 base OTs with the keys truncated to
+   * 128 bits. Unlike copy(), no two instances share a PRG stream.
+   */
+  void DeriveBaseOTs() {
+    SplitKKOT<NetIO> *base = kkot[0];
+    const int lambda = base->lambda;
+    const int iknp_lambda = iknp_straight->lambda;
+    block256 *dk0 = new block256[lambda];
+    block256 *dk1 = new block256[lambda];
+    block128 *ik0 = new block128[iknp_lambda];
+    block128 *ik1 = new block128[iknp_lambda];
+
+    for (int t = 1; t <= KKOT_TYPES; t++) {
+      for (int i = 0; i < lambda; i++) {
+        dk0[i] = derive_seed(&base->k0[i], t);
+        if (party == BOB)
+          dk1[i] = derive_seed(&base->k1[i], t);
+      }
+      if (t < KKOT_TYPES) {
+        if (party == ALICE)
+          kkot[t]->setup_send(dk0, base->s);
+        else
+          kkot[t]->setup_recv(dk0, dk1);
+      } else {
+        for (int i = 0; i < iknp_lambda; i++) {
+          ik0[i] = _mm256_castsi256_si128(dk0[i]);
+          if (party == BOB)
+            ik1[i] = _mm256_castsi256_si128(dk1[i]);
+        }
+        if (party == ALICE)
+          iknp_straight->setup_send(ik0, base->s);
+        else
+          iknp_straight->setup_recv(ik0, ik1);
+      }
+    }
+    delete[] dk0;
+    delete[] dk1;
+    delete[] ik0;
+    delete[] ik1;
+  }
+
+  static block256 derive_seed(const block256 *key, int tag) {
+    PRG256 prg(key, tag);
+    alignas(32) block256 seed;
+    prg.random_block(&seed, 1);
+    return seed;
+  }
+
+  static block128 derive_seed(const block128 *key, int tag) {
+    PRG128 prg(key, tag);
+    block128 seed;
+    prg.random_block(&seed, 1);
+    return seed;
+  }
+
+  /*
+   * Sets up this pack from the keys of base without any base OTs, e.g. to
+   * give each worker thread its own pack and channel. Unlike copy(), every
+   * key of base is first mapped through derive_seed with a tag made of
+   * index and the instance, so packs derived with different indices never
+   * share a PRG stream with each other or with base. Both parties must
+   * derive with the same index.
+   */
+  void DeriveFrom(OTPack *base, int index) {
+    assert(!do_setup && base->do_setup && base->party == party);
+    const int tag0 = (index + 1) * (KKOT_TYPES + 2);
+    for (int i = 0; i < KKOT_TYPES; i++)
+      DeriveKeys(kkot[i], base->kkot[i], party == ALICE, tag0 + i);
+    DeriveKeys(iknp_straight, base->iknp_straight, party == ALICE,
+               tag0 + KKOT_TYPES);
+    DeriveKeys(iknp_reversed, base->iknp_reversed, party == BOB,
+               tag0 + KKOT_TYPES + 1);
+    this->do_setup = true;
+  }
+
+  /*
+   * Writes the base-OT keys of all instances, the choice bits of the sender
+   * instances and the largest PRG counter in use to a file sealed with key
+   * (see utils/sealed_file.h), so that a later process can resume this
+   * setup with LoadSetup instead of running base OTs. Returns false if the
+   * file could not be written.
+   */
+  bool SaveSetup(const std::string &path, const block128 &key) {
+    assert(do_setup);
+    return write_sealed_file(path, key, SerializeSetup(MaxPRGCounter()));
+  }
+
+  /*
+   * Resumes a setup written by SaveSetup. Both parties call it, with files
+   * saved at the same point, and learn in one exchange on io whether the
+   * other side loaded its file too. If either side failed (missing file,
+   * wrong key, different pack layout) both return false without touching the
+   * pack, and the caller falls back to SetupBaseOTs.
+   * The PRG counters resume at the next multiple of OT_RESUME_STRIDE above
+   * the larger saved counter of the two parties, and the file is rewritten
+   * with that counter before returning. A session that ends without saving
+   * is thus never replayed by the next resume. Precomputed OTs of the saved
+   * session are not restored.
+   */
+  bool LoadSetup(const std::string &path, const block128 &key) {
+    std::vector<uint8_t> data;
+    uint64_t saved_counter = 0;
+    bool ok = read_sealed_file(path, key, data) &&
+              DeserializeSetup(data, false, saved_counter);
+
+    uint64_t mine[2] = {ok, (saved_counter / OT_RESUME_STRIDE + 1) *
+                                OT_RESUME_STRIDE};
+    uint64_t theirs[2];
+    if (party == ALICE) {
+      iopack->io->send_data(mine, sizeof(mine));
+      iopack->io->recv_data(theirs, sizeof(theirs));
+    } else {
+      iopack->io->recv_data(theirs, sizeof(theirs));
+      iopack->io->send_data(mine, sizeof(mine));
+      iopack->io->flush();
+    }
+    if (!ok || !theirs[0])
+      return false;
+
+    // Background batches were derived from the keys being replaced.
+    for (int i = 0; i < KKOT_TYPES; i++)
+      kkot[i]->stop_precomp_thread();
+    iknp_straight->stop_precomp_thread();
+    iknp_reversed->stop_precomp_thread();
+    DeserializeSetup(data, true, saved_counter);
+    uint64_t resume_counter = std::max(mine[1], theirs[1]);
+    for (int i = 0; i < KKOT_TYPES; i++) {
+      SetPRGCounters(kkot[i], resume_counter);
+      kkot[i]->counter = kkot[i]->precomp_batch_size;
+      kkot[i]->precomp_masks = false;
+    }
+    SetPRGCounters(iknp_straight, resume_counter);
+    SetPRGCounters(iknp_reversed, resume_counter);
+    iknp_straight->counter = iknp_straight->precomp_batch_size;
+    iknp_reversed->counter = iknp_reversed->precomp_batch_size;
+    this->do_setup = true;
+
+    if (!write_sealed_file(path, key, SerializeSetup(resume_counter)))
+      throw std::runtime_error("OTPack: could not rewrite " + path);
+    return true;
+  }
+
   /*
    * DISCLAIMER:
    * OTPack copy method avoids computing setup keys for each OT instance by
@@ -119,6 +313,127 @@ public:
     this->do_setup = true;
     return;
   }
+
+private:
+  // Layout: party, KKOT_TYPES, PRG counter, then for every kkot (with its
+  // N), iknp_straight and iknp_reversed the keys k0 followed by the choice
+  // bits s for a sender instance or the keys k1 for a receiver instance.
+  std::vector<uint8_t> SerializeSetup(uint64_t prg_counter) {
+    std::vector<uint8_t> out;
+    uint32_t hdr[2] = {(uint32_t)party, KKOT_TYPES};
+    Append(out, hdr, sizeof(hdr));
+    Append(out, &prg_counter, sizeof(prg_counter));
+    for (int i = 0; i < KKOT_TYPES; i++) {
+      uint32_t N = kkot[i]->N;
+      Append(out, &N, sizeof(N));
+      AppendKeys(out, kkot[i], party == ALICE);
+    }
+    AppendKeys(out, iknp_straight, party == ALICE);
+    AppendKeys(out, iknp_reversed, party == BOB);
+    return out;
+  }
+
+  // Checks the layout of data and, if apply is set, sets up every instance
+  // from it. Returns false if data does not match this pack.
+  bool DeserializeSetup(const std::vector<uint8_t> &data, bool apply,
+                        uint64_t &prg_counter) {
+    const uint8_t *p = data.data(), *end = data.data() + data.size();
+    uint32_t hdr[2];
+    if (!Read(p, end, hdr, sizeof(hdr)) || hdr[0] != (uint32_t)party ||
+        hdr[1] != KKOT_TYPES ||
+        !Read(p, end, &prg_counter, sizeof(prg_counter)))
+      return false;
+    for (int i = 0; i < KKOT_TYPES; i++) {
+      uint32_t N;
+      if (!Read(p, end, &N, sizeof(N)) || N != (uint32_t)kkot[i]->N ||
+          !ReadKeys(p, end, kkot[i], party == ALICE, apply))
+        return false;
+    }
+    return ReadKeys(p, end, iknp_straight, party == ALICE, apply) &&
+           ReadKeys(p, end, iknp_reversed, party == BOB, apply) && p == end;
+  }
+
+  static void Append(std::vector<uint8_t> &out, const void *src, size_t n) {
+    out.insert(out.end(), (const uint8_t *)src, (const uint8_t *)src + n);
+  }
+
+  static bool Read(const uint8_t *&p, const uint8_t *end, void *dst,
+                   size_t n) {
+    if ((size_t)(end - p) < n)
+      return false;
+    memcpy(dst, p, n);
+    p += n;
+    return true;
+  }
+
+  template <typename OTType>
+  static void AppendKeys(std::vector<uint8_t> &out, OTType *ot, bool sender) {
+    size_t key_bytes = ot->lambda * sizeof(*ot->k0);
+    Append(out, ot->k0, key_bytes);
+    if (sender)
+      Append(out, ot->s, ot->lambda);
+    else
+      Append(out, ot->k1, key_bytes);
+  }
+
+  template <typename OTType>
+  static bool ReadKeys(const uint8_t *&p, const uint8_t *end, OTType *ot,
+                       bool sender, bool apply) {
+    typedef decltype(ot->k0) KeyPtr; // block128 * or block256 *
+    size_t key_bytes = ot->lambda * sizeof(*ot->k0);
+    size_t n = key_bytes + (sender ? ot->lambda : key_bytes);
+    OTBuffer<uint8_t> buf; // aligned copy for setup_send/setup_recv
+    uint8_t *keys = buf.get(n);
+    if (!Read(p, end, keys, n))
+      return false;
+    if (apply) {
+      if (sender)
+        ot->setup_send((KeyPtr)keys, (bool *)(keys + key_bytes));
+      else
+        ot->setup_recv((KeyPtr)keys, (KeyPtr)(keys + key_bytes));
+    }
+    return true;
+  }
+
+  template <typename OTType>
+  static void DeriveKeys(OTType *dst, OTType *src, bool sender, int tag) {
+    OTBuffer<uint8_t> buf; // aligned for setup_send/setup_recv
+    auto k0 = (decltype(src->k0))buf.get(2 * src->lambda * sizeof(*src->k0));
+    auto k1 = k0 + src->lambda;
+    for (int i = 0; i < src->lambda; i++) {
+      k0[i] = derive_seed(&src->k0[i], tag);
+      if (!sender)
+        k1[i] = derive_seed(&src->k1[i], tag);
+    }
+    if (sender)
+      dst->setup_send(k0, src->s);
+    else
+      dst->setup_recv(k0, k1);
+  }
+
+  template <typename OTType>
+  static uint64_t MaxPRGCounter(OTType *ot, uint64_t max_counter) {
+    for (int i = 0; i < ot->lambda; i++)
+      max_counter =
+          std::max(max_counter, std::max(ot->G0[i].counter, ot->G1[i].counter));
+    return max_counter;
+  }
+
+  uint64_t MaxPRGCounter() {
+    uint64_t max_counter = 0;
+    for (int i = 0; i < KKOT_TYPES; i++)
+      max_counter = MaxPRGCounter(kkot[i], max_counter);
+    max_counter = MaxPRGCounter(iknp_straight, max_counter);
+    return MaxPRGCounter(iknp_reversed, max_counter);
+  }
+
+  template <typename OTType>
+  static void SetPRGCounters(OTType *ot, uint64_t counter) {
+    for (int i = 0; i < ot->lambda; i++) {
+      ot->G0[i].counter = counter;
+      ot->G1[i].counter = counter;
+    }
+  }
 };
 } // namespace sci
 #endif // OT_PACK_H__
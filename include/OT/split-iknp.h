@@ -25,7 +25,7 @@ SOFTWARE.
 // In split functions, OT is split
 // into offline and online phase.
 
-#include "OT/np.h"
+#include "OT/base-ot.h"
 #include "OT/ot-utils.h"
 #include "OT/ot.h"
 #include "split-utils.h"
@@ -33,7 +33,7 @@ SOFTWARE.
 namespace sci {
 template <typename IO> class SplitIKNP : public OT<SplitIKNP<IO>> {
 public:
-  OTNP<IO> *base_ot;  // using noar-pinkas for base OTs
+  BaseOT<IO> *base_ot;  // naor-pinkas unless set_kind is called
   PRG128 prg;
   int party;
   const int lambda = 128;
@@ -46,9 +46,20 @@ public:
   // counter denotes the number of pre-generated OTs used
   int counter = precomp_batch_size;
   int l;
+  // number of threads used to generate the extension matrix in
+  // send_pre/recv_pre. The transcript does not depend on it.
+  int num_threads = 1;
 
   block128 *k0 = nullptr, *k1 = nullptr, *qT = nullptr, *tT = nullptr,
            *tmp = nullptr, block_s;
+  // pooled storage behind qT/tT, h/h64/r_off and the per-call scratch
+  // arrays. They only grow, so steady-state calls do not allocate.
+  OTBuffer<Block128> qT_buf, tT_buf, block_r_buf, msgs_buf, scratch_buf,
+      pad_buf, y_blk0_buf, y_blk1_buf;
+  OTBuffer<uint8_t> h_buf, r_off_buf, y0_buf, y1_buf, masked_buf;
+  OTBuffer<uint64_t> h64_buf;
+  OTBuffer<void *> masked_rows_buf;
+  OTBuffer<bool> r2_buf;
   PRG128 *G0, *G1;
   bool *s = nullptr, *extended_r = nullptr, setup = false;
   IO *io = nullptr;
@@ -63,35 +74,28 @@ public:
   // This is corrected in the online phase when actual choice_input comes.
   uint8_t *r_off;
   int N = 2;       // the number of unique choices (1-out-of-N OTs)
+
+  // Background precomputation (see start_precomp_thread). The producer
+  // thread only touches the bg_* members and the slots of the ring.
+  PrecompRing<PrecompSlot<Block128>> *precomp_ring = nullptr;
+  int precomp_depth = 0, precomp_epoch = 0;
+  int bg_block_size = 0, bg_length = 0;
+  PRG128 *BG0 = nullptr, *BG1 = nullptr, bg_prg;
+  OTBuffer<Block128> bg_msgs_buf, bg_scratch_buf, bg_pad_buf, bg_block_r_buf;
+
   SplitIKNP(int party, IO *io) {
     assert(party == ALICE || party == BOB);
     this->party = party;
     this->io = io;
-    base_ot = new OTNP<IO>(io);// set up np on same network
+    base_ot = new BaseOT<IO>(io);// base OTs on same network
     s = new bool[lambda];      // choice bits for base_ot
     k0 = new block128[lambda]; // lambda messages for choice 0 each of size 128
     k1 = new block128[lambda]; // lambda messages for choice 1 each of size 128
-    switch (party) {
-    case ALICE: { // sender
-      h = new uint8_t *[N];   // N masks per OT
-      h64 = new uint64_t *[N];
-      for (int i = 0; i < N; i++) {
-        h[i] = new uint8_t[precomp_batch_size]; // precomp_batch_size OTs
-        h64[i] = new uint64_t[precomp_batch_size];
-      }
-      break;
-    }
-    case BOB: {  // receiver
-      h = new uint8_t *[1];   // 1 masks per OT
-      h64 = new uint64_t *[1];
-      r_off = new uint8_t[precomp_batch_size];  // bob picks random choices
-      for (int i = 0; i < 1; i++) {
-        h[i] = new uint8_t[precomp_batch_size]; // precomp_batch_size OTs
-        h64[i] = new uint64_t[precomp_batch_size];
-      }
-      break;
-    }
-    }
+    // N masks per OT for the sender, 1 for the receiver
+    h = new uint8_t *[N];
+    h64 = new uint64_t *[N];
+    r_off = nullptr;
+    map_precomp_rows();
     G0 = new PRG128[lambda];
     G1 = new PRG128[lambda];
     tmp = new block128[block_size / 128];
@@ -99,75 +103,131 @@ public:
   }
 
   ~SplitIKNP() {
+    stop_precomp_thread();
+    delete[] BG0;
+    delete[] BG1;
     delete base_ot;
     delete[] s;
     delete[] k0;
     delete[] k1;
-    switch (party) {
-    case ALICE: {
-      for (int i = 0; i < N; i++) {
-        delete[] h[i];
-        delete[] h64[i];
-      }
-      delete[] h;
-      delete[] h64;
-      break;
-    }
-    case BOB: {
-      delete[] h[0];
-      delete[] h;
-      delete[] h64[0];
-      delete[] h64;
-      delete[] r_off;
-      break;
-    }
-    }
+    delete[] h;
+    delete[] h64;
     delete[] G0;
     delete[] G1;
     delete[] tmp;
     delete[] extended_r;
   }
 
+  // Points the rows of h/h64 (and r_off for the receiver) at pooled storage
+  // for precomp_batch_size OTs. The storage only grows, so resizing the batch
+  // back and forth does not allocate.
+  void map_precomp_rows() {
+    int rows = (party == ALICE) ? N : 1;
+    uint8_t *hb = h_buf.get((uint64_t)rows * precomp_batch_size);
+    uint64_t *h64b = h64_buf.get((uint64_t)rows * precomp_batch_size);
+    for (int i = 0; i < rows; i++) {
+      h[i] = hb + (uint64_t)i * precomp_batch_size;
+      h64[i] = h64b + (uint64_t)i * precomp_batch_size;
+    }
+    if (party == BOB)
+      r_off = r_off_buf.get(precomp_batch_size); // bob picks random choices
+  }
+
+  // Restarts the background thread, if one is running, for the new size.
   void set_precomp_batch_size(int batch_size) {
+    int depth = precomp_depth;
+    stop_precomp_thread();
     this->precomp_batch_size = batch_size;
     this->counter = batch_size;
-    switch (party) {
-    case ALICE: {
-      for (int i = 0; i < N; i++) {
-        delete[] h[i];
-        delete[] h64[i];
-      }
-      delete[] h;
-      delete[] h64;
-      break;
-    }
-    case BOB: {
-      delete[] h[0];
-      delete[] h;
-      delete[] h64[0];
-      delete[] h64;
-      delete[] r_off;
-      break;
+    map_precomp_rows();
+    if (depth > 0 && batch_size > 0)
+      start_precomp_thread(depth);
+  }
+
+  /*
+    Moves the precomputation of the online GOT batches to a background
+    thread that keeps up to depth batches ready, so that an online call
+    that runs out of precomputed OTs only switches to the next batch. The
+    thread uses its own PRG streams, derived from the base-OT keys for each
+    start, and the correction rows of batch j + 1 are exchanged on io when
+    the parties switch to batch j. Both parties must start and stop it at
+    the same point of their OT sequences. Runs the base OTs if setup has not
+    been done yet.
+  */
+  void start_precomp_thread(int depth = PRECOMP_MIN_DEPTH) {
+    assert(precomp_batch_size > 0);
+    stop_precomp_thread();
+    if (!setup) {
+      if (party == ALICE)
+        setup_send();
+      else
+        setup_recv();
     }
+    precomp_depth = std::max(PRECOMP_MIN_DEPTH, depth);
+    ++precomp_epoch;
+    if (BG0 == nullptr) {
+      BG0 = new PRG128[lambda];
+      BG1 = new PRG128[lambda];
     }
-    switch (party) {
-    case ALICE:
-      h = new uint8_t *[N];
-      h64 = new uint64_t *[N];
-      for (int i = 0; i < N; i++) {
-        h[i] = new uint8_t[precomp_batch_size];
-        h64[i] = new uint64_t[precomp_batch_size];
-      }
-      break;
-    case BOB:
-      h = new uint8_t *[1];
-      h64 = new uint64_t *[1];
-      r_off = new uint8_t[precomp_batch_size];
-      for (int i = 0; i < 1; i++) {
-        h[i] = new uint8_t[precomp_batch_size];
-        h64[i] = new uint64_t[precomp_batch_size];
+    for (int i = 0; i < lambda; ++i) {
+      BG0[i].reseed(&k0[i], PRECOMP_PRG_DOMAIN | precomp_epoch);
+      BG0[i].counter = G0[i].counter;
+      if (party == BOB) {
+        BG1[i].reseed(&k1[i], PRECOMP_PRG_DOMAIN | precomp_epoch);
+        BG1[i].counter = G1[i].counter;
       }
-      break;
+    }
+    bg_block_size =
+        std::min(block_size, int(ceil(precomp_batch_size / 256.0)) * 256);
+    bg_length = ((precomp_batch_size + bg_block_size - 1) / bg_block_size) *
+                bg_block_size;
+    precomp_ring = new PrecompRing<PrecompSlot<Block128>>(
+        depth, party == ALICE,
+        [this](PrecompSlot<Block128> &slot, uint64_t) {
+          precompute_batch(slot);
+        });
+    counter = precomp_batch_size;
+  }
+
+  // Discards the batches of the background thread and goes back to
+  // computing them in preprocess().
+  void stop_precomp_thread() {
+    if (precomp_ring == nullptr)
+      return;
+    delete precomp_ring;
+    precomp_ring = nullptr;
+    precomp_depth = 0;
+    map_precomp_rows();
+    counter = precomp_batch_size;
+  }
+
+  // Producer side: extends bg_length OTs with the background PRGs, with
+  // the correction rows of the batch recorded into (receiver) or replayed
+  // from (sender) slot.corr_buf, and hashes them into the slot.
+  void precompute_batch(PrecompSlot<Block128> &slot) {
+    const int rows = (party == ALICE) ? N : 1;
+    slot.map_rows(rows, precomp_batch_size);
+    block128 *mat = slot.mat_buf.get(bg_length);
+    OTCursorIO ch(slot.corr_buf.get((uint64_t)bg_length * lambda / 8));
+    if (party == ALICE) {
+      iknp_send_pre_chunks(&ch, BG0, s, lambda, bg_block_size,
+                           bg_length / bg_block_size, mat, 1, bg_msgs_buf,
+                           bg_scratch_buf);
+      got_send_offline(mat, slot.h.data(), slot.h64.data(), bg_pad_buf,
+                       precomp_batch_size);
+    } else {
+      slot.r_off = slot.r_off_buf.get(bg_length);
+      bg_prg.random_data(slot.r_off, bg_length);
+      for (int i = 0; i < bg_length; i++)
+        slot.r_off[i] &= (N - 1);
+      block128 *block_r = bg_block_r_buf.get(bg_length / 128);
+      for (int i = 0; i < bg_length / 128; ++i)
+        block_r[i] = bool_to128((bool *)slot.r_off + i * 128);
+      iknp_recv_pre_chunks(&ch, BG0, BG1, block_r, lambda, bg_block_size,
+                           bg_length / bg_block_size, mat, 1, bg_msgs_buf,
+                           bg_scratch_buf);
+      got_recv_offline(mat, slot.h.data(), slot.h64.data(), bg_pad_buf,
+                       precomp_batch_size);
     }
   }
 
@@ -231,22 +291,12 @@ public:
     this->block_size =
         std::min(old_block_size, int(ceil(length / 256.0)) * 256);
     length = padded_length(length);
-    block128 q[block_size];
-    qT = new block128[length];
+    qT = qT_buf.get(length);
     if (!setup)
       setup_send();
 
-    for (int j = 0; j < length / block_size; ++j) {
-      for (int i = 0; i < lambda; ++i) {
-        G0[i].random_data(q + (i * block_size / 128), block_size / 8);
-        io->recv_data(tmp, block_size / 8);
-        if (s[i])
-          xorBlocks_arr(q + (i * block_size / 128), q + (i * block_size / 128),
-                        tmp, block_size / 128);
-      }
-      sse_trans((uint8_t *)(qT + j * block_size), (uint8_t *)q, 128,
-                block_size);
-    }
+    iknp_send_pre_chunks(io, G0, s, lambda, block_size, length / block_size,
+                         qT, num_threads, msgs_buf, scratch_buf);
     this->block_size = old_block_size;
   }
 
@@ -263,37 +313,24 @@ public:
         std::min(old_block_size, int(ceil(length / 256.0)) * 256);
     int old_length = length;
     length = padded_length(length);
-    block128 t[block_size];
-    tT = new block128[length];
+    tT = tT_buf.get(length);
 
     if (not setup)
       setup_recv();
 
-    bool *r2 = new bool[length];
+    bool *r2 = r2_buf.get(length);
     prg.random_bool(extended_r, block_size);
     memcpy(r2, r, old_length);
     memcpy(r2 + old_length, extended_r, length - old_length);
 
-    block128 *block_r = new block128[length / 128];
+    block128 *block_r = block_r_buf.get(length / 128);
     for (int i = 0; i < length / 128; ++i) {
       block_r[i] = bool_to128(r2 + i * 128);
     }
 
-    for (int j = 0; j * block_size < length; ++j) {
-      for (int i = 0; i < lambda; ++i) {
-        G0[i].random_data(t + (i * block_size / 128), block_size / 8);
-        G1[i].random_data(tmp, block_size / 8);
-        xorBlocks_arr(tmp, t + (i * block_size / 128), tmp, block_size / 128);
-        xorBlocks_arr(tmp, block_r + (j * block_size / 128), tmp,
-                      block_size / 128);
-        io->send_data(tmp, block_size / 8);
-      }
-      sse_trans((uint8_t *)(tT + j * block_size), (uint8_t *)t, 128,
-                block_size);
-    }
-
-    delete[] block_r;
-    delete[] r2;
+    iknp_recv_pre_chunks(io, G0, G1, block_r, lambda, block_size,
+                         length / block_size, tT, num_threads, msgs_buf,
+                         scratch_buf);
 
     this->block_size = old_block_size;
   }
@@ -303,6 +340,19 @@ public:
    ********************************************************/
 
   void preprocess() {
+    if (precomp_ring != nullptr) {
+      PrecompSlot<Block128> &slot =
+          precomp_next_batch(io, *precomp_ring, party == ALICE,
+                             (uint64_t)bg_length * lambda / 8);
+      for (int i = 0; i < (int)slot.h.size(); i++) {
+        h[i] = slot.h[i];
+        h64[i] = slot.h64[i];
+      }
+      if (party == BOB)
+        r_off = slot.r_off;
+      counter = 0;
+      return;
+    }
     switch (party) {
     case ALICE: {
       send_pre(counter);
@@ -329,8 +379,13 @@ public:
   online OT extension. 
 */
   void got_send_offline(int length) {
+    got_send_offline(qT, h, h64, pad_buf, length);
+  }
+
+  void got_send_offline(block128 *qT, uint8_t **h, uint64_t **h64,
+                        OTBuffer<Block128> &pad_buf, int length) {
     const int bsize = AES_BATCH_SIZE;
-    block128 *pad = new block128[2 * bsize];
+    block128 *pad = pad_buf.get(2 * bsize);
     for (int i = 0; i < length; i += bsize) {
       for (int j = i; j < i + bsize and j < length; ++j) {
         pad[2 * (j - i)] = qT[j];
@@ -344,8 +399,6 @@ public:
         h[1][j] = ((uint8_t)_mm_extract_epi8(pad[2 * (j - i) + 1], 0));
       }
     }
-    delete[] qT;
-    delete[] pad;
   }
 
 /*
@@ -354,8 +407,13 @@ public:
   of choice during the online OT extension. 
 */
   void got_recv_offline(int length) {
+    got_recv_offline(tT, h, h64, pad_buf, length);
+  }
+
+  void got_recv_offline(block128 *tT, uint8_t **h, uint64_t **h64,
+                        OTBuffer<Block128> &pad_buf, int length) {
     const int bsize = AES_BATCH_SIZE;
-    block128 *pad = new block128[2 * bsize];
+    block128 *pad = pad_buf.get(2 * bsize);
     for (int i = 0; i < length; i += bsize) {
       if (bsize <= length - i)
         crh.H<bsize>(pad, tT + i);
@@ -366,11 +424,10 @@ public:
         h[0][i + j] = ((uint8_t)_mm_extract_epi8(pad[j], 0));
       }
     }
-    delete[] tT;
-    delete[] pad;
   }
 
-  template <typename T> void got_send_online(T **data, int length) {
+  template <typename T, typename Rows = T **>
+  void got_send_online(Rows data, int length) {
     const int bsize = AES_BATCH_SIZE / 2;
     int bits_in_sel_input = 1;
     uint32_t y_size =
@@ -382,9 +439,10 @@ public:
     T y[y_size];
     uint8_t a_packed[a_size];
     uint8_t a[length];
-    T **maskeddata = new T *[bsize];
+    T *maskedrows = (T *)masked_buf.get((uint64_t)bsize * 2 * sizeof(T));
+    T **maskeddata = (T **)masked_rows_buf.get(bsize);
     for (int i = 0; i < bsize; i++) {
-      maskeddata[i] = new T[2];
+      maskeddata[i] = maskedrows + 2 * i;
     }
     for (int ctr = 0; ctr < length; ctr += bsize) {
       corrected_bsize = std::min(bsize, length - ctr);
@@ -411,10 +469,6 @@ public:
       pack_messages<T>(y, maskeddata, corrected_y_size, corrected_bsize, l, 2);
       io->send_data(y, sizeof(T) * corrected_y_size);
     }
-    for (int i = 0; i < bsize; i++) {
-      delete[] maskeddata[i];
-    }
-    delete[] maskeddata;
   }
 
   template <typename T>
@@ -480,7 +534,6 @@ public:
       }
       io->send_data(pad, 2 * sizeof(block128) * std::min(bsize, length - i));
     }
-    delete[] qT;
   }
 
   void got_recv_post(block128 *data, const bool *r, int length) {
@@ -496,10 +549,49 @@ public:
         data[i + j] = xorBlocks(res[2 * j + r[i + j]], tT[i + j]);
       }
     }
-    delete[] tT;
   }
 
-  template <typename T> void got_send_post(T **data, int length) {
+  /*********************************************************
+   *                Random bit OT functions               *
+   ********************************************************/
+
+/*
+  Random OT with 1-bit messages: the sender's messages are the low bits of
+  H(qT) and H(qT XOR s), the receiver's is the low bit of H(tT). Nothing is
+  sent after the pre-processing, and the choice bits only enter through
+  recv_pre, so random choices make the whole OT input-independent.
+*/
+  void rot_send_post(uint8_t *data0, uint8_t *data1, int length) {
+    const int bsize = AES_BATCH_SIZE / 2;
+    block128 *pad = pad_buf.get(2 * bsize);
+    for (int i = 0; i < length; i += bsize) {
+      for (int j = i; j < i + bsize and j < length; ++j) {
+        pad[2 * (j - i)] = qT[j];
+        pad[2 * (j - i) + 1] = xorBlocks(qT[j], block_s);
+      }
+      crh.H<2 * bsize>(pad, pad);
+      for (int j = i; j < i + bsize and j < length; ++j) {
+        data0[j] = _mm_extract_epi8(pad[2 * (j - i)], 0) & 1;
+        data1[j] = _mm_extract_epi8(pad[2 * (j - i) + 1], 0) & 1;
+      }
+    }
+  }
+
+  void rot_recv_post(uint8_t *data, int length) {
+    const int bsize = AES_BATCH_SIZE;
+    block128 *pad = pad_buf.get(bsize);
+    for (int i = 0; i < length; i += bsize) {
+      if (bsize <= length - i)
+        crh.H<bsize>(pad, tT + i);
+      else
+        crh.Hn(pad, tT + i, length - i);
+      for (int j = 0; j < bsize and j < length - i; ++j)
+        data[i + j] = _mm_extract_epi8(pad[j], 0) & 1;
+    }
+  }
+
+  template <typename T, typename Rows = T **>
+  void got_send_post(Rows data, int length) {
     const int bsize = AES_BATCH_SIZE / 2;
     block128 pad[2 * bsize];
     uint32_t y_size =
@@ -515,20 +607,10 @@ public:
       corrected_y_size = (uint32_t)ceil(
           (2 * std::min(bsize, length - i) * this->l) / ((float)sizeof(T) * 8));
       corrected_bsize = std::min(bsize, length - i);
-      if (sizeof(T) == 8) {
-        pack_ot_messages<uint64_t>((uint64_t *)y, (uint64_t **)data + i, pad,
-                                   corrected_y_size, corrected_bsize, this->l,
-                                   2);
-      } else if (sizeof(T) == 1) {
-        pack_ot_messages<uint8_t>((uint8_t *)y, (uint8_t **)data + i, pad,
-                                  corrected_y_size, corrected_bsize, this->l,
-                                  2);
-      } else {
-        throw std::invalid_argument("Not implemented");
-      }
+      pack_ot_messages<T>(y, data + i, pad, corrected_y_size, corrected_bsize,
+                          this->l, 2);
       io->send_data(y, sizeof(T) * (corrected_y_size));
     }
-    delete[] qT;
   }
 
   template <typename T>
@@ -560,7 +642,6 @@ public:
         throw std::invalid_argument("Not implemented");
       }
     }
-    delete[] tT;
   }
 
   // General OT sender with message length > 64
@@ -573,13 +654,13 @@ public:
     uint64_t modulo_mask = (l == 64 ? -1 : ((1ULL << l) - 1));
     int max_num_hashes = ceil((l * msgs_per_ot) / 128.0);
     int max_pad_len = dim * max_num_hashes;
-    block128 *pad = new block128[2 * max_pad_len];
-    block128 *y0_per_ot = new block128[msgs_per_ot];
-    block128 *y1_per_ot = new block128[msgs_per_ot];
+    block128 *pad = pad_buf.get(2 * max_pad_len);
+    block128 *y0_per_ot = y_blk0_buf.get(msgs_per_ot);
+    block128 *y1_per_ot = y_blk1_buf.get(msgs_per_ot);
     uint8_t *y0 =
-        new uint8_t[dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t))];
+        y0_buf.get(dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t)));
     uint8_t *y1 =
-        new uint8_t[dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t))];
+        y1_buf.get(dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t)));
 
     int num_hashes = ceil((l * msgs_per_ot) / 128.0);
     int bsize = std::min(int(ceil(AES_BATCH_SIZE / double(num_hashes))), dim) *
@@ -624,15 +705,9 @@ public:
       io->send_data(y0, sizeof(uint8_t) * ysize_per_ot * lnum_ot);
       io->send_data(y1, sizeof(uint8_t) * ysize_per_ot * lnum_ot);
     }
-    delete[] pad;
     // delete[] unpacked_pad0;
     // delete[] unpacked_pad1;
     // delete[] corr_data;
-    delete[] y0;
-    delete[] y0_per_ot;
-    delete[] y1;
-    delete[] y1_per_ot;
-    delete[] qT;
 
     /*
             const int bsize = AES_BATCH_SIZE/2;
@@ -669,11 +744,11 @@ public:
 
     int max_num_hashes = ceil((l * msgs_per_ot) / 128.0);
     int max_pad_len = dim * max_num_hashes;
-    block128 *pad = new block128[max_pad_len];
+    block128 *pad = pad_buf.get(max_pad_len);
     uint8_t *y0 =
-        new uint8_t[dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t))];
+        y0_buf.get(dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t)));
     uint8_t *y1 =
-        new uint8_t[dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t))];
+        y1_buf.get(dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t)));
 
     int num_hashes = ceil((l * msgs_per_ot) / 128.0);
     int bsize = std::min(int(ceil(AES_BATCH_SIZE / double(num_hashes))), dim) *
@@ -716,10 +791,6 @@ public:
         }
       }
     }
-    delete[] pad;
-    delete[] y0;
-    delete[] y1;
-    delete[] tT;
 
     /*
             const int bsize = AES_BATCH_SIZE;
@@ -784,7 +855,6 @@ public:
                         this->l);
       io->send_data(y, sizeof(uint64_t) * (corrected_y_size));
     }
-    delete[] qT;
   }
 
   void cot_recv_post(uint64_t *data, const bool *r, int length) {
@@ -815,7 +885,6 @@ public:
           data[j] = _mm_extract_epi64(tT[j], 0) & modulo_mask;
       }
     }
-    delete[] tT;
   }
 
   // Batched COT sender with messages of different bitlengths
@@ -837,13 +906,13 @@ public:
     }
     int max_num_hashes = ceil((64 * msgs_per_ot) / 128.0);
     int max_pad_len = dim * max_num_hashes;
-    block128 *pad = new block128[2 * max_pad_len];
-    block128 *y_per_ot = new block128[msgs_per_ot];
+    block128 *pad = pad_buf.get(2 * max_pad_len);
+    block128 *y_per_ot = y_blk0_buf.get(msgs_per_ot);
     // uint64_t* unpacked_pad0 = new uint64_t[msgs_per_ot];
     // uint64_t* unpacked_pad1 = new uint64_t[msgs_per_ot];
     // uint64_t* corr_data = new uint64_t[dim*msgs_per_ot];
     uint8_t *y =
-        new uint8_t[dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t))];
+        y0_buf.get(dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t)));
     for (int i = 0; i < num_ot / dim; i++) {
       int bit_idx = i;
       int lmsg_len = msg_len[bit_idx];
@@ -896,13 +965,9 @@ public:
         io->send_data(y, sizeof(uint8_t) * ysize_per_ot * lnum_ot);
       }
     }
-    delete[] pad;
     // delete[] unpacked_pad0;
     // delete[] unpacked_pad1;
     // delete[] corr_data;
-    delete[] y;
-    delete[] y_per_ot;
-    delete[] qT;
   }
 
   // Batched COT receiver with messages of different bitlengths
@@ -923,11 +988,11 @@ public:
     }
     int max_num_hashes = ceil((64 * msgs_per_ot) / 128.0);
     int max_pad_len = dim * max_num_hashes;
-    block128 *pad = new block128[max_pad_len];
+    block128 *pad = pad_buf.get(max_pad_len);
     // uint64_t* unpacked_pad = new uint64_t[msgs_per_ot];
     // uint64_t* corr_data = new uint64_t[dim*msgs_per_ot];
     uint8_t *y =
-        new uint8_t[dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t))];
+        y0_buf.get(dim * msgs_per_ot * (sizeof(uint64_t) / sizeof(uint8_t)));
     for (int i = 0; i < num_ot / dim; i++) {
       int bit_idx = i;
       int lmsg_len = msg_len[bit_idx];
@@ -969,11 +1034,8 @@ public:
         }
       }
     }
-    delete[] pad;
     // delete[] unpacked_pad;
     // delete[] corr_data;
-    delete[] y;
-    delete[] tT;
   }
 
   /*********************************************************
@@ -1017,16 +1079,25 @@ public:
   }
 
   void send_impl(uint8_t **data, int length, int l) {
+    send_rows<uint8_t>(data, length, l);
+  }
+
+  void send_impl(const uint8_t *data, int stride, int length, int l) {
+    send_rows<uint8_t>(StridedRows<uint8_t>(data, stride), length, l);
+  }
+
+  template <typename T, typename Rows> void send_rows(Rows data, int length,
+                                                      int l) {
     assert(l <= 8 && l >= 1);
     this->l = l;
     if (length <= precomp_batch_size) {
       if (length > (precomp_batch_size - counter)) {
         preprocess();
       }
-      got_send_online<uint8_t>(data, length);
+      got_send_online<T>(data, length);
     } else {
       send_pre(length);
-      got_send_post<uint8_t>(data, length);
+      got_send_post<T>(data, length);
     }
   }
 
@@ -1055,6 +1126,20 @@ public:
     recv_pre(b, length);
     cot_recv_post(data, b, length);
   }
+
+  void send_rot(uint8_t *data0, uint8_t *data1, int length) {
+    if (length < 1)
+      return;
+    send_pre(length);
+    rot_send_post(data0, data1, length);
+  }
+
+  void recv_rot(uint8_t *data, bool *b, int length) {
+    if (length < 1)
+      return;
+    recv_pre(b, length);
+    rot_recv_post(data, length);
+  }
 };
 } // namespace sci
 #endif // SPLIT_OT_IKNP_H__
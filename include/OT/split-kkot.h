@@ -28,7 +28,7 @@ SOFTWARE.
 // online offline split can
 // be found in OT/kkot.h
 
-#include "OT/np.h"
+#include "OT/base-ot.h"
 #include "OT/ot-utils.h"
 #include "OT/ot.h"
 #include "OT/split-utils.h"
@@ -36,7 +36,7 @@ SOFTWARE.
 namespace sci {
 template <typename IO> class SplitKKOT : public OT<SplitKKOT<IO>> {
 public:
-  OTNP<IO> *base_ot;
+  BaseOT<IO> *base_ot;
   PRG128 prg;
   int party;
   const int lambda = 256;
@@ -58,6 +58,13 @@ public:
 
   block256 *k0 = nullptr, *k1 = nullptr, *d = nullptr, *c_AND_s = nullptr,
            *qT = nullptr, *tT = nullptr, *tmp = nullptr, block_s;
+  // pooled storage behind qT/tT, h/h64/r_off and the per-call scratch
+  // arrays. They only grow, so steady-state calls do not allocate.
+  OTBuffer<Block256> qT_buf, tT_buf, dT_buf, key_buf;
+  OTBuffer<Block128> pad_buf;
+  OTBuffer<uint8_t> h_buf, r_off_buf, r2_buf, y_buf, masked_buf;
+  OTBuffer<uint64_t> h64_buf;
+  OTBuffer<void *> masked_rows_buf;
 
   // h holds the precomputed hashes which can be used directly
   // in the online phase by xoring with the respective OT messages.
@@ -73,117 +80,169 @@ public:
   uint8_t *extended_r = nullptr;
   IO *io = nullptr;
 
+  // Background precomputation (see start_precomp_thread). The producer
+  // thread only touches the bg_* members and the slots of the ring.
+  PrecompRing<PrecompSlot<Block256>> *precomp_ring = nullptr;
+  int precomp_depth = 0, precomp_epoch = 0;
+  int bg_block_size = 0, bg_length = 0;
+  PRG256 *BG0 = nullptr, *BG1 = nullptr;
+  PRG128 bg_prg;
+  OTBuffer<Block256> bg_q_buf, bg_d_buf, bg_dT_buf, bg_tmp_buf, bg_key_buf;
+  OTBuffer<Block128> bg_pad_buf;
+
   SplitKKOT(int party, IO *io, int N) {
     assert(party == ALICE || party == BOB);
     this->party = party;
     this->io = io;
     assert(N > 0);
     this->N = N;
-    base_ot = new OTNP<IO>(io);
+    base_ot = new BaseOT<IO>(io);
     s = new bool[lambda];
-    k0 = new (std::align_val_t(32)) block256[lambda];
-    k1 = new (std::align_val_t(32)) block256[lambda];
-    d = new (std::align_val_t(32)) block256[block_size];
-    c_AND_s = new (std::align_val_t(32)) block256[lambda];
-    switch (party) {
-    case ALICE:
-      h = new uint8_t *[N];
-      h64 = new uint64_t *[N];
-      for (int i = 0; i < N; i++) {
-        h[i] = new uint8_t[precomp_batch_size];
-        h64[i] = new uint64_t[precomp_batch_size];
-      }
-      break;
-    case BOB:
-      h = new uint8_t *[1];
-      h64 = new uint64_t *[1];
-      r_off = new uint8_t[precomp_batch_size];
-      for (int i = 0; i < 1; i++) {
-        h[i] = new uint8_t[precomp_batch_size];
-        h64[i] = new uint64_t[precomp_batch_size];
-      }
-      break;
-    }
+    // new[] honours alignof(block256) and pairs with the delete[] below
+    k0 = new block256[lambda];
+    k1 = new block256[lambda];
+    d = new block256[block_size];
+    c_AND_s = new block256[lambda];
+    // N masks per OT for the sender, 1 for the receiver
+    h = new uint8_t *[N];
+    h64 = new uint64_t *[N];
+    r_off = nullptr;
+    map_precomp_rows();
     G0 = new PRG256[lambda];
     G1 = new PRG256[lambda];
-    tmp = new (std::align_val_t(32)) block256[block_size / 256];
+    tmp = new block256[block_size / 256];
     extended_r = new uint8_t[block_size];
   }
 
   ~SplitKKOT() {
+    stop_precomp_thread();
+    delete[] BG0;
+    delete[] BG1;
     delete base_ot;
     delete[] s;
     delete[] k0;
     delete[] k1;
     delete[] d;
-    if (precomp_masks)
-      delete[] c_AND_s;
-    switch (party) {
-    case ALICE:
-      for (int i = 0; i < N; i++) {
-        delete[] h[i];
-        delete[] h64[i];
-      }
-      delete[] h;
-      delete[] h64;
-      break;
-    case BOB:
-      delete[] h[0];
-      delete[] h;
-      delete[] h64[0];
-      delete[] h64;
-      delete[] r_off;
-      break;
-    }
+    delete[] c_AND_s;
+    delete[] h;
+    delete[] h64;
     delete[] G0;
     delete[] G1;
     delete[] tmp;
     delete[] extended_r;
   }
 
+  // Points the rows of h/h64 (and r_off for the receiver) at pooled storage
+  // for precomp_batch_size OTs. The storage only grows, so resizing the batch
+  // back and forth does not allocate.
+  void map_precomp_rows() {
+    int rows = (party == ALICE) ? N : 1;
+    uint8_t *hb = h_buf.get((uint64_t)rows * precomp_batch_size);
+    uint64_t *h64b = h64_buf.get((uint64_t)rows * precomp_batch_size);
+    for (int i = 0; i < rows; i++) {
+      h[i] = hb + (uint64_t)i * precomp_batch_size;
+      h64[i] = h64b + (uint64_t)i * precomp_batch_size;
+    }
+    if (party == BOB)
+      r_off = r_off_buf.get(precomp_batch_size);
+  }
+
+  // Restarts the background thread, if one is running, for the new size.
   void set_precomp_batch_size(int batch_size) {
+    int depth = precomp_depth;
+    stop_precomp_thread();
     this->precomp_batch_size = batch_size;
     this->counter = batch_size;
-    if (precomp_masks) {
-      delete[] c_AND_s;
-      c_AND_s = new (std::align_val_t(32)) block256[lambda];
-      precomp_masks = false;
+    // c_AND_s is fully rewritten by precompute_masks
+    precomp_masks = false;
+    map_precomp_rows();
+    if (depth > 0 && batch_size > 0)
+      start_precomp_thread(depth);
+  }
+
+  /*
+    Background precomputation of the online GOT batches, as in
+    SplitIKNP::start_precomp_thread: a thread keeps up to depth batches
+    ready, using PRG streams derived from the base-OT keys for each start,
+    and the correction rows of batch j + 1 are exchanged on io when the
+    parties switch to batch j. Both parties must start and stop it at the
+    same point of their OT sequences.
+  */
+  void start_precomp_thread(int depth = PRECOMP_MIN_DEPTH) {
+    assert(precomp_batch_size > 0);
+    stop_precomp_thread();
+    if (!setup) {
+      if (party == ALICE)
+        setup_send();
+      else
+        setup_recv();
     }
-    switch (party) {
-    case ALICE:
-      for (int i = 0; i < N; i++) {
-        delete[] h[i];
-        delete[] h64[i];
-      }
-      delete[] h;
-      delete[] h64;
-      break;
-    case BOB:
-      delete[] h[0];
-      delete[] h;
-      delete[] h64[0];
-      delete[] h64;
-      delete[] r_off;
-      break;
+    if (party == ALICE && !precomp_masks)
+      precompute_masks();
+    precomp_depth = std::max(PRECOMP_MIN_DEPTH, depth);
+    ++precomp_epoch;
+    if (BG0 == nullptr) {
+      BG0 = new PRG256[lambda];
+      BG1 = new PRG256[lambda];
     }
-    switch (party) {
-    case ALICE:
-      h = new uint8_t *[N];
-      h64 = new uint64_t *[N];
-      for (int i = 0; i < N; i++) {
-        h[i] = new uint8_t[precomp_batch_size];
-        h64[i] = new uint64_t[precomp_batch_size];
-      }
-      break;
-    case BOB:
-      h = new uint8_t *[1];
-      h64 = new uint64_t *[1];
-      r_off = new uint8_t[precomp_batch_size];
-      for (int i = 0; i < 1; i++) {
-        h[i] = new uint8_t[precomp_batch_size];
-        h64[i] = new uint64_t[precomp_batch_size];
+    for (int i = 0; i < lambda; ++i) {
+      BG0[i].reseed(&k0[i], PRECOMP_PRG_DOMAIN | precomp_epoch);
+      BG0[i].counter = G0[i].counter;
+      if (party == BOB) {
+        BG1[i].reseed(&k1[i], PRECOMP_PRG_DOMAIN | precomp_epoch);
+        BG1[i].counter = G1[i].counter;
       }
-      break;
+    }
+    bg_block_size =
+        std::min(block_size, int(ceil(precomp_batch_size / 256.0)) * 256);
+    bg_length = ((precomp_batch_size + bg_block_size - 1) / bg_block_size) *
+                bg_block_size;
+    precomp_ring = new PrecompRing<PrecompSlot<Block256>>(
+        depth, party == ALICE,
+        [this](PrecompSlot<Block256> &slot, uint64_t) {
+          precompute_batch(slot);
+        });
+    counter = precomp_batch_size;
+  }
+
+  // Discards the batches of the background thread and goes back to
+  // computing them in preprocess().
+  void stop_precomp_thread() {
+    if (precomp_ring == nullptr)
+      return;
+    delete precomp_ring;
+    precomp_ring = nullptr;
+    precomp_depth = 0;
+    map_precomp_rows();
+    counter = precomp_batch_size;
+  }
+
+  // Producer side: extends bg_length OTs with the background PRGs, with
+  // the correction rows of the batch recorded into (receiver) or replayed
+  // from (sender) slot.corr_buf, and hashes them into the slot.
+  void precompute_batch(PrecompSlot<Block256> &slot) {
+    const int rows = (party == ALICE) ? N : 1;
+    const int bs = bg_block_size;
+    slot.map_rows(rows, precomp_batch_size);
+    block256 *mat = slot.mat_buf.get(bg_length);
+    block256 *tmp = bg_tmp_buf.get(bs / 256);
+    OTCursorIO ch(slot.corr_buf.get((uint64_t)bg_length * lambda / 8));
+    if (party == ALICE) {
+      send_pre_chunks(&ch, BG0, mat, bg_q_buf.get(bs), tmp, bs, bg_length);
+      got_send_offline(mat, slot.h.data(), slot.h64.data(), bg_key_buf,
+                       bg_pad_buf, precomp_batch_size);
+    } else {
+      slot.r_off = slot.r_off_buf.get(bg_length);
+      bg_prg.random_data(slot.r_off, bg_length);
+      for (int i = 0; i < bg_length; i++)
+        slot.r_off[i] &= (N - 1);
+      block256 *dT = bg_dT_buf.get(bg_length);
+      for (int i = 0; i < bg_length; i++)
+        dT[i] = _mm256_lddqu_si256((const __m256i *)WH_Code[slot.r_off[i]]);
+      recv_pre_chunks(&ch, BG0, BG1, dT, mat, bg_q_buf.get(bs),
+                      bg_d_buf.get(bs), tmp, bs, bg_length);
+      got_recv_offline(mat, slot.h.data(), slot.h64.data(), bg_pad_buf,
+                       precomp_batch_size);
     }
   }
 
@@ -232,6 +291,19 @@ public:
   }
 
   void preprocess() {
+    if (precomp_ring != nullptr) {
+      PrecompSlot<Block256> &slot =
+          precomp_next_batch(io, *precomp_ring, party == ALICE,
+                             (uint64_t)bg_length * lambda / 8);
+      for (int i = 0; i < (int)slot.h.size(); i++) {
+        h[i] = slot.h[i];
+        h64[i] = slot.h64[i];
+      }
+      if (party == BOB)
+        r_off = slot.r_off;
+      counter = 0;
+      return;
+    }
     switch (party) {
     case ALICE:
       send_pre(counter);
@@ -256,24 +328,30 @@ public:
         std::min(old_block_size, int(ceil(length / 256.0)) * 256);
     length = padded_length(length);
     alignas(32) block256 q[block_size];
-    qT = new (std::align_val_t(32)) block256[length];
+    qT = qT_buf.get(length);
     if (!setup)
       setup_send();
     if (!precomp_masks)
       precompute_masks();
 
-    for (int j = 0; j < length / block_size; ++j) {
+    send_pre_chunks(io, G0, qT, q, tmp, block_size, length);
+    this->block_size = old_block_size;
+  }
+
+  // Sender extension of length OTs (a multiple of bs) into qT, reading the
+  // correction rows from ch. q and tmp hold bs and bs / 256 blocks.
+  template <typename ChIO>
+  void send_pre_chunks(ChIO *ch, PRG256 *G, block256 *qT, block256 *q,
+                       block256 *tmp, int bs, int length) {
+    for (int j = 0; j < length / bs; ++j) {
       for (int i = 0; i < lambda; ++i) {
-        G0[i].random_data(q + (i * block_size / 256), block_size / 8);
-        io->recv_data(tmp, block_size / 8);
+        G[i].random_data(q + (i * bs / 256), bs / 8);
+        ch->recv_data(tmp, bs / 8);
         if (s[i])
-          xorBlocks_arr(q + (i * block_size / 256), q + (i * block_size / 256),
-                        tmp, block_size / 256);
+          xorBlocks_arr(q + (i * bs / 256), q + (i * bs / 256), tmp, bs / 256);
       }
-      sse_trans((uint8_t *)(qT + j * block_size), (uint8_t *)q, 256,
-                block_size);
+      bit_trans((uint8_t *)(qT + j * bs), (uint8_t *)q, 256, bs);
     }
-    this->block_size = old_block_size;
   }
 
   void recv_pre(const uint8_t *r, int length) {
@@ -283,43 +361,53 @@ public:
     int old_length = length;
     length = padded_length(length);
     alignas(32) block256 t[block_size];
-    tT = new (std::align_val_t(32)) block256[length];
+    tT = tT_buf.get(length);
     if (not setup)
       setup_recv();
 
-    uint8_t *r2 = new uint8_t[length];
+    uint8_t *r2 = r2_buf.get(length);
     prg.random_data(extended_r, block_size);
     memcpy(r2, r, old_length);
     memcpy(r2 + old_length, extended_r, length - old_length);
 
-    block256 *dT = new (std::align_val_t(32)) block256[length];
+    block256 *dT = dT_buf.get(length);
     for (int i = 0; i < length; i++)
       dT[i] = _mm256_lddqu_si256((const __m256i *)WH_Code[r2[i]]);
 
-    for (int j = 0; j * block_size < length; ++j) {
-      sse_trans((uint8_t *)d, (uint8_t *)(dT + j * block_size), block_size,
-                256);
+    recv_pre_chunks(io, G0, G1, dT, tT, t, d, tmp, block_size, length);
+    this->block_size = old_block_size;
+  }
+
+  // Receiver extension of length OTs (a multiple of bs) with the codewords
+  // dT into tT, writing the correction rows to ch. t and d hold bs blocks,
+  // tmp bs / 256.
+  template <typename ChIO>
+  void recv_pre_chunks(ChIO *ch, PRG256 *G0, PRG256 *G1, block256 *dT,
+                       block256 *tT, block256 *t, block256 *d, block256 *tmp,
+                       int bs, int length) {
+    for (int j = 0; j * bs < length; ++j) {
+      bit_trans((uint8_t *)d, (uint8_t *)(dT + j * bs), bs, 256);
       for (int i = 0; i < lambda; ++i) {
-        G0[i].random_data(t + (i * block_size / 256), block_size / 8);
-        G1[i].random_data(tmp, block_size / 8);
-        xorBlocks_arr(tmp, t + (i * block_size / 256), tmp, block_size / 256);
-        xorBlocks_arr(tmp, d + (i * block_size / 256), tmp, block_size / 256);
-        io->send_data(tmp, block_size / 8);
+        G0[i].random_data(t + (i * bs / 256), bs / 8);
+        G1[i].random_data(tmp, bs / 8);
+        xorBlocks_arr(tmp, t + (i * bs / 256), tmp, bs / 256);
+        xorBlocks_arr(tmp, d + (i * bs / 256), tmp, bs / 256);
+        ch->send_data(tmp, bs / 8);
       }
-      sse_trans((uint8_t *)(tT + j * block_size), (uint8_t *)t, 256,
-                block_size);
+      bit_trans((uint8_t *)(tT + j * bs), (uint8_t *)t, 256, bs);
     }
-
-    delete[] dT;
-    delete[] r2;
-
-    this->block_size = old_block_size;
   }
 
   void got_send_offline(int length) {
+    got_send_offline(qT, h, h64, key_buf, pad_buf, length);
+  }
+
+  void got_send_offline(block256 *qT, uint8_t **h, uint64_t **h64,
+                        OTBuffer<Block256> &key_buf,
+                        OTBuffer<Block128> &pad_buf, int length) {
     const int bsize = ro_batch_size;
-    block256 *key = new (std::align_val_t(32)) block256[N * bsize];
-    block128 *pad = new block128[N * bsize];
+    block256 *key = key_buf.get(N * bsize);
+    block128 *pad = pad_buf.get(N * bsize);
 
     for (int i = 0; i < length; i += bsize) {
       for (int j = i; j < i + bsize and j < length; ++j) {
@@ -335,14 +423,16 @@ public:
         }
       }
     }
-    delete[] qT;
-    delete[] key;
-    delete[] pad;
   }
 
   void got_recv_offline(int length) {
+    got_recv_offline(tT, h, h64, pad_buf, length);
+  }
+
+  void got_recv_offline(block256 *tT, uint8_t **h, uint64_t **h64,
+                        OTBuffer<Block128> &pad_buf, int length) {
     const int bsize = ro_batch_size;
-    block128 *pad = new block128[N * bsize];
+    block128 *pad = pad_buf.get(N * bsize);
 
     for (int i = 0; i < length; i += bsize) {
       if (bsize <= length - i)
@@ -354,11 +444,10 @@ public:
         h64[0][i + j] = ((uint64_t)_mm_extract_epi64(pad[j], 0));
       }
     }
-    delete[] tT;
-    delete[] pad;
   }
 
-  template <typename T> void got_send_online(T **data, int length) {
+  template <typename T, typename Rows = T **>
+  void got_send_online(Rows data, int length) {
     const int bsize = length; // ro_batch_size;
     uint32_t y_size = (uint32_t)ceil((N * bsize * l) / ((float)sizeof(T) * 8));
     int bits_in_sel_input = sci::bitlen(N);
@@ -367,9 +456,10 @@ public:
     T y[y_size];
     uint8_t a_packed[a_size];
     uint8_t a[length];
-    T **maskeddata = new T *[bsize];
+    T *maskedrows = (T *)masked_buf.get((uint64_t)bsize * N * sizeof(T));
+    T **maskeddata = (T **)masked_rows_buf.get(bsize);
     for (int i = 0; i < bsize; i++) {
-      maskeddata[i] = new T[N];
+      maskeddata[i] = maskedrows + (uint64_t)N * i;
     }
     int32_t corrected_bsize, corrected_y_size, corrected_a_size;
     uint8_t mask_a;
@@ -409,10 +499,6 @@ public:
       pack_messages<T>(y, maskeddata, corrected_y_size, corrected_bsize, l, N);
       io->send_data(y, sizeof(T) * corrected_y_size);
     }
-    for (int i = 0; i < bsize; i++) {
-      delete[] maskeddata[i];
-    }
-    delete[] maskeddata;
   }
 
   template <typename T>
@@ -465,14 +551,15 @@ public:
     }
   }
 
-  template <typename T> void got_send_post(T **data, int length) {
+  template <typename T, typename Rows = T **>
+  void got_send_post(Rows data, int length) {
     const int bsize = ro_batch_size;
-    block256 *key = new (std::align_val_t(32)) block256[N * bsize];
-    block128 *pad = new block128[N * bsize];
+    block256 *key = key_buf.get(N * bsize);
+    block128 *pad = pad_buf.get(N * bsize);
     uint32_t y_size =
         (uint32_t)ceil((N * bsize * this->l) / ((float)sizeof(T) * 8));
     uint32_t corrected_y_size, corrected_bsize;
-    T *y = new T[y_size];
+    T *y = (T *)y_buf.get((uint64_t)y_size * sizeof(T));
 
     for (int i = 0; i < length; i += bsize) {
       for (int j = i; j < i + bsize and j < length; ++j) {
@@ -484,33 +571,20 @@ public:
       corrected_y_size = (uint32_t)ceil(
           (N * std::min(bsize, length - i) * this->l) / ((float)sizeof(T) * 8));
       corrected_bsize = std::min(bsize, length - i);
-      if (sizeof(T) == 8) {
-        pack_ot_messages<uint64_t>((uint64_t *)y, (uint64_t **)data + i, pad,
-                                   corrected_y_size, corrected_bsize, this->l,
-                                   this->N);
-      } else if (sizeof(T) == 1) {
-        pack_ot_messages<uint8_t>((uint8_t *)y, (uint8_t **)data + i, pad,
-                                  corrected_y_size, corrected_bsize, this->l,
-                                  this->N);
-      } else {
-        throw std::invalid_argument("Not implemented");
-      }
+      pack_ot_messages<T>(y, data + i, pad, corrected_y_size, corrected_bsize,
+                          this->l, this->N);
       io->send_data(y, sizeof(T) * (corrected_y_size));
     }
-    delete[] qT;
-    delete[] y;
-    delete[] key;
-    delete[] pad;
   }
 
   template <typename T>
   void got_recv_post(T *data, const uint8_t *r, int length) {
     const int bsize = ro_batch_size;
-    block128 *pad = new block128[N * bsize];
+    block128 *pad = pad_buf.get(N * bsize);
     uint32_t recvd_size =
         (uint32_t)ceil((N * bsize * this->l) / ((float)sizeof(T) * 8));
     uint32_t corrected_recvd_size, corrected_bsize;
-    T *recvd = new T[recvd_size];
+    T *recvd = (T *)y_buf.get((uint64_t)recvd_size * sizeof(T));
     for (int i = 0; i < length; i += bsize) {
       uint32_t corrected_recvd_size = (uint32_t)ceil(
           (N * std::min(bsize, length - i) * this->l) / ((float)sizeof(T) * 8));
@@ -533,12 +607,18 @@ public:
         throw std::invalid_argument("Not implemented");
       }
     }
-    delete[] tT;
-    delete[] pad;
-    delete[] recvd;
   }
 
   void send_impl(uint8_t **data, int length, int l) {
+    send_rows<uint8_t>(data, length, l);
+  }
+
+  void send_impl(const uint8_t *data, int stride, int length, int l) {
+    send_rows<uint8_t>(StridedRows<uint8_t>(data, stride), length, l);
+  }
+
+  template <typename T, typename Rows> void send_rows(Rows data, int length,
+                                                      int l) {
     assert(N <= lambda && N >= 2);
     assert(l <= 8 && l >= 1);
     // assert(((N*l*length) % 8) == 0);
@@ -547,10 +627,10 @@ public:
       if (length > (precomp_batch_size - counter)) {
         preprocess();
       }
-      got_send_online<uint8_t>(data, length);
+      got_send_online<T>(data, length);
     } else {
       send_pre(length);
-      got_send_post<uint8_t>(data, length);
+      got_send_post<T>(data, length);
     }
   }
 
@@ -0,0 +1,1127 @@
+#pragma once
+// Unit tests of the SCI OT and millionaire code. Both parties run as threads
+// of this process over in-process IOPacks (MEM_IO_ADDRESS), so the tests need
+// no sockets. They are registered in main and run with -u.
+
+#include "cryptoTools/Common/CLP.h"
+#include "cryptoTools/Common/Defines.h"
+#include "OT/bit-pack.h"
+#include "OT/iknp.h"
+#include "OT/kkot.h"
+#include "OT/np.h"
+#include "OT/split-iknp.h"
+#include "OT/split-kkot.h"
+#include "Millionaire/mill-tuner.h"
+#include "Millionaire/millionaire_parallel.h"
+#include "Millionaire/millionaire_with_equality.h"
+#include "utils/io_pack.h"
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace osuCrypto
+{
+    // runs alice() on a new thread and bob() on this one.
+    template<typename A, typename B>
+    void sciRunParties(A&& alice, B&& bob)
+    {
+        std::thread t(alice);
+        bob();
+        t.join();
+    }
+
+    /*
+        Checks that the pooled extension buffers stop allocating: once IKNP,
+        KKOT, SplitIKNP and SplitKKOT have run a round of every length, more
+        rounds of the same lengths leave ot_buffer_allocs unchanged. The
+        outputs of every round are checked.
+    */
+    inline void OTBuffer_alloc_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 33000);
+        const int L = 5000, S = 300, N = 4, l = 2;
+        sci::IOPack alice(sci::ALICE, port, MEM_IO_ADDRESS);
+        sci::IOPack bob(sci::BOB, port, MEM_IO_ADDRESS);
+
+        sci::IKNP<sci::NetIO> iknpA(alice.io), iknpB(bob.io);
+        sci::KKOT<sci::NetIO> kkotA(alice.io), kkotB(bob.io);
+        sci::SplitIKNP<sci::NetIO> splitA(sci::ALICE, alice.io), splitB(sci::BOB, bob.io);
+        sci::SplitKKOT<sci::NetIO> skkotA(sci::ALICE, alice.io, N), skkotB(sci::BOB, bob.io, N);
+        splitA.set_precomp_batch_size(1000);
+        splitB.set_precomp_batch_size(1000);
+        skkotA.set_precomp_batch_size(1000);
+        skkotB.set_precomp_batch_size(1000);
+
+        sci::PRG128 prg;
+        sci::OTBuffer<sci::Block128> d0Buf, d1Buf, outBuf, bmBuf;
+        sci::block128* d0 = d0Buf.get(L), * d1 = d1Buf.get(L), * out = outBuf.get(L),
+            * bmb = bmBuf.get(L * N);
+        sci::block128** bm = new sci::block128*[L];
+        std::vector<u8> mb(L * N), c(L), cb(L), o(L);
+        std::vector<u8*> m(L);
+        std::unique_ptr<bool[]> r(new bool[L]);
+        prg.random_block(d0, L);
+        prg.random_block(d1, L);
+        prg.random_block(bmb, L * N);
+        prg.random_bool(r.get(), L);
+        prg.random_data(mb.data(), L * N);
+        prg.random_data(c.data(), L);
+        for (int i = 0; i < L; ++i)
+        {
+            m[i] = mb.data() + N * i;
+            bm[i] = bmb + N * i;
+            for (int k = 0; k < N; ++k)
+                m[i][k] &= 3;
+            c[i] &= 3;
+            cb[i] = c[i] & 1;
+        }
+
+        std::atomic<bool> failed(false);
+        auto check = [&](bool ok) { if (!ok) failed = true; };
+        auto round = [&] {
+            sciRunParties([&] {
+                iknpA.send(d0, d1, L);
+                kkotA.send(bm, L, N);
+                splitA.send(d0, d1, L);
+                splitA.send(m.data(), S, l);
+                splitA.send(m.data(), L, l);
+                skkotA.send(m.data(), S, l);
+                skkotA.send(m.data(), L, l);
+                alice.io->flush();
+            }, [&] {
+                iknpB.recv(out, r.get(), L);
+                for (int i = 0; i < L; ++i)
+                    check(sci::cmpBlock(&out[i], r[i] ? &d1[i] : &d0[i], 1));
+                kkotB.recv(out, c.data(), L, N);
+                for (int i = 0; i < L; ++i)
+                    check(sci::cmpBlock(&out[i], &bm[i][c[i]], 1));
+                splitB.recv(out, r.get(), L);
+                for (int i = 0; i < L; ++i)
+                    check(sci::cmpBlock(&out[i], r[i] ? &d1[i] : &d0[i], 1));
+                splitB.recv(o.data(), cb.data(), S, l);
+                for (int i = 0; i < S; ++i)
+                    check(o[i] == m[i][cb[i]]);
+                splitB.recv(o.data(), cb.data(), L, l);
+                for (int i = 0; i < L; ++i)
+                    check(o[i] == m[i][cb[i]]);
+                skkotB.recv(o.data(), c.data(), S, l);
+                for (int i = 0; i < S; ++i)
+                    check(o[i] == m[i][c[i]]);
+                skkotB.recv(o.data(), c.data(), L, l);
+                for (int i = 0; i < L; ++i)
+                    check(o[i] == m[i][c[i]]);
+                bob.io->flush();
+            });
+        };
+
+        round();
+        u64 allocs = sci::ot_buffer_allocs();
+        for (int t = 0; t < 4; ++t)
+            round();
+        delete[] bm;
+
+        if (failed)
+            throw std::runtime_error("wrong OT output. " LOCATION);
+        if (sci::ot_buffer_allocs() != allocs)
+            throw std::runtime_error("OT buffers allocated after warm-up. " LOCATION);
+    }
+    /*
+        Runs SplitIKNP and SplitKKOT with the background precomputation
+        thread over many batch switches: calls that cross a batch, one that
+        spans several, a stop and restart of the thread and a change of the
+        batch size. Every output must match the chosen message.
+    */
+    inline void OT_precomp_thread_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 33100);
+        const int B = 1 << 12, len = 700, calls = 40, big = 3 * B + 77;
+        sci::PRG128 prg;
+        std::vector<u8> msgs(big * 16), ch(big), out(big);
+        std::vector<u8*> rows(big);
+        prg.random_data(msgs.data(), msgs.size());
+        prg.random_data(ch.data(), big);
+        for (int i = 0; i < big; ++i)
+            rows[i] = msgs.data() + i * 16;
+
+        // ot(party, io) -> OT; N messages of l bits per OT.
+        auto run = [&](auto make, int N, int l, int portOffset) {
+            std::vector<u8> choice(big);
+            for (int i = 0; i < big; ++i)
+                choice[i] = ch[i] & (N - 1);
+            std::vector<u8> masked(msgs.size());
+            for (u64 i = 0; i < msgs.size(); ++i)
+                masked[i] = msgs[i] & ((1 << l) - 1);
+            for (int i = 0; i < big; ++i)
+                rows[i] = masked.data() + i * 16;
+
+            auto steps = [&](auto& ot, int c) {
+                if (c == 10)
+                    ot.stop_precomp_thread();
+                if (c == 13)
+                    ot.start_precomp_thread(2);
+                if (c == 25)
+                    ot.set_precomp_batch_size(B / 2 + 300);
+                return c == 18 ? big : len;
+            };
+
+            sci::IOPack alice(sci::ALICE, port + portOffset, MEM_IO_ADDRESS);
+            sci::IOPack bob(sci::BOB, port + portOffset, MEM_IO_ADDRESS);
+            u64 bad = 0;
+            sciRunParties([&] {
+                auto ot = make(sci::ALICE, alice.io, N);
+                ot->set_precomp_batch_size(B);
+                ot->start_precomp_thread();
+                for (int c = 0; c < calls; ++c)
+                    ot->send(rows.data(), steps(*ot, c), l);
+                alice.io->flush();
+                delete ot;
+            }, [&] {
+                auto ot = make(sci::BOB, bob.io, N);
+                ot->set_precomp_batch_size(B);
+                ot->start_precomp_thread();
+                for (int c = 0; c < calls; ++c)
+                {
+                    int n = steps(*ot, c);
+                    ot->recv(out.data(), choice.data(), n, l);
+                    for (int i = 0; i < n; ++i)
+                        bad += out[i] != rows[i][choice[i]];
+                }
+                bob.io->flush();
+                delete ot;
+            });
+            if (bad)
+                throw std::runtime_error("wrong OT output with the precomputation thread. " LOCATION);
+        };
+
+        run([](int party, sci::NetIO* io, int) { return new sci::SplitIKNP<sci::NetIO>(party, io); }, 2, 8, 0);
+        run([](int party, sci::NetIO* io, int N) { return new sci::SplitKKOT<sci::NetIO>(party, io, N); }, 16, 4, 1);
+    }
+    /*
+        Runs IKNP random OTs and SplitIKNP chosen-message OTs with 1 and 3
+        extension threads on either side. The length spans 5 chunks, which
+        3 threads take in waves of 3 and 2. The IKNP base-OT keys are fixed,
+        so every pairing of thread counts must give the random OTs of 1 and
+        1, and every output must match the chosen message.
+    */
+    inline void IKNP_threads_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 33600);
+        const int L = 5 * (1 << 14) - 1000, l = 8;
+        sci::PRG128 prg;
+        sci::OTBuffer<sci::Block128> keyBuf, ref0Buf, ref1Buf, d0Buf, d1Buf, outBuf;
+        sci::block128* k0 = keyBuf.get(3 * 128), * k1 = k0 + 128, * ks = k1 + 128;
+        sci::block128* ref0 = ref0Buf.get(L), * ref1 = ref1Buf.get(L),
+            * d0 = d0Buf.get(L), * d1 = d1Buf.get(L), * out = outBuf.get(L);
+        bool s[128];
+        std::unique_ptr<bool[]> r(new bool[L]);
+        prg.random_block(k0, 2 * 128);
+        prg.random_bool(s, 128);
+        prg.random_bool(r.get(), L);
+        for (int i = 0; i < 128; ++i)
+            ks[i] = s[i] ? k1[i] : k0[i];
+
+        std::vector<u8> m(2 * L), c(L), o(L);
+        std::vector<u8*> rows(L);
+        prg.random_data(m.data(), m.size());
+        for (int i = 0; i < L; ++i)
+        {
+            rows[i] = m.data() + 2 * i;
+            c[i] = r[i];
+        }
+
+        const int threads[4][2] = { { 1, 1 }, { 3, 3 }, { 1, 3 }, { 3, 1 } };
+        for (int t = 0; t < 4; ++t)
+        {
+            sci::IOPack alice(sci::ALICE, port + t, MEM_IO_ADDRESS);
+            sci::IOPack bob(sci::BOB, port + t, MEM_IO_ADDRESS);
+            sciRunParties([&] {
+                sci::IKNP<sci::NetIO> iknp(alice.io);
+                iknp.num_threads = threads[t][0];
+                iknp.setup_send(ks, s);
+                iknp.send_rot(d0, d1, L);
+                sci::SplitIKNP<sci::NetIO> split(sci::ALICE, alice.io);
+                split.num_threads = threads[t][0];
+                split.send(rows.data(), L, l);
+                alice.io->flush();
+            }, [&] {
+                sci::IKNP<sci::NetIO> iknp(bob.io);
+                iknp.num_threads = threads[t][1];
+                iknp.setup_recv(k0, k1);
+                iknp.recv_rot(out, r.get(), L);
+                sci::SplitIKNP<sci::NetIO> split(sci::BOB, bob.io);
+                split.num_threads = threads[t][1];
+                split.recv(o.data(), c.data(), L, l);
+                bob.io->flush();
+            });
+
+            if (t == 0)
+            {
+                memcpy(ref0, d0, L * sizeof(sci::block128));
+                memcpy(ref1, d1, L * sizeof(sci::block128));
+            }
+            if (!sci::cmpBlock(d0, ref0, L) || !sci::cmpBlock(d1, ref1, L))
+                throw std::runtime_error("IKNP output depends on num_threads. " LOCATION);
+            for (int i = 0; i < L; ++i)
+                if (!sci::cmpBlock(&out[i], r[i] ? &d1[i] : &d0[i], 1) || o[i] != rows[i][c[i]])
+                    throw std::runtime_error("wrong OT output with num_threads > 1. " LOCATION);
+        }
+    }
+    /*
+        Checks the bit-packing kernels of OT/bit-pack.h for every width 1..64
+        against a bit-by-bit reference: pack_bits and unpack_bits on uint8_t
+        (widths up to 8) and uint64_t values, BitWriter with the compile-time
+        width of dispatch_bit_width against the runtime one, read_bits at
+        every position, and the AVX2 and (if the CPU has it) BMI2 kernels on
+        their own. The lengths cover empty, partial and whole words.
+    */
+    inline void bit_pack_test(const CLP& cmd)
+    {
+        sci::PRG128 prg;
+        auto fail = [](const char* what) {
+            throw std::runtime_error(std::string("bit_pack_test: ") + what + " " LOCATION);
+        };
+
+        for (int w = 1; w <= 64; ++w)
+        for (u64 n : { 0, 1, 7, 8, 9, 31, 32, 33, 63, 64, 65, 200, 1001 })
+        {
+            const u64 nbytes = (n * w + 7) / 8, mask = sci::bit_mask(w);
+            std::vector<u64> v(n);
+            prg.random_data(v.data(), n * 8);
+            for (auto& x : v)
+                x &= mask;
+
+            std::vector<u8> ref(nbytes + 8, 0);
+            for (u64 i = 0; i < n; ++i)
+                for (int b = 0; b < w; ++b)
+                    ref[(i * w + b) / 8] |= u8(((v[i] >> b) & 1) << ((i * w + b) % 8));
+
+            // BitWriter: the dispatched width and the runtime width.
+            std::vector<u8> bits0(nbytes + 8, 0xff), bitsW(nbytes + 8, 0xff);
+            sci::BitWriter<0> bw0(bits0.data(), w);
+            for (auto x : v)
+                bw0.put(x);
+            bw0.finish(bits0.data() + nbytes + 8);
+            sci::dispatch_bit_width(w, [&](auto W) {
+                sci::BitWriter<decltype(W)::value> bw(bitsW.data(), w);
+                for (auto x : v)
+                    bw.put(x);
+                bw.finish(bitsW.data() + nbytes + 8);
+            });
+            if (bits0 != ref || bitsW != ref)
+                fail("BitWriter");
+
+            for (u64 i = 0; i < n; ++i)
+                if (sci::read_bits(ref.data(), nbytes, i * w, w) != v[i])
+                    fail("read_bits");
+
+            std::vector<u8> packed(nbytes + 8, 0xff);
+            sci::pack_bits(packed.data(), nbytes + 8, v.data(), n, w);
+            if (packed != ref)
+                fail("pack_bits u64");
+            std::vector<u64> back(n);
+            sci::unpack_bits(back.data(), ref.data(), n, w);
+            if (back != v)
+                fail("unpack_bits u64");
+
+            if (w > 8)
+                continue;
+            std::vector<u8> v8(v.begin(), v.end()), back8(n);
+            std::fill(packed.begin(), packed.end(), 0xff);
+            sci::pack_bits(packed.data(), nbytes + 8, v8.data(), n, w);
+            if (packed != ref)
+                fail("pack_bits u8");
+            sci::unpack_bits(back8.data(), ref.data(), n, w);
+            if (back8 != v8)
+                fail("unpack_bits u8");
+
+            // The vector kernels on their own; they stop at whole groups.
+            std::vector<u8> out(nbytes + 8, 0);
+            if (w == 1)
+            {
+                u64 done = sci::pack_u8_bits_avx2(out.data(), v8.data(), n);
+                if (!std::equal(out.begin(), out.begin() + done / 8, ref.begin()))
+                    fail("pack_u8_bits_avx2");
+                done = sci::pack_u64_bits_avx2(out.data(), v.data(), n);
+                if (!std::equal(out.begin(), out.begin() + done / 8, ref.begin()))
+                    fail("pack_u64_bits_avx2");
+            }
+            if (w < 8 && sci::bit_pack_has_bmi2())
+            {
+                u64 done = sci::pack_u8_bmi2(out.data(), v8.data(), n, w);
+                if (!std::equal(out.begin(), out.begin() + done * w / 8, ref.begin()))
+                    fail("pack_u8_bmi2");
+                std::fill(back8.begin(), back8.end(), 0);
+                done = sci::unpack_u8_bmi2(back8.data(), ref.data(), n, w);
+                if (!std::equal(back8.begin(), back8.begin() + done, v8.begin()))
+                    fail("unpack_u8_bmi2");
+            }
+        }
+    }
+    /*
+        Runs two TripleBanks one after the other on the same generators, the
+        first with _16KKOT_to_4OT and the second with _2ROT, so the second
+        starts after ALICE's stop flag ended the first pair of producers.
+        Each party leases the same sequence of sizes, some spanning several
+        batches and in total several times the pool, so the producers must
+        refill. Every leased triple must satisfy (a ^ a') & (b ^ b') = c ^ c'
+        and the pool never holds more than max_batches batches.
+    */
+    inline void TripleBank_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 33200);
+        const int batchTriples = 1024, maxBatches = 2, numLeases = 60;
+        const u64 maxBytes = maxBatches * batchTriples / 8;
+        std::vector<int> sizes(numLeases);
+        sci::PRG128 prg;
+        for (auto& n : sizes)
+        {
+            prg.random_data(&n, sizeof(n));
+            n = 1 + (n & 0x7fffffff) % 400;
+        }
+
+        std::vector<u8> a[3], b[3], c[3];
+        std::atomic<bool> failed(false);
+        auto party = [&](int p) {
+            sci::IOPack iopack(p, port, MEM_IO_ADDRESS);
+            sci::OTPack otpack(&iopack, p);
+            TripleGenerator gen(p, &iopack, &otpack);
+            for (auto method : { _16KKOT_to_4OT, _2ROT })
+            {
+                TripleBank bank(p, &gen, method, batchTriples, maxBatches);
+                u64 leased = 0;
+                for (int n : sizes)
+                {
+                    u64 pos = a[p].size();
+                    for (auto v : { &a[p], &b[p], &c[p] })
+                        v->resize(pos + n);
+                    bank.lease(a[p].data() + pos, b[p].data() + pos, c[p].data() + pos, n);
+                    leased += n;
+                    if (bank.available() > maxBytes)
+                        failed = true;
+                }
+                if (bank.num_leased != leased || bank.num_batches * batchTriples / 8 < leased)
+                    failed = true;
+            }
+        };
+        sciRunParties([&] { party(sci::ALICE); }, [&] { party(sci::BOB); });
+
+        if (failed || a[1].size() != a[2].size())
+            throw std::runtime_error("TripleBank lease or refill failed. " LOCATION);
+        for (u64 i = 0; i < a[1].size(); ++i)
+            if (((a[1][i] ^ a[2][i]) & (b[1][i] ^ b[2][i])) != (c[1][i] ^ c[2][i]))
+                throw std::runtime_error("invalid triple leased from TripleBank. " LOCATION);
+    }
+    /*
+        Runs the same MillionaireProtocol compares without and with a
+        TripleBank attached (on its own IOPack and OTPack). Both runs must
+        reconstruct to x_ALICE > x_BOB for every pair, with some equal pairs
+        and several bitlengths.
+    */
+    inline void Millionaire_bank_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 33300);
+        const int n = 3000;
+        sci::PRG128 prg;
+        std::vector<u64> x[3];
+        for (int p = 1; p <= 2; ++p)
+        {
+            x[p].resize(n);
+            prg.random_data(x[p].data(), n * sizeof(u64));
+        }
+        for (int i = 0; i < n; i += 5)
+            x[2][i] = x[1][i];
+
+        const std::vector<int> bitlengths = { 1, 7, 32, 64 };
+        // res[p][bank][j] are party p's shares of the compares at bitlengths[j].
+        std::vector<u8> res[3][2][4];
+        std::atomic<bool> unused(false);
+        auto party = [&](int p) {
+            sci::IOPack iopack(p, port, MEM_IO_ADDRESS);
+            sci::OTPack otpack(&iopack, p);
+            MillionaireProtocol mill(p, &iopack, &otpack);
+            sci::IOPack bankIO(p, port + 1, MEM_IO_ADDRESS);
+            sci::OTPack bankOT(&bankIO, p);
+            TripleGenerator bankGen(p, &bankIO, &bankOT);
+            std::vector<u64> data(n);
+            for (int bank = 0; bank < 2; ++bank)
+            {
+                TripleBank* tb = bank ? new TripleBank(p, &bankGen, _16KKOT_to_4OT, 1 << 14, 2) : nullptr;
+                mill.triple_bank = tb;
+                for (u64 j = 0; j < bitlengths.size(); ++j)
+                {
+                    int l = bitlengths[j];
+                    for (int i = 0; i < n; ++i)
+                        data[i] = x[p][i] & sci::bit_mask(l);
+                    res[p][bank][j].resize(n);
+                    mill.compare(res[p][bank][j].data(), data.data(), n, l);
+                }
+                mill.triple_bank = nullptr;
+                if (tb && tb->num_leased == 0)
+                    unused = true;
+                delete tb;
+            }
+        };
+        sciRunParties([&] { party(sci::ALICE); }, [&] { party(sci::BOB); });
+
+        if (unused)
+            throw std::runtime_error("the compares did not lease from TripleBank. " LOCATION);
+        for (u64 j = 0; j < bitlengths.size(); ++j)
+        {
+            auto mask = sci::bit_mask(bitlengths[j]);
+            for (int i = 0; i < n; ++i)
+            {
+                u8 expected = (x[1][i] & mask) > (x[2][i] & mask);
+                u8 plain = res[1][0][j][i] ^ res[2][0][j][i];
+                u8 banked = res[1][1][j][i] ^ res[2][1][j][i];
+                if (plain != expected || banked != plain)
+                    throw std::runtime_error("compare with TripleBank differs. " LOCATION);
+            }
+        }
+    }
+    /*
+        Streams compares through MillionaireProtocol::compare_stream,
+        MillionaireWithEquality::compare_with_eq_stream and
+        ParallelMillionaire::compare_stream, each first with no compares at
+        all and then with a count that is not a multiple of the window. The
+        empty calls must not touch res or the channels, so the following
+        calls still agree.
+    */
+    inline void Millionaire_stream_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 33400);
+        const u64 n = 10007;
+        const int l = 40, window = 1001;
+        sci::PRG128 prg;
+        std::vector<u64> x[3];
+        for (int p = 1; p <= 2; ++p)
+        {
+            x[p].resize(n);
+            prg.random_data(x[p].data(), n * sizeof(u64));
+            for (auto& v : x[p])
+                v &= sci::bit_mask(l);
+        }
+        for (u64 i = 0; i < n; i += 5)
+            x[2][i] = x[1][i];
+
+        std::vector<u8> res[3][3], eq[3];
+        std::atomic<bool> touched(false);
+        auto party = [&](int p) {
+            sci::IOPack iopack(p, port, MEM_IO_ADDRESS);
+            sci::OTPack otpack(&iopack, p);
+            MillionaireProtocol mill(p, &iopack, &otpack);
+            MillionaireWithEquality mwe(p, &iopack, &otpack);
+            ParallelMillionaire pm(p, &iopack, &otpack, 3, port + 1, MEM_IO_ADDRESS);
+            for (auto& r : res[p])
+                r.assign(n, 7);
+            eq[p].assign(n, 7);
+
+            mill.compare_stream(res[p][0].data(), x[p].data(), 0, l, true, MILL_PARAM, window);
+            mwe.compare_with_eq_stream(res[p][1].data(), eq[p].data(), x[p].data(), 0, l, true, MILL_PARAM, window);
+            pm.compare_stream(res[p][2].data(), x[p].data(), 0, l, true, MILL_PARAM, window);
+            for (auto& r : res[p])
+                if (r[0] != 7)
+                    touched = true;
+
+            mill.compare_stream(res[p][0].data(), x[p].data(), n, l, true, MILL_PARAM, window);
+            mwe.compare_with_eq_stream(res[p][1].data(), eq[p].data(), x[p].data(), n, l, true, MILL_PARAM, window);
+            pm.compare_stream(res[p][2].data(), x[p].data(), n, l, true, MILL_PARAM, window);
+        };
+        sciRunParties([&] { party(sci::ALICE); }, [&] { party(sci::BOB); });
+
+        if (touched)
+            throw std::runtime_error("an empty compare_stream wrote to res. " LOCATION);
+        for (int k = 0; k < 3; ++k)
+            for (u64 i = 0; i < n; ++i)
+                if ((res[1][k][i] ^ res[2][k][i]) != (x[1][i] > x[2][i]))
+                    throw std::runtime_error("wrong streamed compare. " LOCATION);
+        for (u64 i = 0; i < n; ++i)
+            if ((eq[1][i] ^ eq[2][i]) != (x[1][i] == x[2][i]))
+                throw std::runtime_error("wrong streamed equality. " LOCATION);
+    }
+    /*
+        Runs a compare with every candidate MillParams (both triple methods,
+        radix 2, 4, 7 and 8, with and without correlated triples) at a few
+        bitlengths, then tunes a MillionaireProtocol with MillTuner on them
+        and runs a compare with every choice. Every compare must reconstruct
+        to the plaintext result, and both parties must pick the same
+        MillParams.
+    */
+    inline void MillTuner_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 33500);
+        const int n = 2000;
+        const std::vector<int> bitlengths = { 8, 33, 64 };
+        const std::vector<u64> counts = { 1, 100, 1 << 20 };
+        std::vector<MillParams> cands;
+        for (auto method : { _16KKOT_to_4OT, _2ROT })
+            for (int radix : { 2, 4, 7, 8 })
+                for (bool corr : { false, true })
+                {
+                    MillParams c;
+                    c.radix_base = radix;
+                    c.corr_triples = corr;
+                    c.std_method = method;
+                    cands.push_back(c);
+                }
+
+        sci::PRG128 prg;
+        std::vector<u64> x[3];
+        for (int p = 1; p <= 2; ++p)
+        {
+            x[p].resize(n);
+            prg.random_data(x[p].data(), n * sizeof(u64));
+        }
+        for (int i = 0; i < n; i += 3)
+            x[2][i] = x[1][i];
+
+        std::vector<MillParams> chosen[3];
+        std::vector<std::vector<u8>> res[3], candRes[3];
+        auto party = [&](int p) {
+            sci::IOPack iopack(p, port, MEM_IO_ADDRESS);
+            sci::OTPack otpack(&iopack, p);
+            MillionaireProtocol mill(p, &iopack, &otpack);
+            std::vector<u64> data(n);
+            for (int l : bitlengths)
+            {
+                for (int i = 0; i < n; ++i)
+                    data[i] = x[p][i] & sci::bit_mask(l);
+                for (auto& c : cands)
+                {
+                    candRes[p].emplace_back(n);
+                    mill.compare(candRes[p].back().data(), data.data(), n, l, true, c);
+                }
+            }
+
+            MillTuner tuner(p, &iopack);
+            tuner.measure_link(4, 1 << 16);
+            for (int l : bitlengths)
+                tuner.autotune(&mill, l, 256, cands);
+
+            for (int l : bitlengths)
+                for (u64 num : counts)
+                {
+                    chosen[p].push_back(tuner.choose(l, num));
+                    for (int i = 0; i < n; ++i)
+                        data[i] = x[p][i] & sci::bit_mask(l);
+                    res[p].emplace_back(n);
+                    mill.compare(res[p].back().data(), data.data(), n, l, true, chosen[p].back());
+                }
+        };
+        sciRunParties([&] { party(sci::ALICE); }, [&] { party(sci::BOB); });
+
+        u64 k = 0;
+        for (int l : bitlengths)
+            for (auto& c : cands)
+            {
+                auto mask = sci::bit_mask(l);
+                for (int i = 0; i < n; ++i)
+                    if ((candRes[1][k][i] ^ candRes[2][k][i]) != ((x[1][i] & mask) > (x[2][i] & mask)))
+                        throw std::runtime_error("wrong compare at radix " + std::to_string(c.radix_base) +
+                            ", corr_triples " + std::to_string(c.corr_triples) + ", std_method " +
+                            std::to_string(c.std_method) + ", l " + std::to_string(l) + ". " LOCATION);
+                ++k;
+            }
+
+        k = 0;
+        for (int l : bitlengths)
+            for (u64 num : counts)
+            {
+                (void)num;
+                auto& a = chosen[1][k];
+                auto& b = chosen[2][k];
+                if (a.radix_base != b.radix_base || a.corr_triples != b.corr_triples ||
+                    a.std_method != b.std_method)
+                    throw std::runtime_error("the parties chose different MillParams. " LOCATION);
+                auto mask = sci::bit_mask(l);
+                for (int i = 0; i < n; ++i)
+                    if ((res[1][k][i] ^ res[2][k][i]) != ((x[1][i] & mask) > (x[2][i] & mask)))
+                        throw std::runtime_error("wrong compare with the tuned MillParams. " LOCATION);
+                ++k;
+            }
+    }
+    /*
+        Saves an OTPack setup with SaveSetup and resumes it with LoadSetup.
+        Two packs loaded from the same saved state must give both parties
+        the same outputs for the next batch of random OTs, and those must be
+        valid OTs that differ from the saved session's. Every PRG counter
+        must resume above the largest saved one, and a second resume above
+        the first. A wrong key, a truncated file or a missing file on either
+        side makes LoadSetup return false on both sides.
+    */
+    inline void OTPack_resume_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 33700);
+        std::string base = cmd.getOr<std::string>("setupPath", "OTPack_resume_test");
+        const int L = 5000, N = 16, l = 4;
+        const sci::block128 key = sci::makeBlock128(1, 2), wrongKey = sci::makeBlock128(1, 3);
+        auto path = [&](int p, int copy) { return base + "." + std::to_string(p) + "." + std::to_string(copy); };
+
+        sci::PRG128 prg;
+        std::unique_ptr<bool[]> r(new bool[L]);
+        std::vector<u8> msgs(L * N), c(L);
+        std::vector<u8*> rows(L);
+        prg.random_bool(r.get(), L);
+        prg.random_data(msgs.data(), msgs.size());
+        prg.random_data(c.data(), L);
+        for (int i = 0; i < L; ++i)
+        {
+            rows[i] = msgs.data() + N * i;
+            for (int k = 0; k < N; ++k)
+                rows[i][k] &= (1 << l) - 1;
+            c[i] &= N - 1;
+        }
+
+        // out[p] holds party p's random OTs: sender outputs d0, d1 of the
+        // instance it sends on, then receiver outputs of the other one.
+        struct Outputs { std::vector<u8> d0, d1, recv; };
+        std::atomic<bool> failed(false);
+        auto runOTs = [&](sci::OTPack& op, int p, Outputs& out) {
+            auto* sender = p == sci::ALICE ? op.iknp_straight : op.iknp_reversed;
+            auto* receiver = p == sci::ALICE ? op.iknp_reversed : op.iknp_straight;
+            out.d0.resize(L);
+            out.d1.resize(L);
+            out.recv.resize(L);
+            std::vector<u8> o(L);
+            if (p == sci::ALICE)
+            {
+                sender->send_rot(out.d0.data(), out.d1.data(), L);
+                receiver->recv_rot(out.recv.data(), r.get(), L);
+                op.kkot[3]->send(rows.data(), L, l);
+            }
+            else
+            {
+                receiver->recv_rot(out.recv.data(), r.get(), L);
+                sender->send_rot(out.d0.data(), out.d1.data(), L);
+                op.kkot[3]->recv(o.data(), c.data(), L, l);
+                for (int i = 0; i < L; ++i)
+                    if (o[i] != rows[i][c[i]])
+                        failed = true;
+            }
+            op.iopack->io->flush();
+            op.iopack->io_rev->flush();
+        };
+        auto checkOTs = [&](Outputs* out) {
+            for (int p = 1; p <= 2; ++p)
+                for (int i = 0; i < L; ++i)
+                    if (out[3 - p].recv[i] != (r[i] ? out[p].d1[i] : out[p].d0[i]))
+                        throw std::runtime_error("wrong OT output after LoadSetup. " LOCATION);
+        };
+        // smallest and largest PRG counter over every instance of a pack.
+        auto counters = [](sci::OTPack& op, u64& lo, u64& hi) {
+            lo = ~0ull;
+            hi = 0;
+            auto scan = [&](auto* ot) {
+                for (int i = 0; i < ot->lambda; ++i)
+                    for (auto ctr : { ot->G0[i].counter, ot->G1[i].counter })
+                    {
+                        lo = std::min<u64>(lo, ctr);
+                        hi = std::max<u64>(hi, ctr);
+                    }
+            };
+            for (int i = 0; i < KKOT_TYPES; ++i)
+                scan(op.kkot[i]);
+            scan(op.iknp_straight);
+            scan(op.iknp_reversed);
+        };
+        // runs f(p, iopack) for both parties on a fresh pair of IOPacks.
+        int session = 0;
+        auto both = [&](auto f) {
+            int sport = port + session++;
+            sciRunParties([&] {
+                sci::IOPack iopack(sci::ALICE, sport, MEM_IO_ADDRESS);
+                f(sci::ALICE, iopack);
+            }, [&] {
+                sci::IOPack iopack(sci::BOB, sport, MEM_IO_ADDRESS);
+                f(sci::BOB, iopack);
+            });
+        };
+
+        // The saved session, saved twice so that two packs can resume it.
+        Outputs saved[3], resumed[3], again[3], second[3];
+        u64 savedMax[3], lo[3], hi[3];
+        both([&](int p, sci::IOPack& iopack) {
+            sci::OTPack op(&iopack, p);
+            runOTs(op, p, saved[p]);
+            counters(op, lo[p], savedMax[p]);
+            if (!op.SaveSetup(path(p, 0), key) || !op.SaveSetup(path(p, 1), key))
+                failed = true;
+        });
+        if (failed)
+            throw std::runtime_error("SaveSetup failed. " LOCATION);
+        checkOTs(saved);
+
+        for (int copy = 0; copy < 2; ++copy)
+        {
+            auto& out = copy ? again : resumed;
+            both([&](int p, sci::IOPack& iopack) {
+                sci::OTPack op(&iopack, p, false);
+                if (!op.LoadSetup(path(p, copy), key) || !op.do_setup)
+                    failed = true;
+                counters(op, lo[p], hi[p]);
+                runOTs(op, p, out[p]);
+            });
+            if (failed)
+                throw std::runtime_error("LoadSetup failed. " LOCATION);
+            checkOTs(out);
+            for (int p = 1; p <= 2; ++p)
+                if (lo[p] != hi[p] || lo[p] <= std::max(savedMax[1], savedMax[2]) ||
+                    lo[p] % OT_RESUME_STRIDE)
+                    throw std::runtime_error("PRG counters do not resume above the saved ones. " LOCATION);
+        }
+        for (int p = 1; p <= 2; ++p)
+        {
+            if (resumed[p].d0 != again[p].d0 || resumed[p].d1 != again[p].d1 ||
+                resumed[p].recv != again[p].recv)
+                throw std::runtime_error("two resumes of one setup differ. " LOCATION);
+            if (resumed[p].d0 == saved[p].d0 || resumed[p].d1 == saved[p].d1)
+                throw std::runtime_error("the resumed OTs repeat the saved session. " LOCATION);
+        }
+
+        // The rewritten file resumes a second time past the first resume.
+        u64 firstResume = lo[1];
+        both([&](int p, sci::IOPack& iopack) {
+            sci::OTPack op(&iopack, p, false);
+            if (!op.LoadSetup(path(p, 0), key))
+                failed = true;
+            counters(op, lo[p], hi[p]);
+            runOTs(op, p, second[p]);
+        });
+        if (failed || lo[1] != firstResume + OT_RESUME_STRIDE || lo[2] != lo[1])
+            throw std::runtime_error("a second LoadSetup does not move past the first. " LOCATION);
+        checkOTs(second);
+        if (second[1].d0 == resumed[1].d0 || second[2].d0 == resumed[2].d0)
+            throw std::runtime_error("the second resume repeats the first. " LOCATION);
+
+        // Failures on one side only; both must return false.
+        auto mustFail = [&](const char* what, int bad, auto makeKey) {
+            bool ok[3] = { false, true, true };
+            both([&](int p, sci::IOPack& iopack) {
+                sci::OTPack op(&iopack, p, false);
+                ok[p] = op.LoadSetup(path(p, 1), makeKey(p)) || op.do_setup;
+            });
+            if (ok[1] || ok[2])
+                throw std::runtime_error(std::string("LoadSetup succeeded with ") + what +
+                    " on party " + std::to_string(bad) + ". " LOCATION);
+        };
+        for (int bad = 1; bad <= 2; ++bad)
+            mustFail("a wrong key", bad, [&](int p) { return p == bad ? wrongKey : key; });
+
+        for (int bad = 1; bad <= 2; ++bad)
+        {
+            std::string file = path(bad, 1), contents;
+            {
+                std::ifstream in(file, std::ios::binary);
+                contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            }
+            for (u64 size : { contents.size() - 1, contents.size() / 2, u64(10) })
+            {
+                std::ofstream(file, std::ios::binary | std::ios::trunc).write(contents.data(), size);
+                mustFail("a truncated file", bad, [&](int) { return key; });
+            }
+            std::remove(file.c_str());
+            mustFail("a missing file", bad, [&](int) { return key; });
+            std::ofstream(file, std::ios::binary).write(contents.data(), contents.size());
+        }
+        for (int p = 1; p <= 2; ++p)
+            for (int copy = 0; copy < 2; ++copy)
+                std::remove(path(p, copy).c_str());
+    }
+    /*
+        Runs Naor-Pinkas base OTs of 128- and 256-bit messages through
+        OTNP::send_batched and recv_batched, with batch counts that are not
+        powers of two and do not divide among 3 threads, on 1 and 3 threads
+        per side. Every output must match the chosen message.
+    */
+    inline void OTNP_batched_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 33800);
+        const std::vector<int> lengths = { 3, 13, 100, 129 };
+        const int maxLen = 129;
+        sci::PRG128 prg;
+        sci::OTBuffer<sci::Block128> m128Buf, out128Buf;
+        sci::OTBuffer<sci::Block256> m256Buf, out256Buf;
+        sci::block128* m128 = m128Buf.get(2 * maxLen), * out128 = out128Buf.get(maxLen);
+        sci::block256* m256 = m256Buf.get(2 * maxLen), * out256 = out256Buf.get(maxLen);
+        std::unique_ptr<bool[]> b(new bool[maxLen]);
+        prg.random_block(m128, 2 * maxLen);
+        prg.random_block(m256, 2 * maxLen);
+        prg.random_bool(b.get(), maxLen);
+
+        const int threads[2][2] = { { 1, 1 }, { 3, 3 } };
+        for (int t = 0; t < 2; ++t)
+        {
+            sci::IOPack alice(sci::ALICE, port + t, MEM_IO_ADDRESS);
+            sci::IOPack bob(sci::BOB, port + t, MEM_IO_ADDRESS);
+            for (int len : lengths)
+            {
+                sciRunParties([&] {
+                    sci::OTNP<sci::NetIO> np(alice.io);
+                    np.num_threads = threads[t][0];
+                    np.send(m128, m128 + maxLen, len);
+                    np.send(m256, m256 + maxLen, len);
+                    alice.io->flush();
+                }, [&] {
+                    sci::OTNP<sci::NetIO> np(bob.io);
+                    np.num_threads = threads[t][1];
+                    np.recv(out128, b.get(), len);
+                    np.recv(out256, b.get(), len);
+                    bob.io->flush();
+                });
+                for (int i = 0; i < len; ++i)
+                    if (!sci::cmpBlock(&out128[i], &m128[b[i] ? maxLen + i : i], 1) ||
+                        !sci::cmpBlock(&out256[i], &m256[b[i] ? maxLen + i : i], 1))
+                        throw std::runtime_error("wrong OTNP output. " LOCATION);
+            }
+        }
+    }
+#ifdef SCI_USE_SODIUM
+    /*
+        Sets up OTPacks with the Chou-Orlandi base OTs (BASE_OT_CO), once
+        with a base-OT run per instance and once with the derived setup,
+        and checks that the extensions then give valid OTs: chosen-message
+        KKOT, chosen-message IKNP on the straight channel and random IKNP
+        on the reversed one.
+    */
+    inline void OTPack_base_ot_co_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 33900);
+        const int L = 3000, N = 16, l = 4;
+        sci::PRG128 prg;
+        sci::OTBuffer<sci::Block128> d0Buf, d1Buf, outBuf;
+        sci::block128* d0 = d0Buf.get(L), * d1 = d1Buf.get(L), * out = outBuf.get(L);
+        std::unique_ptr<bool[]> r(new bool[L]);
+        std::vector<u8> msgs(L * N), c(L), o(L), rot0(L), rot1(L), rot(L);
+        std::vector<u8*> rows(L);
+        prg.random_block(d0, L);
+        prg.random_block(d1, L);
+        prg.random_bool(r.get(), L);
+        prg.random_data(msgs.data(), msgs.size());
+        prg.random_data(c.data(), L);
+        for (int i = 0; i < L; ++i)
+        {
+            rows[i] = msgs.data() + N * i;
+            for (int k = 0; k < N; ++k)
+                rows[i][k] &= (1 << l) - 1;
+            c[i] &= N - 1;
+        }
+
+        for (int derive = 0; derive < 2; ++derive)
+        {
+            std::atomic<bool> failed(false);
+            auto party = [&](int p) {
+                sci::IOPack iopack(p, port + derive, MEM_IO_ADDRESS);
+                sci::OTPack otpack(&iopack, p, true, derive, sci::BASE_OT_CO);
+                auto* base = otpack.kkot[0]->base_ot;
+                if (base->co == nullptr || base->np != nullptr)
+                    failed = true;
+                if (p == sci::ALICE)
+                {
+                    otpack.kkot[3]->send(rows.data(), L, l);
+                    otpack.iknp_straight->send(d0, d1, L);
+                    otpack.iknp_reversed->recv_rot(rot.data(), r.get(), L);
+                }
+                else
+                {
+                    otpack.kkot[3]->recv(o.data(), c.data(), L, l);
+                    otpack.iknp_straight->recv(out, r.get(), L);
+                    otpack.iknp_reversed->send_rot(rot0.data(), rot1.data(), L);
+                }
+                iopack.io->flush();
+                iopack.io_rev->flush();
+            };
+            sciRunParties([&] { party(sci::ALICE); }, [&] { party(sci::BOB); });
+
+            if (failed)
+                throw std::runtime_error("OTPack did not use the Chou-Orlandi base OTs. " LOCATION);
+            for (int i = 0; i < L; ++i)
+                if (o[i] != rows[i][c[i]] || !sci::cmpBlock(&out[i], r[i] ? &d1[i] : &d0[i], 1) ||
+                    rot[i] != (r[i] ? rot1[i] : rot0[i]))
+                    throw std::runtime_error("wrong OT output with Chou-Orlandi base OTs. " LOCATION);
+        }
+    }
+#endif
+    /*
+        Runs MillionaireWithEquality::compare_lt_eq_le at several bitlengths
+        and radixes, on inputs where every third pair is equal and with a
+        count that is not a multiple of 8. Each output is requested alone,
+        with the others nullptr, and all three together. Every requested
+        output must reconstruct to x < y, x == y or x <= y for ALICE's x and
+        BOB's y.
+    */
+    inline void Millionaire_lt_eq_le_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 34000);
+        const int n = 1003;
+        const std::vector<std::array<int, 2>> configs = {
+            { 1, MILL_PARAM }, { 7, 4 }, { 32, MILL_PARAM }, { 33, 2 }, { 64, 8 } };
+        // which outputs each call asks for: lt, eq, le.
+        const u8 want[4][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 1, 1 } };
+        sci::PRG128 prg;
+        std::vector<u64> x[3];
+        for (int p = 1; p <= 2; ++p)
+        {
+            x[p].resize(n);
+            prg.random_data(x[p].data(), n * sizeof(u64));
+        }
+        for (int i = 0; i < n; i += 3)
+            x[2][i] = x[1][i];
+
+        // res[p][config][call][output]
+        std::vector<std::array<std::array<std::vector<u8>, 3>, 4>> res[3];
+        auto party = [&](int p) {
+            sci::IOPack iopack(p, port, MEM_IO_ADDRESS);
+            sci::OTPack otpack(&iopack, p);
+            MillionaireWithEquality mwe(p, &iopack, &otpack);
+            std::vector<u64> data(n);
+            res[p].resize(configs.size());
+            for (u64 k = 0; k < configs.size(); ++k)
+            {
+                for (int i = 0; i < n; ++i)
+                    data[i] = x[p][i] & sci::bit_mask(configs[k][0]);
+                for (int call = 0; call < 4; ++call)
+                {
+                    u8* out[3];
+                    for (int o = 0; o < 3; ++o)
+                    {
+                        res[p][k][call][o].assign(want[call][o] ? n : 0, 7);
+                        out[o] = want[call][o] ? res[p][k][call][o].data() : nullptr;
+                    }
+                    mwe.compare_lt_eq_le(out[0], out[1], out[2], data.data(), n,
+                        configs[k][0], configs[k][1]);
+                }
+            }
+        };
+        sciRunParties([&] { party(sci::ALICE); }, [&] { party(sci::BOB); });
+
+        for (u64 k = 0; k < configs.size(); ++k)
+        {
+            auto mask = sci::bit_mask(configs[k][0]);
+            for (int call = 0; call < 4; ++call)
+                for (int i = 0; i < n; ++i)
+                {
+                    u64 a = x[1][i] & mask, b = x[2][i] & mask;
+                    const bool expected[3] = { a < b, a == b, a <= b };
+                    for (int o = 0; o < 3; ++o)
+                        if (want[call][o] &&
+                            (res[1][k][call][o][i] ^ res[2][k][call][o][i]) != expected[o])
+                            throw std::runtime_error("wrong compare_lt_eq_le output at l " +
+                                std::to_string(configs[k][0]) + ". " LOCATION);
+                }
+        }
+    }
+    /*
+        Runs MillionaireProtocol::compare_batch on groups of mixed
+        bitlengths (1 to 64), including an empty group and counts that are
+        not multiples of 8, at radix 2, 3, 4 and 8 and in both directions.
+        Every result must match the plaintext, and the empty group's res must
+        be left alone. ALICE only reads from io_rev to open the AND tree, so
+        her io_rev reads count its exchanges: the batch must take exactly as
+        many as a batch of its widest group alone, and fewer than the groups
+        compared one by one. A batch of only empty groups must not
+        communicate.
+    */
+    inline void Millionaire_batch_test(const CLP& cmd)
+    {
+        int port = cmd.getOr("port", 34100);
+        const std::vector<int> bitlengths = { 17, 1, 64, 33, 8, 40 };
+        const std::vector<int> counts = { 37, 9, 100, 0, 3, 64 };
+        const int numGroups = bitlengths.size(), widest = 2;
+        sci::PRG128 prg;
+        std::vector<u64> x[3][6];
+        for (int p = 1; p <= 2; ++p)
+            for (int g = 0; g < numGroups; ++g)
+            {
+                x[p][g].resize(std::max(counts[g], 1));
+                prg.random_data(x[p][g].data(), x[p][g].size() * sizeof(u64));
+                for (auto& v : x[p][g])
+                    v &= sci::bit_mask(bitlengths[g]);
+            }
+        for (int g = 0; g < numGroups; ++g)
+            for (int i = 0; i < counts[g]; i += 4)
+                x[2][g][i] = x[1][g][i];
+
+        // AND exchanges of the tree; num_rounds can't see them, since each
+        // level sends on one channel and receives on the other.
+        auto exchanges = [](sci::IOPack& iopack) { return iopack.io_rev->num_recv_calls; };
+        struct Run { int radix; bool gt; u64 batch, alone, sum, empty; std::vector<u8> res[3][6]; };
+        std::vector<Run> runs;
+        for (int radix : { 2, 3, 4, 8 })
+            for (bool gt : { true, false })
+            {
+                runs.emplace_back();
+                runs.back().radix = radix;
+                runs.back().gt = gt;
+            }
+
+        auto party = [&](int p) {
+            sci::IOPack iopack(p, port, MEM_IO_ADDRESS);
+            sci::OTPack otpack(&iopack, p);
+            MillionaireProtocol mill(p, &iopack, &otpack);
+            MillParams params;
+            params.corr_triples = false;
+            mill.set_params(params);
+            for (auto& run : runs)
+            {
+                u8* res[6];
+                u64* data[6];
+                for (int g = 0; g < numGroups; ++g)
+                {
+                    run.res[p][g].assign(std::max(counts[g], 1), 7);
+                    res[g] = run.res[p][g].data();
+                    data[g] = x[p][g].data();
+                }
+                std::vector<u8> scratch(100);
+                u8* out = scratch.data();
+
+                u64 r0 = exchanges(iopack);
+                mill.compare_batch(res, data, counts.data(), bitlengths.data(), numGroups, run.gt, run.radix);
+                u64 r1 = exchanges(iopack);
+                mill.compare_batch(&out, &data[widest], &counts[widest], &bitlengths[widest], 1,
+                    run.gt, run.radix);
+                u64 r2 = exchanges(iopack);
+                for (int g = 0; g < numGroups; ++g)
+                    if (counts[g])
+                        mill.compare_batch(&out, &data[g], &counts[g], &bitlengths[g], 1, run.gt, run.radix);
+                u64 r3 = exchanges(iopack);
+                const int zero[2] = { 0, 0 };
+                u64 sent = iopack.io->counter + iopack.io_rev->counter;
+                mill.compare_batch(res, data, zero, bitlengths.data(), 2, run.gt, run.radix);
+                u64 r4 = exchanges(iopack) + iopack.io->counter + iopack.io_rev->counter - sent;
+                if (p == sci::ALICE)
+                {
+                    run.batch = r1 - r0;
+                    run.alone = r2 - r1;
+                    run.sum = r3 - r2;
+                    run.empty = r4 - r3;
+                }
+            }
+        };
+        sciRunParties([&] { party(sci::ALICE); }, [&] { party(sci::BOB); });
+
+        for (auto& run : runs)
+        {
+            std::string where = " at radix " + std::to_string(run.radix) +
+                (run.gt ? ", greater_than. " : ", less_than. ");
+            for (int g = 0; g < numGroups; ++g)
+            {
+                if (counts[g] == 0 && (run.res[1][g][0] != 7 || run.res[2][g][0] != 7))
+                    throw std::runtime_error("compare_batch wrote to an empty group" + where + LOCATION);
+                for (int i = 0; i < counts[g]; ++i)
+                {
+                    u64 a = x[1][g][i], b = x[2][g][i];
+                    if ((run.res[1][g][i] ^ run.res[2][g][i]) != (run.gt ? a > b : a < b))
+                        throw std::runtime_error("wrong compare_batch result" + where + LOCATION);
+                }
+            }
+            if (run.batch != run.alone || run.batch >= run.sum)
+                throw std::runtime_error("compare_batch took " + std::to_string(run.batch) +
+                    " exchanges, the widest group alone " + std::to_string(run.alone) +
+                    " and all groups one by one " + std::to_string(run.sum) + where + LOCATION);
+            if (run.empty != 0)
+                throw std::runtime_error("compare_batch of empty groups communicated" + where + LOCATION);
+        }
+    }
+}
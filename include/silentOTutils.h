@@ -17,6 +17,7 @@
 #include <iomanip>
 
 #include <Millionaire/millionaire.h>
+#include <Millionaire/mill-tuner.h>
 
 using namespace osuCrypto;
 using namespace std;
@@ -964,4 +965,373 @@ void silent_ot_sender_offline_test(CLP& cmd)
     // ========================================================
     sender.silentSendOffline(prng.get(), numOTs, prng);
     // ========================================================
-}
\ No newline at end of file
+}
+
+/*
+    Random OTs for TripleGenerator's _2ROT method from silent OT, so that
+    the triples cost the silent OT's sublinear communication instead of two
+    IKNP OTs each. Every call runs one silent random OT batch in each
+    direction on chl, ALICE being the sender of the first and BOB of the
+    second, and keeps the low bit of every hashed ROT message. The silent
+    base OTs are generated by the first batch of each direction.
+
+    Set it as TripleGenerator::rot_source on both parties, e.g.
+        SilentRotSource src(party, chl, prng.get());
+        mill.triple_gen->rot_source = &src;
+*/
+class SilentRotSource : public RotSource
+{
+public:
+    int mParty;
+    Socket mChl;
+    PRNG mPrng;
+    u64 mNumThreads;
+    SilentOtExtSender mSender;
+    SilentOtExtReceiver mRecver;
+
+    SilentRotSource(int party, Socket chl, block seed, u64 numThreads = 1)
+        : mParty(party), mChl(std::move(chl)), mPrng(seed), mNumThreads(numThreads)
+    {}
+
+    void rots(u8* s0, u8* s1, u8* b, u8* r, int numOts) override
+    {
+        if (numOts <= 0)
+            return;
+        std::vector<std::array<block, 2>> sent(numOts);
+        std::vector<block> recvd(numOts);
+        BitVector choice(numOts);
+        mSender.configure(numOts, 2, mNumThreads);
+        mRecver.configure(numOts, 2, mNumThreads);
+
+        if (mParty == sci::ALICE)
+        {
+            cp::sync_wait(mSender.silentSend(sent, mPrng, mChl));
+            cp::sync_wait(mRecver.silentReceive(choice, recvd, mPrng, mChl));
+        }
+        else
+        {
+            cp::sync_wait(mRecver.silentReceive(choice, recvd, mPrng, mChl));
+            cp::sync_wait(mSender.silentSend(sent, mPrng, mChl));
+        }
+        cp::sync_wait(mChl.flush());
+
+        // Only the hashed ROT messages may be used: the low bits of raw COT
+        // outputs (mB, mB ^ mDelta) differ by a fixed bit of mDelta.
+        u64 numBytes = divCeil(numOts, 8);
+        memset(s0, 0, numBytes);
+        memset(s1, 0, numBytes);
+        memset(r, 0, numBytes);
+        memcpy(b, choice.data(), numBytes);
+        for (int i = 0; i < numOts; ++i)
+        {
+            s0[i / 8] |= (sent[i][0].get<u8>(0) & 1) << (i % 8);
+            s1[i / 8] |= (sent[i][1].get<u8>(0) & 1) << (i % 8);
+            r[i / 8] |= (recvd[i].get<u8>(0) & 1) << (i % 8);
+        }
+    }
+};
+
+/*
+    Generates _2ROT bit triples with SilentRotSource on both parties, packed
+    and one bit per byte, over several batches of different sizes. Every
+    triple must satisfy (a0 ^ a1) & (b0 ^ b1) = c0 ^ c1, and the shared a
+    and b must be balanced. The TripleGenerators have no IOPack or OTPack,
+    so the IKNP path cannot be taken by mistake.
+*/
+void silent_rot_triple_test(const CLP& cmd)
+{
+    auto sockets = cp::LocalAsyncSocket::makePair();
+    const std::vector<int> sizes = { 1 << 14, 1000, 5003 };
+
+    // abc[p][packed] holds party p's a, b and c of all batches.
+    std::vector<u8> abc[3][2][3];
+    auto party = [&](int p)
+    {
+        SilentRotSource src(p, sockets[p - 1], toBlock(p, cmd.getOr<u64>("seed", 0)));
+        TripleGenerator gen(p, nullptr, nullptr);
+        gen.rot_source = &src;
+        for (int packed = 0; packed < 2; ++packed)
+            for (int n : sizes)
+            {
+                if (packed && n % 8)
+                    continue;
+                u64 len = packed ? n / 8 : n, pos = abc[p][packed][0].size();
+                for (auto& v : abc[p][packed])
+                    v.resize(pos + len);
+                gen.generate(p, abc[p][packed][0].data() + pos, abc[p][packed][1].data() + pos,
+                    abc[p][packed][2].data() + pos, n, _2ROT, packed);
+            }
+    };
+    std::thread alice([&] { party(sci::ALICE); });
+    party(sci::BOB);
+    alice.join();
+
+    for (int packed = 0; packed < 2; ++packed)
+    {
+        auto& x = abc[1][packed];
+        auto& y = abc[2][packed];
+        u64 ones[2] = { 0, 0 }, bits = 0;
+        for (u64 i = 0; i < x[0].size(); ++i)
+        {
+            u8 a = x[0][i] ^ y[0][i], b = x[1][i] ^ y[1][i], c = x[2][i] ^ y[2][i];
+            if ((a & b) != c || (!packed && (a | b | c) > 1))
+                throw std::runtime_error("invalid triple from silent ROTs. " LOCATION);
+            ones[0] += popcount(a);
+            ones[1] += popcount(b);
+            bits += packed ? 8 : 1;
+        }
+        for (auto o : ones)
+            if (o < bits * 45 / 100 || o > bits * 55 / 100)
+                throw std::runtime_error("unbalanced triples from silent ROTs. " LOCATION);
+    }
+}
+
+/*
+    Benchmarks the bit-matrix transposition kernels of utils/transpose.h in
+    isolation, on the shapes of the IKNP (128 x block) and KKOT (256 x block,
+    block x 256) extension matrices. Each kernel is checked against sse_trans
+    before it is timed.
+
+    Parameters:
+        @param cmd : the command line parser
+            -rows, -cols : benchmark this shape instead of the default ones
+            -trials      : transpositions per kernel and shape
+*/
+void bit_trans_bench(CLP& cmd)
+{
+    auto trials = cmd.getOr<u64>("trials", 200);
+    std::vector<std::array<u64, 2>> shapes = { {128, 16384}, {256, 16384}, {16384, 256} };
+    if (cmd.isSet("rows") && cmd.isSet("cols"))
+        shapes = { {cmd.get<u64>("rows"), cmd.get<u64>("cols")} };
+
+    cout << "default kernel: " << sci::trans_kernel_name(sci::trans_kernel()) << endl;
+
+    PRNG prng(toBlock(cmd.getOr("seed", 0)));
+    for (auto& shape : shapes)
+    {
+        u64 rows = shape[0], cols = shape[1], bytes = rows * cols / 8;
+        if (rows % 8 || cols % 8)
+            throw std::runtime_error("rows and cols must be multiples of 8. " LOCATION);
+
+        std::vector<u8> in(bytes), ref(bytes), out(bytes);
+        prng.get(in.data(), bytes);
+        sci::sse_trans(ref.data(), in.data(), rows, cols);
+
+        for (auto kernel : { sci::TRANS_SSE, sci::TRANS_AVX2, sci::TRANS_AVX512 })
+        {
+            cout << setw(6) << rows << " x " << setw(6) << cols << " " << setw(6)
+                << sci::trans_kernel_name(kernel);
+            if (!sci::trans_kernel_supported(kernel))
+            {
+                cout << " unsupported" << endl;
+                continue;
+            }
+
+            sci::bit_trans(out.data(), in.data(), rows, cols, kernel);
+            if (out != ref)
+                throw std::runtime_error("transposition mismatch. " LOCATION);
+
+            auto t0 = std::chrono::steady_clock::now();
+            for (u64 i = 0; i < trials; ++i)
+                sci::bit_trans(out.data(), in.data(), rows, cols, kernel);
+            double ns = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - t0).count() / trials;
+
+            cout << " " << fixed << setprecision(0) << setw(10) << ns << " ns "
+                << setprecision(2) << setw(6) << bytes / ns << " GB/s" << defaultfloat << endl;
+        }
+    }
+}
+
+/*
+    Runs OTPack::SetupBaseOTs for one party over a fresh IOPack and checks
+    the derived instances with a few OTs on kkot[KKOT_TYPES - 1],
+    iknp_straight and iknp_reversed. Returns the setup time in milliseconds
+    and reports the rounds and bytes of the setup on io.
+*/
+double otpack_setup_party(int party, int port, bool derive, sci::BaseOTKind kind,
+    u64 latencyUs, u64& rounds, u64& comm)
+{
+    sci::IOPack iopack(party, port);
+    iopack.io->emulated_latency_us = latencyUs;
+    iopack.io_rev->emulated_latency_us = latencyUs;
+    iopack.io->sync();
+    iopack.io_rev->sync();
+    u64 rounds0 = iopack.io->num_rounds, comm0 = iopack.get_comm();
+
+    auto t0 = std::chrono::steady_clock::now();
+    sci::OTPack otpack(&iopack, party, true, derive, kind);
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - t0).count();
+    rounds = iopack.io->num_rounds - rounds0;
+    comm = iopack.get_comm() - comm0;
+
+    // Fixed messages and choices so that both parties can check the outputs.
+    const int n = 64, N = 1 << KKOT_TYPES;
+    std::vector<u8> msgs(n * N), choice(n), out8(n);
+    std::vector<u8*> rows(n);
+    std::vector<sci::block128> d0(n), d1(n), out(n);
+    std::unique_ptr<bool[]> b(new bool[n]);
+    for (int i = 0; i < n; ++i)
+    {
+        rows[i] = msgs.data() + i * N;
+        for (int j = 0; j < N; ++j)
+            rows[i][j] = u8(i * 31 + j);
+        choice[i] = u8(i * 37);
+        b[i] = choice[i] & 1;
+        d0[i] = sci::makeBlock128(i, 0);
+        d1[i] = sci::makeBlock128(i, 1);
+    }
+    auto check = [&](bool ok) {
+        if (!ok)
+            throw std::runtime_error("OTPack setup check failed. " LOCATION);
+    };
+
+    if (party == sci::ALICE)
+    {
+        otpack.kkot[KKOT_TYPES - 1]->send(rows.data(), n, 8);
+        otpack.iknp_straight->send(d0.data(), d1.data(), n);
+        otpack.iknp_reversed->recv(out.data(), b.get(), n);
+    }
+    else
+    {
+        otpack.kkot[KKOT_TYPES - 1]->recv(out8.data(), choice.data(), n, 8);
+        for (int i = 0; i < n; ++i)
+            check(out8[i] == rows[i][choice[i]]);
+        otpack.iknp_straight->recv(out.data(), b.get(), n);
+        otpack.iknp_reversed->send(d0.data(), d1.data(), n);
+    }
+    for (int i = 0; i < n; ++i)
+        check(sci::cmpBlock(&out[i], b[i] ? &d1[i] : &d0[i], 1));
+    iopack.io->flush();
+    iopack.io_rev->flush();
+    return ms;
+}
+
+/*
+    Benchmarks the startup latency of OTPack, i.e. the base-OT setup of all
+    its OT instances, with the sequential and the derived setup mode and
+    every compiled-in base-OT backend. Both parties run in this process over
+    localhost, and every NetIO adds half of the emulated RTT before the first
+    recv of each round.
+
+    Parameters:
+        @param cmd : the command line parser
+            -rtt  : emulated round-trip times in milliseconds (default 0 20 80)
+            -port : first port to use
+*/
+void otpack_setup_bench(CLP& cmd)
+{
+    auto rtts = cmd.getManyOr<double>("rtt", { 0, 20, 80 });
+    int port = cmd.getOr("port", 32000);
+
+    for (auto rtt : rtts) for (bool derive : { false, true })
+    for (auto kind : { sci::BASE_OT_NP, sci::BASE_OT_CO })
+    {
+        if (!sci::base_ot_kind_supported(kind))
+            continue;
+        u64 latencyUs = u64(rtt * 500);
+        u64 rounds[2], comm[2];
+        double ms[2];
+        std::thread server([&] {
+            ms[0] = otpack_setup_party(sci::ALICE, port, derive, kind, latencyUs, rounds[0], comm[0]);
+        });
+        ms[1] = otpack_setup_party(sci::BOB, port, derive, kind, latencyUs, rounds[1], comm[1]);
+        server.join();
+        port += 200;
+
+        cout << "rtt " << fixed << setprecision(1) << setw(6) << rtt << " ms | " << setw(10)
+            << (derive ? "derived" : "sequential") << " | " << setw(15)
+            << sci::base_ot_kind_name(kind) << " | setup "
+            << setw(8) << std::max(ms[0], ms[1]) << " ms | rounds " << setw(3) << rounds[0]
+            << " | comm " << setw(7) << (comm[0] + comm[1]) / 1024 << " KiB" << defaultfloat << endl;
+    }
+}
+
+/*
+    Runs MillTuner for both parties in this process and reports the
+    MillParams it picks for each bitlength and call size. Every NetIO adds
+    half of the emulated RTT before the first recv of each round, so the
+    choice can be seen to move with the link. Each choice is then used for
+    a compare call that is checked against the plaintext result.
+
+    Parameters:
+        @param cmd : the command line parser
+            -rtt     : emulated round-trip time in milliseconds (default 0)
+            -l       : bitlengths to tune (default 32 64)
+            -n       : compares per call to choose for (default 1000 1000000)
+            -samples : comparisons per measured call of autotune
+            -port    : port to use
+*/
+void mill_tune_bench(CLP& cmd)
+{
+    double rtt = cmd.getOr("rtt", 0.0);
+    auto bitlengths = cmd.getManyOr<int>("l", { 32, 64 });
+    auto counts = cmd.getManyOr<u64>("n", { 1000, 1000000 });
+    int samples = cmd.getOr("samples", 1 << 12);
+    int port = cmd.getOr("port", 32000);
+    // compares run with each choice, capped to bound the memory
+    const u64 maxCheck = 1 << 16;
+
+    std::vector<u64> x[3];
+    std::vector<std::vector<u8>> res[3];
+    PRNG prng(toBlock(cmd.getOr("seed", 0)));
+    for (int p = 1; p <= 2; ++p)
+    {
+        x[p].resize(maxCheck);
+        prng.get(x[p].data(), x[p].size());
+    }
+
+    auto party = [&](int p)
+    {
+        sci::IOPack iopack(p, port);
+        iopack.io->emulated_latency_us = u64(rtt * 500);
+        iopack.io_rev->emulated_latency_us = u64(rtt * 500);
+        sci::OTPack otpack(&iopack, p);
+        MillionaireProtocol mill(p, &iopack, &otpack);
+        MillTuner tuner(p, &iopack);
+
+        auto link = tuner.measure_link();
+        if (p == sci::ALICE)
+            cout << "link rtt " << fixed << setprecision(1) << link.rtt_us << " us, "
+                << link.bytes_per_us << " B/us" << defaultfloat << endl;
+        for (int l : bitlengths)
+            tuner.autotune(&mill, l, samples);
+
+        std::vector<u64> data(maxCheck);
+        for (int l : bitlengths) for (u64 n : counts)
+        {
+            MillParams params = tuner.choose(l, n);
+            u64 num = std::min(n, maxCheck);
+            for (u64 i = 0; i < num; ++i)
+                data[i] = x[p][i] & sci::bit_mask(l);
+            res[p].emplace_back(num);
+
+            auto t0 = std::chrono::steady_clock::now();
+            mill.compare(res[p].back().data(), data.data(), num, l, true, params);
+            iopack.io->flush();
+            double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - t0).count();
+
+            if (p == sci::ALICE)
+                cout << "l " << setw(2) << l << " | n " << setw(9) << n << " | radix "
+                    << params.radix_base << " | corr " << params.corr_triples << " | "
+                    << setw(13) << (params.std_method == _2ROT ? "2ROT" : "16KKOT_to_4OT")
+                    << " | " << num << " compares " << fixed << setprecision(1) << setw(8)
+                    << ms << " ms" << defaultfloat << endl;
+        }
+    };
+    std::thread server([&] { party(sci::ALICE); });
+    party(sci::BOB);
+    server.join();
+
+    u64 k = 0;
+    for (int l : bitlengths) for (u64 n : counts)
+    {
+        auto& r1 = res[1][k], & r2 = res[2][k];
+        for (u64 i = 0; i < r1.size(); ++i)
+            if ((r1[i] ^ r2[i]) != ((x[1][i] & sci::bit_mask(l)) > (x[2][i] & sci::bit_mask(l))))
+                throw std::runtime_error("compare with the tuned parameters failed. " LOCATION);
+        ++k;
+    }
+}
@@ -36,6 +36,8 @@ const static int HASH_BUFFER_SIZE = 1024 * 8;
 const static int NETWORK_BUFFER_SIZE =
     1024 * 16; // Should change depending on the network
 const static int FILE_BUFFER_SIZE = 1024 * 16;
+// Bytes a MemIO sender can run ahead of its peer, per direction.
+const static int MEM_IO_RING_SIZE = 1 << 22;
 const static int CHECK_BUFFER_SIZE = 1024 * 8;
 
 const static int XOR = -1;
@@ -15,4 +15,5 @@
 #include "utils/hash.h"
 #include "utils/prg.h"
 #include "utils/prp.h"
+#include "utils/transpose.h"
 #include "utils/utils.h"
@@ -69,12 +69,14 @@ public:
   size_t size();
   void from_bin(Group *g, const unsigned char *buf, size_t buf_len);
 
-  Point add(Point &rhs);
+  // Arithmetic uses the group's BN_CTX unless ctx is given. Threads sharing
+  // a group must each pass their own ctx.
+  Point add(Point &rhs, BN_CTX *ctx = nullptr);
   //		Point sub(Point & rhs);
   //		bool is_at_infinity();
   //		bool is_on_curve();
-  Point mul(const BigInt &m);
-  Point inv();
+  Point mul(const BigInt &m, BN_CTX *ctx = nullptr);
+  Point inv(BN_CTX *ctx = nullptr);
   bool operator==(Point &rhs);
 };
 
@@ -90,7 +92,7 @@ public:
   void resize_scratch(size_t size);
   void get_rand_bn(BigInt &n);
   Point get_generator();
-  Point mul_gen(const BigInt &m);
+  Point mul_gen(const BigInt &m, BN_CTX *ctx = nullptr);
 };
 
 } // namespace emp
@@ -136,27 +136,28 @@ inline void Point::from_bin(Group *g, const unsigned char *buf,
     sci::error("ECC FROM_BIN");
 }
 
-inline Point Point::add(Point &rhs) {
+inline Point Point::add(Point &rhs, BN_CTX *ctx) {
   Point ret(group);
-  int res =
-      EC_POINT_add(group->ec_group, ret.point, point, rhs.point, group->bn_ctx);
+  int res = EC_POINT_add(group->ec_group, ret.point, point, rhs.point,
+                         ctx ? ctx : group->bn_ctx);
   if (res == 0)
     sci::error("ECC ADD");
   return ret;
 }
 
-inline Point Point::mul(const BigInt &m) {
+inline Point Point::mul(const BigInt &m, BN_CTX *ctx) {
   Point ret(group);
-  int res =
-      EC_POINT_mul(group->ec_group, ret.point, NULL, point, m.n, group->bn_ctx);
+  int res = EC_POINT_mul(group->ec_group, ret.point, NULL, point, m.n,
+                         ctx ? ctx : group->bn_ctx);
   if (res == 0)
     sci::error("ECC MUL");
   return ret;
 }
 
-inline Point Point::inv() {
+inline Point Point::inv(BN_CTX *ctx) {
   Point ret(*this);
-  int res = EC_POINT_invert(group->ec_group, ret.point, group->bn_ctx);
+  int res =
+      EC_POINT_invert(group->ec_group, ret.point, ctx ? ctx : group->bn_ctx);
   if (res == 0)
     sci::error("ECC INV");
   return ret;
@@ -205,9 +206,10 @@ inline Point Group::get_generator() {
   return res;
 }
 
-inline Point Group::mul_gen(const BigInt &m) {
+inline Point Group::mul_gen(const BigInt &m, BN_CTX *ctx) {
   Point res(this);
-  int ret = EC_POINT_mul(ec_group, res.point, m.n, NULL, NULL, bn_ctx);
+  int ret =
+      EC_POINT_mul(ec_group, res.point, m.n, NULL, NULL, ctx ? ctx : bn_ctx);
   if (ret == 0)
     sci::error("ECC GEN MUL");
   return res;
@@ -29,6 +29,8 @@ Modified by Deevashwer Rathee
 #define IO_CHANNEL_H__
 #include "utils/block.h"
 #include "utils/group.h"
+#include <cstring>
+#include <vector>
 
 /** @addtogroup IO
   @{
@@ -76,6 +78,42 @@ public:
     }
   }
 
+  /*
+    Bulk variants of send_pt/recv_pt: all num_pts points go out as one
+    buffer, a 4-byte byte count followed by a 1-byte length and the encoding
+    of each point, so a batch costs a single send_data/recv_data pair.
+  */
+  void send_pts(emp::Point *A, int num_pts) {
+    std::vector<unsigned char> buf(4);
+    for (int i = 0; i < num_pts; ++i) {
+      size_t len = A[i].size();
+      if (len > 255)
+        sci::error("point encoding too long");
+      size_t off = buf.size();
+      buf.resize(off + 1 + len);
+      buf[off] = (unsigned char)len;
+      A[i].to_bin(buf.data() + off + 1, len);
+    }
+    uint32_t nbytes = buf.size() - 4;
+    memcpy(buf.data(), &nbytes, 4);
+    send_data(buf.data(), buf.size());
+  }
+
+  void recv_pts(emp::Group *g, emp::Point *A, int num_pts) {
+    uint32_t nbytes = 0;
+    recv_data(&nbytes, 4);
+    std::vector<unsigned char> buf(nbytes);
+    recv_data(buf.data(), nbytes);
+    size_t off = 0;
+    for (int i = 0; i < num_pts; ++i) {
+      if (off >= nbytes || off + 1 + buf[off] > nbytes)
+        sci::error("truncated point buffer");
+      size_t len = buf[off];
+      A[i].from_bin(g, buf.data() + off + 1, len);
+      off += 1 + len;
+    }
+  }
+
 private:
   T &derived() { return *static_cast<T *>(this); }
 };
@@ -14,9 +14,18 @@ public:
   std::string address;
   int party, port;
 
+  // With address MEM_IO_ADDRESS both parties must be threads of this
+  // process; each NetIO then runs over a MemIO on its port instead of TCP.
   IOPack(int party, int port, std::string address = "127.0.0.1") {
     this->party = party;
     this->port = port;
+    this->address = address;
+    if (address == MEM_IO_ADDRESS) {
+      this->io = new NetIO(new MemIO(party, port));
+      this->io_rev = new NetIO(new MemIO(party, port + REV_PORT_OFFSET));
+      this->io_GC = new NetIO(new MemIO(party, port + GC_PORT_OFFSET));
+      return;
+    }
     this->io =
         new NetIO(party == 1 ? nullptr : address.c_str(), port, false, false);
     this->io_rev = new NetIO(party == 1 ? nullptr : address.c_str(),
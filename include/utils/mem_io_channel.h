@@ -0,0 +1,154 @@
+/*
+In-process loopback channel. Both parties run as threads of one process and
+exchange bytes through two single-producer single-consumer rings, one per
+direction, so a protocol can be run and profiled from a single binary
+without sockets or the kernel TCP stack.
+
+Endpoints meet by port, the way NetIO's server and client do: the first
+MemIO constructed on a port creates the link and the other party's MemIO on
+the same port takes it, whichever thread gets there first. A ring holds
+MEM_IO_RING_SIZE bytes; a sender that gets that far ahead of its peer waits,
+as it would on a full socket buffer. Waiting spins briefly and then yields,
+since both ends are expected to be busy threads of the same benchmark.
+*/
+
+#ifndef MEM_IO_CHANNEL_H__
+#define MEM_IO_CHANNEL_H__
+#include "utils/constants.h"
+#include "utils/io_channel.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// IOPack address that connects both parties in-process through MemIO.
+#define MEM_IO_ADDRESS "inproc"
+
+namespace sci {
+/** @addtogroup IO
+  @{
+ */
+
+class MemRing {
+public:
+  MemRing(uint64_t capacity) {
+    this->capacity = capacity;
+    buf = new char[capacity];
+  }
+
+  ~MemRing() { delete[] buf; }
+
+  void write(const char *data, uint64_t len) {
+    while (len > 0) {
+      uint64_t t = tail.load(std::memory_order_relaxed);
+      uint64_t space;
+      wait_until([&] {
+        space = capacity - (t - head.load(std::memory_order_acquire));
+        return space > 0;
+      });
+      uint64_t n = std::min(len, space);
+      uint64_t pos = t % capacity;
+      uint64_t first = std::min(n, capacity - pos);
+      memcpy(buf + pos, data, first);
+      memcpy(buf, data + first, n - first);
+      tail.store(t + n, std::memory_order_release);
+      data += n;
+      len -= n;
+    }
+  }
+
+  void read(char *data, uint64_t len) {
+    while (len > 0) {
+      uint64_t h = head.load(std::memory_order_relaxed);
+      uint64_t avail;
+      wait_until([&] {
+        avail = tail.load(std::memory_order_acquire) - h;
+        return avail > 0;
+      });
+      uint64_t n = std::min(len, avail);
+      uint64_t pos = h % capacity;
+      uint64_t first = std::min(n, capacity - pos);
+      memcpy(data, buf + pos, first);
+      memcpy(data + first, buf, n - first);
+      head.store(h + n, std::memory_order_release);
+      data += n;
+      len -= n;
+    }
+  }
+
+private:
+  template <typename F> static void wait_until(F ready) {
+    for (int spins = 0; !ready(); spins++) {
+      if (spins < 1024)
+        _mm_pause();
+      else
+        std::this_thread::yield();
+    }
+  }
+
+  char *buf;
+  uint64_t capacity;
+  // Total bytes read and written; kept on separate cache lines.
+  alignas(64) std::atomic<uint64_t> head{0};
+  alignas(64) std::atomic<uint64_t> tail{0};
+};
+
+// Both directions of one connection.
+struct MemLink {
+  MemRing to_server, to_client;
+  MemLink(uint64_t capacity) : to_server(capacity), to_client(capacity) {}
+};
+
+// Carries the bytes of a NetIO (see NetIO(MemIO *)), which keeps the byte
+// and round counters and implements sync().
+class MemIO : public IOChannel<MemIO> {
+public:
+  bool is_server;
+  int port;
+
+  // ALICE is the server end, as with NetIO in IOPack.
+  MemIO(int party, int port, uint64_t ring_size = MEM_IO_RING_SIZE) {
+    this->is_server = (party == ALICE);
+    this->port = port;
+    link = connect(party, port, ring_size);
+    out = is_server ? &link->to_client : &link->to_server;
+    in = is_server ? &link->to_server : &link->to_client;
+  }
+
+  // Bytes are visible to the peer as soon as send_data returns.
+  void flush() {}
+
+  void send_data(const void *data, int len) {
+    out->write((const char *)data, len);
+  }
+
+  void recv_data(void *data, int len) { in->read((char *)data, len); }
+
+private:
+  std::shared_ptr<MemLink> link;
+  MemRing *out, *in;
+
+  static std::shared_ptr<MemLink> connect(int party, int port,
+                                          uint64_t ring_size) {
+    static std::mutex mtx;
+    static std::map<int, std::pair<int, std::shared_ptr<MemLink>>> pending;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = pending.find(port);
+    if (it == pending.end()) {
+      auto link = std::make_shared<MemLink>(ring_size);
+      pending[port] = {party, link};
+      return link;
+    }
+    if (it->second.first == party)
+      error("MemIO: both ends of a port belong to the same party");
+    auto link = it->second.second;
+    pending.erase(it);
+    return link;
+  }
+};
+/**@}*/
+
+} // namespace sci
+#endif // MEM_IO_CHANNEL_H__
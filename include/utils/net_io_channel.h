@@ -26,6 +26,7 @@ Enquiries about further applications and development opportunities are welcome.
 #define NETWORK_IO_CHANNEL
 
 #include "utils/io_channel.h"
+#include "utils/mem_io_channel.h"
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
@@ -59,8 +60,29 @@ public:
   int port;
   uint64_t counter = 0;
   uint64_t num_rounds = 0;
+  // number of fwrite/fread calls on the unbuffered stream, i.e. a lower
+  // bound on the number of send/recv syscalls. Over a MemIO every
+  // send_data/recv_data counts as one call.
+  uint64_t num_send_calls = 0;
+  uint64_t num_recv_calls = 0;
+  // one-way latency in microseconds added before the first recv of every
+  // round, to emulate a WAN link in benchmarks. 0 disables it.
+  uint64_t emulated_latency_us = 0;
   bool FBF_mode;
   LastCall last_call = LastCall::None;
+  // In-process endpoint that carries the bytes instead of a socket, or
+  // nullptr. Counters and the emulated latency apply all the same.
+  MemIO *mem = nullptr;
+
+  // Takes ownership of mem. There is no socket, so consocket stays -1.
+  NetIO(MemIO *mem) {
+    this->mem = mem;
+    this->consocket = -1;
+    this->port = mem->port;
+    this->is_server = mem->is_server;
+    this->FBF_mode = false;
+  }
+
   NetIO(const char *address, int port, bool full_buffer = false,
         bool quiet = false) {
     this->port = port;
@@ -137,6 +159,10 @@ public:
   }
 
   ~NetIO() {
+    if (mem != nullptr) {
+      delete mem;
+      return;
+    }
     fflush(stream);
     close(consocket);
     delete[] buffer;
@@ -144,25 +170,35 @@ public:
 
   void set_FBF() {
     flush();
-    setvbuf(stream, buffer, _IOFBF, NETWORK_BUFFER_SIZE);
+    if (mem == nullptr)
+      setvbuf(stream, buffer, _IOFBF, NETWORK_BUFFER_SIZE);
   }
 
   void set_NBF() {
     flush();
-    setvbuf(stream, buffer, _IONBF, NETWORK_BUFFER_SIZE);
+    if (mem == nullptr)
+      setvbuf(stream, buffer, _IONBF, NETWORK_BUFFER_SIZE);
   }
 
+  // No-ops over a MemIO, which has no socket.
   void set_nodelay() {
+    if (mem != nullptr)
+      return;
     const int one = 1;
     setsockopt(consocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
   }
 
   void set_delay() {
+    if (mem != nullptr)
+      return;
     const int zero = 0;
     setsockopt(consocket, IPPROTO_TCP, TCP_NODELAY, &zero, sizeof(zero));
   }
 
-  void flush() { fflush(stream); }
+  void flush() {
+    if (mem == nullptr)
+      fflush(stream);
+  }
 
   void send_data(const void *data, int len) {
     if (last_call != LastCall::Send) {
@@ -170,9 +206,15 @@ public:
       last_call = LastCall::Send;
     }
     counter += len;
+    if (mem != nullptr) {
+      mem->send_data(data, len);
+      num_send_calls++;
+      return;
+    }
     int sent = 0;
     while (sent < len) {
       int res = fwrite(sent + (char *)data, 1, len - sent, stream);
+      num_send_calls++;
       if (res >= 0)
         sent += res;
       else
@@ -182,16 +224,25 @@ public:
   }
 
   void recv_data(void *data, int len) {
-    if (last_call != LastCall::Recv) {
+    bool new_round = (last_call != LastCall::Recv);
+    if (new_round) {
       num_rounds++;
       last_call = LastCall::Recv;
     }
     if (has_sent)
       fflush(stream);
     has_sent = false;
+    if (new_round && emulated_latency_us)
+      usleep(emulated_latency_us);
+    if (mem != nullptr) {
+      mem->recv_data(data, len);
+      num_recv_calls++;
+      return;
+    }
     int sent = 0;
     while (sent < len) {
       int res = fread(sent + (char *)data, 1, len - sent, stream);
+      num_recv_calls++;
       if (res >= 0)
         sent += res;
       else
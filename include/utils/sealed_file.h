@@ -0,0 +1,124 @@
+/*
+Authenticated encryption of small local state files (e.g. OT setup keys).
+
+The file holds "SCISEAL1" || iv (12 bytes) || tag (16 bytes) || ciphertext,
+where the ciphertext is the AES-128-GCM encryption of the payload under the
+caller's key with the magic as associated data. Files are written to a
+temporary path, synced and renamed, so a reader never sees a partial file.
+*/
+
+#ifndef UTIL_SEALED_FILE_H__
+#define UTIL_SEALED_FILE_H__
+#include "utils/prg.h"
+#include <cstdio>
+#include <openssl/evp.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace sci {
+
+const char sealed_file_magic[] = "SCISEAL1";
+const int sealed_file_magic_len = 8, sealed_file_iv_len = 12,
+          sealed_file_tag_len = 16;
+
+inline bool write_sealed_file(const std::string &path, const block128 &key,
+                              const std::vector<uint8_t> &data) {
+  uint8_t iv[sealed_file_iv_len], tag[sealed_file_tag_len];
+  PRG128 prg;
+  prg.random_data(iv, sealed_file_iv_len);
+
+  std::vector<uint8_t> ct(data.size() + 16);
+  int len = 0, ct_len = 0;
+  bool ok = false;
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  if (ctx != nullptr &&
+      EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), nullptr, nullptr, nullptr) &&
+      EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, sealed_file_iv_len,
+                          nullptr) &&
+      EVP_EncryptInit_ex(ctx, nullptr, nullptr, (const uint8_t *)&key, iv) &&
+      EVP_EncryptUpdate(ctx, nullptr, &len, (const uint8_t *)sealed_file_magic,
+                        sealed_file_magic_len) &&
+      EVP_EncryptUpdate(ctx, ct.data(), &len, data.data(), data.size())) {
+    ct_len = len;
+    ok = EVP_EncryptFinal_ex(ctx, ct.data() + ct_len, &len) &&
+         EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, sealed_file_tag_len,
+                             tag);
+    ct_len += len;
+  }
+  EVP_CIPHER_CTX_free(ctx);
+  if (!ok)
+    return false;
+
+  std::string tmp_path = path + ".tmp";
+  FILE *f = fopen(tmp_path.c_str(), "wb");
+  if (f == nullptr)
+    return false;
+  ok = fwrite(sealed_file_magic, 1, sealed_file_magic_len, f) ==
+           (size_t)sealed_file_magic_len &&
+       fwrite(iv, 1, sealed_file_iv_len, f) == (size_t)sealed_file_iv_len &&
+       fwrite(tag, 1, sealed_file_tag_len, f) == (size_t)sealed_file_tag_len &&
+       fwrite(ct.data(), 1, ct_len, f) == (size_t)ct_len &&
+       fflush(f) == 0 && fsync(fileno(f)) == 0;
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+/*
+  Returns false if the file is missing, truncated, or does not authenticate
+  under key. data is only written on success.
+*/
+inline bool read_sealed_file(const std::string &path, const block128 &key,
+                             std::vector<uint8_t> &data) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == nullptr)
+    return false;
+  std::vector<uint8_t> file;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    file.insert(file.end(), buf, buf + n);
+  fclose(f);
+
+  const size_t header =
+      sealed_file_magic_len + sealed_file_iv_len + sealed_file_tag_len;
+  if (file.size() < header ||
+      memcmp(file.data(), sealed_file_magic, sealed_file_magic_len) != 0)
+    return false;
+  const uint8_t *iv = file.data() + sealed_file_magic_len;
+  uint8_t *tag = file.data() + sealed_file_magic_len + sealed_file_iv_len;
+  const uint8_t *ct = file.data() + header;
+  int ct_len = file.size() - header;
+
+  std::vector<uint8_t> pt(ct_len + 16);
+  int len = 0, pt_len = 0;
+  bool ok = false;
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  if (ctx != nullptr &&
+      EVP_DecryptInit_ex(ctx, EVP_aes_128_gcm(), nullptr, nullptr, nullptr) &&
+      EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, sealed_file_iv_len,
+                          nullptr) &&
+      EVP_DecryptInit_ex(ctx, nullptr, nullptr, (const uint8_t *)&key, iv) &&
+      EVP_DecryptUpdate(ctx, nullptr, &len, (const uint8_t *)sealed_file_magic,
+                        sealed_file_magic_len) &&
+      EVP_DecryptUpdate(ctx, pt.data(), &len, ct, ct_len) &&
+      EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, sealed_file_tag_len,
+                          tag)) {
+    pt_len = len;
+    ok = EVP_DecryptFinal_ex(ctx, pt.data() + pt_len, &len) > 0;
+    pt_len += len;
+  }
+  EVP_CIPHER_CTX_free(ctx);
+  if (!ok)
+    return false;
+  pt.resize(pt_len);
+  data.swap(pt);
+  return true;
+}
+
+} // namespace sci
+#endif // UTIL_SEALED_FILE_H__
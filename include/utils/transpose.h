@@ -0,0 +1,178 @@
+/*
+Bit-matrix transposition kernels for the OT extension matrices.
+
+All kernels compute the same transposition as sse_trans in utils/block.h:
+inp is an nrows x ncols bit matrix stored row-wise, and out receives the
+ncols x nrows transpose. bit_trans dispatches to the widest kernel the CPU
+supports, which is detected once at runtime, and falls back to sse_trans
+for shapes the wide kernels do not cover.
+*/
+
+#ifndef UTIL_TRANSPOSE_H__
+#define UTIL_TRANSPOSE_H__
+#include "utils/block.h"
+
+namespace sci {
+
+enum TransKernel { TRANS_AUTO = 0, TRANS_SSE, TRANS_AVX2, TRANS_AVX512 };
+
+inline const char *trans_kernel_name(TransKernel k) {
+  switch (k) {
+  case TRANS_SSE:
+    return "sse";
+  case TRANS_AVX2:
+    return "avx2";
+  case TRANS_AVX512:
+    return "avx512";
+  default:
+    return "auto";
+  }
+}
+
+inline bool trans_kernel_supported(TransKernel k) {
+  switch (k) {
+  case TRANS_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case TRANS_AVX512:
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw");
+  default:
+    return true;
+  }
+}
+
+/*
+  Kernel used by bit_trans when none is given. It starts as the widest
+  supported kernel and can be overridden, e.g. for benchmarking.
+*/
+inline TransKernel &trans_kernel() {
+  static TransKernel kernel = trans_kernel_supported(TRANS_AVX512) ? TRANS_AVX512
+                              : trans_kernel_supported(TRANS_AVX2)
+                                  ? TRANS_AVX2
+                                  : TRANS_SSE;
+  return kernel;
+}
+
+/*
+  Transposes the 16x16 byte matrix held in each 128-bit lane of x[0..15]
+  (row i of a lane in x[i]). Every round is a perfect shuffle of the
+  (vector, byte) index bits, so four rounds swap the two indices.
+*/
+__attribute__((target("avx2"))) inline void
+byte_trans_16x16_avx2(__m256i *x) {
+  __m256i y[16];
+  for (int round = 0; round < 4; ++round) {
+    for (int i = 0; i < 8; ++i) {
+      y[2 * i] = _mm256_unpacklo_epi8(x[i], x[i + 8]);
+      y[2 * i + 1] = _mm256_unpackhi_epi8(x[i], x[i + 8]);
+    }
+    for (int i = 0; i < 16; ++i)
+      x[i] = y[i];
+  }
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline void
+byte_trans_16x16_avx512(__m512i *x) {
+  __m512i y[16];
+  for (int round = 0; round < 4; ++round) {
+    for (int i = 0; i < 8; ++i) {
+      y[2 * i] = _mm512_unpacklo_epi8(x[i], x[i + 8]);
+      y[2 * i + 1] = _mm512_unpackhi_epi8(x[i], x[i + 8]);
+    }
+    for (int i = 0; i < 16; ++i)
+      x[i] = y[i];
+  }
+}
+
+/*
+  AVX2 kernel. Works on tiles of 32 rows x 128 columns: rows r and r+16 of
+  the tile share a register, a lane-wise byte transpose gathers byte j of all
+  32 rows into x[j], and 8 movemasks then emit 32 output bits per column.
+*/
+__attribute__((target("avx2"))) inline void
+avx2_trans(uint8_t *out, uint8_t const *inp, uint64_t nrows, uint64_t ncols) {
+  if (nrows % 32 != 0 || ncols % 128 != 0) {
+    sse_trans(out, inp, nrows, ncols);
+    return;
+  }
+  const uint64_t in_stride = ncols / 8, out_stride = nrows / 8;
+  __m256i x[16];
+  for (uint64_t rr = 0; rr < nrows; rr += 32) {
+    for (uint64_t cc = 0; cc < ncols; cc += 128) {
+      const uint8_t *src = inp + rr * in_stride + cc / 8;
+      for (int k = 0; k < 16; ++k) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(src + k * in_stride));
+        __m128i hi =
+            _mm_loadu_si128((const __m128i *)(src + (k + 16) * in_stride));
+        x[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+      }
+      byte_trans_16x16_avx2(x);
+      uint8_t *dst = out + cc * out_stride + rr / 8;
+      for (int j = 0; j < 16; ++j) {
+        __m256i v = x[j];
+        for (int i = 8; --i >= 0; v = _mm256_slli_epi64(v, 1))
+          *(uint32_t *)(dst + (8 * j + i) * out_stride) =
+              _mm256_movemask_epi8(v);
+      }
+    }
+  }
+}
+
+/*
+  AVX-512 kernel. Same scheme as avx2_trans on tiles of 64 rows x 128
+  columns, with rows r, r+16, r+32 and r+48 in the four lanes of a register
+  and 64-bit movepi8 masks.
+*/
+__attribute__((target("avx512f,avx512bw"))) inline void
+avx512_trans(uint8_t *out, uint8_t const *inp, uint64_t nrows,
+             uint64_t ncols) {
+  if (nrows % 64 != 0 || ncols % 128 != 0) {
+    avx2_trans(out, inp, nrows, ncols);
+    return;
+  }
+  const uint64_t in_stride = ncols / 8, out_stride = nrows / 8;
+  __m512i x[16];
+  for (uint64_t rr = 0; rr < nrows; rr += 64) {
+    for (uint64_t cc = 0; cc < ncols; cc += 128) {
+      const uint8_t *src = inp + rr * in_stride + cc / 8;
+      for (int k = 0; k < 16; ++k) {
+        __m512i v = _mm512_castsi128_si512(
+            _mm_loadu_si128((const __m128i *)(src + k * in_stride)));
+        for (int q = 1; q < 4; ++q) {
+          __m512i w = _mm512_castsi128_si512(_mm_loadu_si128(
+              (const __m128i *)(src + (k + 16 * q) * in_stride)));
+          v = _mm512_mask_shuffle_i64x2(v, (__mmask8)(3 << (2 * q)), w, w, 0);
+        }
+        x[k] = v;
+      }
+      byte_trans_16x16_avx512(x);
+      uint8_t *dst = out + cc * out_stride + rr / 8;
+      for (int j = 0; j < 16; ++j) {
+        __m512i v = x[j];
+        for (int i = 8; --i >= 0; v = _mm512_slli_epi64(v, 1))
+          *(uint64_t *)(dst + (8 * j + i) * out_stride) =
+              _mm512_movepi8_mask(v);
+      }
+    }
+  }
+}
+
+inline void bit_trans(uint8_t *out, uint8_t const *inp, uint64_t nrows,
+                      uint64_t ncols, TransKernel kernel = TRANS_AUTO) {
+  if (kernel == TRANS_AUTO)
+    kernel = trans_kernel();
+  switch (kernel) {
+  case TRANS_AVX512:
+    avx512_trans(out, inp, nrows, ncols);
+    break;
+  case TRANS_AVX2:
+    avx2_trans(out, inp, nrows, ncols);
+    break;
+  default:
+    sse_trans(out, inp, nrows, ncols);
+    break;
+  }
+}
+
+} // namespace sci
+#endif // UTIL_TRANSPOSE_H__
@@ -1,5 +1,7 @@
 #include <ExConv_tests.h>
+#include <ExConvCodeTest/ExConvCheckerTest.h>
 #include <silentOTutils.h>
+#include <SCI_tests.h>
 // using namespace tests_libOTe;
 
 using namespace osuCrypto;
@@ -9,8 +11,70 @@ int main(int argc, char** argv){
     CLP cmd;
 	cmd.parse(argc, argv);
 
+    // Runs the unit tests, -u to run all or -u <index> to pick some
+    if (cmd.isSet("u"))
+    {
+        TestCollection tests;
+        tests.add("ExConvCode_weight_thread_test", ExConvCode_weight_thread_test);
+        tests.add("ExConvCode_isd_test", ExConvCode_isd_test);
+        tests.add("ExConvResultStore_test", ExConvResultStore_test);
+        tests.add("silent_rot_triple_test", silent_rot_triple_test);
+        tests.add("OTBuffer_alloc_test", OTBuffer_alloc_test);
+        tests.add("OT_precomp_thread_test", OT_precomp_thread_test);
+        tests.add("IKNP_threads_test", IKNP_threads_test);
+        tests.add("bit_pack_test", bit_pack_test);
+        tests.add("TripleBank_test", TripleBank_test);
+        tests.add("Millionaire_bank_test", Millionaire_bank_test);
+        tests.add("Millionaire_stream_test", Millionaire_stream_test);
+        tests.add("MillTuner_test", MillTuner_test);
+        tests.add("OTPack_resume_test", OTPack_resume_test);
+        tests.add("OTNP_batched_test", OTNP_batched_test);
+#ifdef SCI_USE_SODIUM
+        tests.add("OTPack_base_ot_co_test", OTPack_base_ot_co_test);
+#endif
+        tests.add("Millionaire_lt_eq_le_test", Millionaire_lt_eq_le_test);
+        tests.add("Millionaire_batch_test", Millionaire_batch_test);
+        return tests.runIf(cmd) == TestCollection::Result::failed;
+    }
+
     // Tests ExConvCode
     //ExConvCode_tester(cmd);
+
+    // Benchmarks the stages of ExConvCode
+    if (cmd.isSet("exconvBench"))
+    {
+        ExConvCode_bench(cmd);
+        return 0;
+    }
+
+    // Estimates the minimum distance of ExConv codes over a sweep of the
+    // expander and accumulator weights, by brute force or with -isd
+    if (cmd.isSet("exconvCheck"))
+    {
+        ExConvChecker(cmd);
+        return 0;
+    }
+
+    // Benchmarks the bit-matrix transposition kernels of the OT extensions
+    if (cmd.isSet("transBench"))
+    {
+        bit_trans_bench(cmd);
+        return 0;
+    }
+
+    // Benchmarks the OTPack base-OT setup under an emulated RTT
+    if (cmd.isSet("setupBench"))
+    {
+        otpack_setup_bench(cmd);
+        return 0;
+    }
+    
+    // Tunes the millionaire parameters to the link and runs the choices
+    if (cmd.isSet("millTune"))
+    {
+        mill_tune_bench(cmd);
+        return 0;
+    }
     
     // Tests only the sender side of silent OT (offline)
     silent_ot_sender_offline_test(cmd);